@@ -26,10 +26,54 @@ using namespace std;
 #include <boost/type_traits.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/token_functions.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <unordered_map>
+#include <algorithm>
+#include <unordered_set>
+#include <cstring>
+#include <cstdint>
 
 typedef boost::escaped_list_separator<char> Parser;
 typedef boost::tokenizer<Parser> Tokenizer;
 
+/// Classifies the characters of a record as quotes, escaped
+/// characters or plain characters, so that every scan of a record
+/// gives escapes and quotes the same precedence. If the escape and
+/// quote characters are the same, a doubled quote within a quoted
+/// field is an escaped quote, as in RFC 4180.
+struct RecordScanner
+{
+  enum Char {plain, escaped, quoteMark};
+  char quote, escape;
+  bool quoted=false; ///< true within a quoted field
+  RecordScanner(char quote, char escape): quote(quote), escape(escape) {}
+  /// classify the character at \a p. If it escapes the following
+  /// character, \a p is advanced to that character.
+  template <class I>
+  Char scan(I& p, I end)
+  {
+    if (*p==escape)
+      {
+        auto q=p;
+        if (++q!=end && (escape!=quote || (quoted && *q==quote)))
+          {
+            p=q;
+            return escaped;
+          }
+      }
+    if (*p==quote)
+      {
+        quoted=!quoted;
+        return quoteMark;
+      }
+    return plain;
+  }
+};
+
 struct SpaceSeparatorParser
 {
   char escape, quote;
@@ -39,19 +83,22 @@ struct SpaceSeparatorParser
   bool operator()(I& next, I end, std::string& tok)
   {
     tok.clear();
-    bool quoted=false;
+    RecordScanner scanner(quote, escape);
     for (; next!=end; ++next)
-      if (*next==escape)
-        tok+=*(++next);
-      else if (*next==quote)
-        quoted=!quoted;
-      else if (!quoted && isspace(*next))
-        {
-          while (isspace(*next)) ++next;
-          return true;
-        }
-      else
-        tok+=*next;
+      {
+        auto c=scanner.scan(next, end);
+        if (c==RecordScanner::escaped)
+          tok+=*next;
+        else if (c==RecordScanner::plain)
+          {
+            if (!scanner.quoted && isspace(*next))
+              {
+                while (next!=end && isspace(*next)) ++next;
+                return true;
+              }
+            tok+=*next;
+          }
+      }
     return !tok.empty();
   }
   void reset() {}
@@ -75,61 +122,16 @@ namespace
 {
   const size_t maxRowsToAnalyse=100;
   
-  double quotedStoD(const string& s,size_t& charsProcd)
-  {
-    double r=stod(s,&charsProcd);
-    if (charsProcd==s.size()) return r;
-    //strip possible quote characters
-    if (!s.empty() && s[0]==s[s.size()-1])
-      {
-        r=stod(s.substr(1),&charsProcd);
-        charsProcd+=2;
-      }
-    return r;
-  }
-
-  string stripWSAndDecimalSep(const string& s)
-  {
-    string r;
-    for (auto c: s)
-      if (!isspace(c) && c!=',' && c!='.')
-        r+=c;
-    return r;
-  }
-
-  bool isNumerical(const string& s)
-  {
-    size_t charsProcd;
-    string stripped=stripWSAndDecimalSep(s);
-    try
-      {
-        quotedStoD(stripped, charsProcd);
-      }
-    catch (...) {return false;}
-    return charsProcd==stripped.size();
-  }
-  
   // returns first position of v such that all elements in that or later
-  // positions are numerical or null
-  size_t firstNumerical(const vector<string>& v)
+  // positions are numerical or null. Missing value tokens such as "NA"
+  // may be labels, so only empty elements are taken to be null here.
+  size_t firstNumerical(const vector<string>& v, char decSeparator)
   {
     size_t r=0;
+    double x;
     for (size_t i=0; i<v.size(); ++i)
-      try
-        {
-          if (!v[i].empty())
-            {
-              size_t c;
-              auto s=stripWSAndDecimalSep(v[i]);
-              quotedStoD(s,c);
-              if (c!=s.size())
-                r=i+1;
-            }
-        }
-      catch (...)
-        {
-          r=i+1;
-        }
+      if (!v[i].empty() && parseNumber(v[i], decSeparator, x)!=numberField)
+        r=i+1;
     return r;
   }
 
@@ -154,6 +156,24 @@ void DataSpec::setDataArea(size_t row, size_t col)
   dimensionCols.erase(dimensionCols.lower_bound(nColAxes()), dimensionCols.end());
 }
 
+bool DataSpec::operator==(const DataSpec& x) const
+{
+  auto sameDimension=[](const civita::Dimension& x, const civita::Dimension& y)
+    {return x.type==y.type && x.units==y.units;};
+  if (dimensions.size()!=x.dimensions.size()) return false;
+  for (size_t i=0; i<dimensions.size(); ++i)
+    if (!sameDimension(dimensions[i], x.dimensions[i])) return false;
+  return m_nRowAxes==x.m_nRowAxes && m_nColAxes==x.m_nColAxes &&
+    separator==x.separator && quote==x.quote && escape==x.escape &&
+    decSeparator==x.decSeparator && mergeDelimiters==x.mergeDelimiters &&
+    columnar==x.columnar && headerRow==x.headerRow &&
+    (missingValue==x.missingValue || (isnan(missingValue) && isnan(x.missingValue))) &&
+    horizontalDimName==x.horizontalDimName &&
+    sameDimension(horizontalDimension, x.horizontalDimension) &&
+    duplicateKeyAction==x.duplicateKeyAction && dimensionCols==x.dimensionCols &&
+    dimensionNames==x.dimensionNames;
+}
+
 
 template <class TokenizerFunction>
 void DataSpec::givenTFguessRemainder(std::istream& input, const TokenizerFunction& tf)
@@ -172,7 +192,7 @@ void DataSpec::givenTFguessRemainder(std::istream& input, const TokenizerFunctio
         if (buf.back()=='\r') buf=buf.substr(0,buf.size()-1);
         boost::tokenizer<TokenizerFunction> tok(buf.begin(),buf.end(), tf);
         vector<string> line(tok.begin(), tok.end());
-        starts.push_back(firstNumerical(line));
+        starts.push_back(firstNumerical(line, decSeparator));
         nCols=std::max(nCols, line.size());
         if (starts.back()==line.size())
           m_nRowAxes=row;
@@ -267,17 +287,12 @@ void DataSpec::guessDimensionsFromStream(std::istream& input, const T& tf)
   for (;row<=nRowAxes(); ++row) getline(input, buf);
   vector<string> data(tok.begin(),tok.end());
   for (size_t col=0; col<data.size() && col<nColAxes(); ++col)
-    try
-      {
-        // only select value type if the datafield is a pure double
-        size_t c;
-        string s=stripWSAndDecimalSep(data[col]);
-        double v=quotedStoD(s, c);
-        if (c!=s.size()) throw 0; // try parsing as time
+    {
+      double v;
+      // only select value type if the datafield is a pure double
+      if (parseNumber(data[col], decSeparator, v)==numberField)
         dimensions.emplace_back(Dimension::value,"");
-      }
-    catch (...)
-      {
+      else // try parsing as time
         try
           {
             Dimension dim(Dimension::time,"%Y-Q%Q");
@@ -297,14 +312,518 @@ void DataSpec::guessDimensionsFromStream(std::istream& input, const T& tf)
                 dimensions.emplace_back(Dimension::string,"");
               }
           }
-      }
+    }
 }
 
 
 
 
+namespace
+{
+  /// check whether memory is available for tensor data of \a n
+  /// elements, taking \a bytes. Data large enough to be held in a
+  /// mapped file once reset is reported as mapped, so it need not be
+  /// resident.
+  /// @throw if not
+  void checkTensorMemory(size_t bytes, size_t n)
+  {
+    auto& m=cminsky();
+    size_t dataBytes=n*(m.singlePrecisionParameters? sizeof(float): sizeof(double));
+    size_t mapped=dataBytes>m.mappedTensorThreshold? min(dataBytes, bytes): 0;
+    if (!m.checkMemAllocation(bytes, mapped))
+      throw runtime_error("memory threshold exceeded");
+  }
+
+  void checkTensorMemory(const CSVSizing& sizing)
+  {checkTensorMemory(sizing.bytes(), sizing.dense()? sizing.numElements(): sizing.numCells);}
+
+  /// populate the tensorInit field of \a v with \a data, a list of
+  /// (hypercube index, value) pairs, using whichever of the dense or
+  /// sparse representations needs less memory
+  void assembleTensorInit(VariableValue& v, const Hypercube& hc,
+                          const vector<pair<size_t,double>>& data, double missingValue)
+  {
+    CSVSizing sizing;
+    for (auto& i : hc.xvectors) sizing.dims.push_back(i.size());
+    sizing.numCells=data.size();
+
+    if (sizing.dense()) 
+      { // dense case
+        v.index({});
+        checkTensorMemory(hc.numElements()*sizeof(double), hc.numElements());
+        v.hypercube(hc);
+        // stash the data into vv tensorInit field
+        v.tensorInit.index({});
+        v.tensorInit.hypercube(hc);
+        for (auto& i: v.tensorInit)
+          i=missingValue;
+        for (auto& i: data)
+          v.tensorInit[i.first]=i.second;  
+      }    
+    else 
+      { // sparse case	
+        checkTensorMemory(data.size()*sizeof(double), data.size());
+        map<size_t,double> indexValue; // intermediate stash to sort index vector
+        for (auto& i: data)
+          if (!isnan(i.second))
+            indexValue.emplace(i.first, i.second);
+
+        v.tensorInit.index(indexValue);
+        size_t j=0;
+        for (auto& i: indexValue)
+          v.tensorInit[j++]=i.second;
+        v.hypercube(hc);
+        v.tensorInit.hypercube(hc);
+      }                 
+  }
+
+  /// returns the start of the record following the one starting at
+  /// \a p. Newlines within quoted fields do not terminate a record.
+  const char* nextRecord(const char* p, const char* end, char quote, char escape)
+  {
+    RecordScanner scanner(quote, escape);
+    for (; p<end; ++p)
+      if (scanner.scan(p,end)==RecordScanner::plain && *p=='\n' && !scanner.quoted)
+        return p+1;
+    return end;
+  }
+
+  /// fields of a record. Fields refer directly into the record,
+  /// except those containing quotes or escapes, which are unescaped
+  /// into a pool of reusable strings.
+  struct Record
+  {
+    vector<boost::string_ref> fields;
+    vector<string> pool;
+    vector<char> pooled;
+    size_t size() const {return fields.size();}
+    boost::string_ref operator[](size_t i) const {return fields[i];}
+  };
+  
+  /// split the record [b,e) into fields according to \a spec
+  void splitRecord(const char* b, const char* e, const DataSpec& spec, Record& record)
+  {
+    record.fields.clear();
+    record.pooled.clear();
+    if (b<e && e[-1]=='\n') --e;
+    if (b<e && e[-1]=='\r') --e; // remove trailing carriage returns
+    if (b==e) return;
+    bool space=spec.separator==' ';
+    auto isSeparator=[&](char c) {return space? isspace(c): c==spec.separator;};
+    auto start=b;
+    bool pooled=false;
+    auto pool=[&]()->string& {
+      size_t n=record.fields.size();
+      if (n>=record.pool.size()) record.pool.resize(n+1);
+      return record.pool[n];
+    };
+    // copy the field so far to the pool, up to \a p
+    auto usePool=[&](const char* p) {
+      if (!pooled)
+        {
+          pool().assign(start,p);
+          pooled=true;
+        }
+    };
+    auto endField=[&](const char* p) {
+      record.fields.emplace_back(start, pooled? 0: p-start);
+      record.pooled.push_back(pooled);
+      pooled=false;
+    };
+    RecordScanner scanner(spec.quote, spec.escape);
+    for (auto p=b; p<e; ++p)
+      switch (scanner.scan(p,e))
+        {
+        case RecordScanner::quoteMark:
+          usePool(p);
+          break;
+        case RecordScanner::escaped:
+          usePool(p-1);
+          pool() += (*p=='n' && !space)? '\n': *p;
+          break;
+        case RecordScanner::plain:
+          if (!scanner.quoted && isSeparator(*p))
+            {
+              endField(p);
+              // whitespace separators are always merged, so trailing
+              // whitespace is consumed here
+              if (space || spec.mergeDelimiters)
+                while (p+1<e && isSeparator(p[1])) ++p;
+              start=p+1;
+            }
+          else if (pooled)
+            pool()+=*p;
+          break;
+        }
+    if (start<e || !space)
+      endField(e);
+    // pool is now stable, so refer to it
+    for (size_t i=0; i<record.fields.size(); ++i)
+      if (record.pooled[i])
+        record.fields[i]=record.pool[i];
+  }
+
+  /// accumulated value of a data cell, and the number of values
+  /// contributing to it
+  struct CellValue
+  {
+    double value;
+    size_t count;
+    CellValue(double value=0, size_t count=1): value(value), count(count) {}
+  };
+
+  /// combine a duplicate cell \a y into \a x according to \a action.
+  /// Returns false if duplicates are an error.
+  bool combine(DataSpec::DuplicateKeyAction action, CellValue& x, const CellValue& y)
+  {
+    switch (action)
+      {
+      case DataSpec::throwException:
+        return false;
+      case DataSpec::sum:
+        x.value+=y.value;
+        break;
+      case DataSpec::product:
+        x.value*=y.value;
+        break;
+      case DataSpec::min:
+        if (y.value<x.value)
+          x.value=y.value;
+        break;
+      case DataSpec::max:
+        if (y.value>x.value)
+          x.value=y.value;
+        break;
+      case DataSpec::av: // value holds the sum until the average is taken
+        x.value+=y.value;
+        break;
+      }
+    x.count+=y.count;
+    return true;
+  }
+
+  /// data parsed from a contiguous block of records
+  struct CSVChunk
+  {
+    /// dimension labels in order of first appearance within the chunk
+    vector<vector<string>> labels;
+    vector<unordered_map<string,size_t>> labelIdx;
+    /// keys are indices into labels, plus the horizontal column if tabular
+    typedef vector<size_t> Key;
+    unordered_map<Key,CellValue,boost::hash<Key>> data;
+    std::exception_ptr error;
+
+    explicit CSVChunk(size_t rank): labels(rank), labelIdx(rank) {}
+    string labelBuf;
+    size_t labelIndex(size_t dim, boost::string_ref field) {
+      auto& label=labelBuf.assign(field.begin(), field.end());
+      auto i=labelIdx[dim].find(label);
+      if (i!=labelIdx[dim].end()) return i->second;
+      labels[dim].push_back(label);
+      labelIdx[dim].emplace(label, labels[dim].size()-1);
+      return labels[dim].size()-1;
+    }
+    /// return string representation of a key, for error messages
+    vector<string> keyLabels(const Key& key, const vector<string>& horizontalLabels) const {
+      vector<string> r;
+      for (size_t i=0; i<key.size(); ++i)
+        r.push_back(i<labels.size()? labels[i][key[i]]: horizontalLabels[key[i]]);
+      return r;
+    }
+  };
+
+  /// parse the records in [b,e) into \a chunk
+  void parseChunk(CSVChunk& chunk, const char* b, const char* e, const DataSpec& spec,
+                  const vector<string>& horizontalLabels, bool tabularFormat)
+  {
+    try
+      {
+        Record fields;
+        CSVChunk::Key key;
+        for (auto next=b; b<e; b=next)
+          {
+            next=nextRecord(b,e,spec.quote,spec.escape);
+            splitRecord(b,next,spec,fields);
+            size_t numFields=fields.size();
+            if (numFields==0) continue; // blank line
+            if (numFields<=spec.nColAxes())
+              throw NoDataColumns();
+            key.clear();
+            for (size_t i=0; i<spec.nColAxes(); ++i)
+              if (spec.dimensionCols.count(i))
+                key.push_back(chunk.labelIndex(key.size(), fields[i]));
+                  
+            for (size_t col=0; col+spec.nColAxes()<numFields; ++col)
+              {
+                if (tabularFormat)
+                  {
+                    if (col>=horizontalLabels.size()) break; // unlabelled column
+                    key.push_back(col);
+                  }
+                double v;
+                bool valueExists=true;
+                if (parseNumber(fields[col+spec.nColAxes()], spec.decSeparator, v)!=numberField)
+                  { // value misunderstood
+                    v=spec.missingValue;
+                    valueExists=!isnan(spec.missingValue);
+                  }
+                if (valueExists)
+                  {
+                    auto i=chunk.data.emplace(key, v);
+                    if (!i.second && !combine(spec.duplicateKeyAction, i.first->second, v))
+                      throw DuplicateKey(chunk.keyLabels(key, horizontalLabels));
+                  }
+                if (tabularFormat)
+                  key.pop_back();
+              }
+          }
+      }
+    catch (...)
+      {
+        chunk.error=std::current_exception();
+      }
+  }
+
+  /// a file mapped read only into memory
+  struct MappedFile
+  {
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    const char *begin=nullptr, *end=nullptr;
+    explicit MappedFile(const string& filename);
+  };
+
+  MappedFile::MappedFile(const string& filename)
+  {
+    using namespace boost::interprocess;
+    try
+      {
+        if (boost::filesystem::file_size(filename)>0)
+          {
+            file_mapping(filename.c_str(), read_only).swap(file);
+            mapped_region(file, read_only).swap(region);
+            begin=static_cast<const char*>(region.get_address());
+            end=begin+region.get_size();
+          }
+      }
+    catch (const std::exception& ex)
+      {
+        throw runtime_error("Unable to open "+filename+": "+ex.what());
+      }
+  }
+  
+  /// a CSV file mapped into memory, with its header section parsed
+  /// and its data section divided into chunks of whole records for
+  /// parallel processing
+  struct MappedCSV: public MappedFile
+  {
+    bool tabularFormat=false;
+    vector<string> horizontalLabels;
+    /// chunk boundaries within the data section
+    vector<const char*> bounds;
+
+    MappedCSV(const string& filename, const DataSpec& spec);
+    size_t numChunks() const {return bounds.size()-1;}
+    /// call f(chunk, begin, end) for each chunk, on separate threads
+    template <class F> void forEachChunk(F f) const {
+      if (numChunks()==1)
+        f(0,bounds[0],bounds[1]);
+      else
+        {
+          boost::thread_group threads;
+          for (size_t i=0; i<numChunks(); ++i)
+            threads.create_thread([&,i]() {f(i,bounds[i],bounds[i+1]);});
+          threads.join_all();
+        }
+    }
+  };
+
+  MappedCSV::MappedCSV(const string& filename, const DataSpec& spec): MappedFile(filename)
+  {
+    // header section
+    auto p=begin;
+    for (size_t row=0; row<spec.nRowAxes() && p<end; ++row)
+      {
+        auto next=nextRecord(p,end,spec.quote,spec.escape);
+        if (row==spec.headerRow && !spec.columnar)
+          {
+            Record parsedRow;
+            splitRecord(p,next,spec,parsedRow);
+            if (parsedRow.size()>spec.nColAxes()+1)
+              {
+                tabularFormat=true;
+                for (size_t i=spec.nColAxes(); i<parsedRow.size(); ++i)
+                  horizontalLabels.push_back(parsedRow[i].to_string());
+              }
+          }
+        p=next;
+      }
+
+    // split the data section at record boundaries, into one chunk per thread
+    const size_t minChunkSize=1<<20;
+    size_t numChunks=std::max<size_t>
+      (1, std::min<size_t>(boost::thread::hardware_concurrency(), (end-p)/minChunkSize));
+    bounds.push_back(p);
+    if (numChunks>1)
+      {
+        size_t chunkSize=(end-p)/numChunks;
+        if (!memchr(p,spec.quote,end-p) && !memchr(p,spec.escape,end-p))
+          // no quotes, so any newline is a record boundary
+          for (size_t i=1; i<numChunks; ++i)
+            {
+              auto q=std::max(bounds.back(), p+i*chunkSize);
+              auto nl=static_cast<const char*>(memchr(q,'\n',end-q));
+              if (nl && nl+1<end) bounds.push_back(nl+1);
+            }
+        else
+          for (auto q=p; q<end; q=nextRecord(q,end,spec.quote,spec.escape))
+            if (q>=p+bounds.size()*chunkSize)
+              bounds.push_back(q);
+      }
+    bounds.push_back(end);
+  }
+}
+
 namespace minsky
 {
+  namespace
+  {
+    bool iequals(boost::string_ref x, const char* y)
+    {
+      for (auto c: x)
+        if (tolower(static_cast<unsigned char>(c))!=*y++) return false;
+      return *y=='\0';
+    }
+    
+    bool isMissingToken(boost::string_ref x)
+    {
+      static const char* tokens[]={"","na","n/a","#n/a","null","none","-","--","..","...","?"};
+      for (auto t: tokens)
+        if (iequals(x,t)) return true;
+      return false;
+    }
+
+    bool space(char c) {return isspace(static_cast<unsigned char>(c));}
+    bool digit(char c) {return c>='0' && c<='9';}
+
+    void trim(boost::string_ref& x)
+    {
+      while (!x.empty() && space(x.front())) x.remove_prefix(1);
+      while (!x.empty() && space(x.back())) x.remove_suffix(1);
+    }
+  }
+  
+  FieldType parseNumber(boost::string_ref x, char decSeparator, double& value)
+  {
+    trim(x);
+    if (x.size()>=2 && (x.front()=='"' || x.front()=='\'') && x.back()==x.front())
+      {
+        x.remove_prefix(1);
+        x.remove_suffix(1);
+        trim(x);
+      }
+    if (isMissingToken(x)) return missingField;
+    
+    bool percent=false;
+    if (x.back()=='%')
+      {
+        percent=true;
+        x.remove_suffix(1);
+        trim(x);
+      }
+    auto p=x.begin(), end=x.end();
+    bool negative=false;
+    if (p<end && (*p=='-' || *p=='+'))
+      negative=*p++=='-';
+
+    // a thousands separator cannot lead a number, so a leading '.' or
+    // ',' is taken to be a decimal point whatever decSeparator is
+    bool decimal=false;
+    if (p+1<end && (*p=='.' || *p==',') && digit(p[1]))
+      {
+        decimal=true;
+        ++p;
+      }
+
+    if (p<end && !digit(*p) && *p!=decSeparator)
+      {
+        boost::string_ref word(p, end-p);
+        if (iequals(word,"inf") || iequals(word,"infinity"))
+          value=numeric_limits<double>::infinity();
+        else if (iequals(word,"nan"))
+          value=numeric_limits<double>::quiet_NaN();
+        else
+          return invalidField;
+        if (negative) value=-value;
+        return numberField;
+      }
+
+    // accumulate up to 19 significant digits into an integer mantissa
+    uint64_t mantissa=0;
+    int exponent=0;
+    bool anyDigits=false, truncated=false;
+    for (; p<end; ++p)
+      if (digit(*p))
+        {
+          anyDigits=true;
+          if (mantissa<=(numeric_limits<uint64_t>::max()-9)/10)
+            {
+              mantissa=10*mantissa+(*p-'0');
+              if (decimal) --exponent;
+            }
+          else
+            {
+              if (!decimal) ++exponent;
+              truncated|=*p!='0';
+            }
+        }
+      else if (*p==decSeparator)
+        {
+          if (decimal) return invalidField;
+          decimal=true;
+        }
+      else if (*p!='.' && *p!=',' && !space(*p)) // skip thousands separators
+        break;
+    if (!anyDigits) return invalidField;
+
+    if (p<end && (*p=='e' || *p=='E'))
+      {
+        ++p;
+        bool negExp=false;
+        if (p<end && (*p=='-' || *p=='+'))
+          negExp=*p++=='-';
+        if (p==end || !digit(*p)) return invalidField;
+        int e=0;
+        for (; p<end && digit(*p); ++p)
+          if (e<100000) e=10*e+(*p-'0');
+        exponent+=negExp? -e: e;
+      }
+    if (p!=end) return invalidField;
+
+    static const double powersOf10[]=
+      {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+       1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+    if (!truncated && mantissa<=(uint64_t(1)<<53) && exponent>=-22 && exponent<=22)
+      // exactly representable operands, so the result is correctly rounded
+      value = exponent<0? mantissa/powersOf10[-exponent]: mantissa*powersOf10[exponent];
+    else
+      {
+        // defer to strtod, which needs no decimal point (and hence is
+        // locale independent) in this form
+        char buf[48], *q=buf+sizeof(buf);
+        *--q='\0';
+        for (unsigned e=abs(exponent); e>0 || *q=='\0'; e/=10)
+          *--q='0'+e%10;
+        if (exponent<0) *--q='-';
+        *--q='e';
+        do *--q='0'+mantissa%10; while (mantissa/=10);
+        value=strtod(q, nullptr);
+      }
+    if (negative) value=-value;
+    if (percent) value/=100;
+    return numberField;
+  }
+
   template <class P>
   void reportFromCSVFileT(istream& input, ostream& output, const DataSpec& spec)
   {
@@ -340,7 +859,8 @@ namespace minsky
               {
                 string x=*field;
                 if (x.back()=='\r') x=x.substr(0,x.size()-1); //deal with MS nonsense
-                if (!x.empty() && !isNumerical(x))
+                double v;
+                if (parseNumber(x, spec.decSeparator, v)==invalidField)
                   {
                     output<<"invalid numerical data"<<spec.separator<<buf<<endl;
                     continue;
@@ -441,23 +961,12 @@ namespace minsky
                     if (tabularFormat)
                       key.push_back(horizontalLabels[col]);
 
-                    // remove thousands separators, and set decimal separator to '.' ("C" locale)
-                    string s;
-                    for (auto c: *field)
-                      if (c==spec.decSeparator)
-                        s+='.';
-                      else if (!isspace(c) && c!='.' && c!=',')
-                        s+=c;                    
-
                     auto i=tmpData.find(key);
                     bool valueExists=true;
                     double v=spec.missingValue;
-                    try
-                      {
-                        v=stod(s);
-                      }
-                    catch (...) // value misunderstood
+                    if (parseNumber(*field, spec.decSeparator, v)!=numberField)
                       {
+                        v=spec.missingValue;
                         if (isnan(spec.missingValue)) // if spec.missingValue is NaN, then don't populate the tmpData map
                           valueExists=false;
                       }
@@ -502,65 +1011,22 @@ namespace minsky
         for (auto& xv: hc.xvectors)
           xv.imposeDimension();
 
-        size_t numHyperCubeElems=1;
-        for (auto& i : hc.xvectors) numHyperCubeElems*=i.size();
-                           
-        double sparsityRatio =  static_cast<double>(1.0-static_cast<double>(tmpData.size())/numHyperCubeElems); 
-
-        if (sparsityRatio <= 0.5) 
-          { // dense case
-            v.index({});
-            if (!cminsky().checkMemAllocation(hc.numElements()*sizeof(double)))
-              throw runtime_error("memory threshold exceeded");            
-            v.hypercube(hc);
-            // stash the data into vv tensorInit field
-            v.tensorInit.index({});
-            v.tensorInit.hypercube(hc);
-            for (auto& i: v.tensorInit)
-              i=spec.missingValue;
-            auto dims=v.hypercube().dims();
-            for (auto& i: tmpData)
-              {
-                size_t idx=0;
-                assert (hc.rank()==i.first.size());
-                assert(dimLabels.size()==hc.rank());
-                for (int j=hc.rank()-1; j>=0; --j)
-                  {
-                    assert(dimLabels[j].count(i.first[j]));
-                    idx = (idx*dims[j]) + dimLabels[j][i.first[j]];
-                  }
-                v.tensorInit[idx]=i.second;  
-              }
-          }    
-        else 
-          { // sparse case	
-            if (!cminsky().checkMemAllocation(tmpData.size()*sizeof(double)))
-              throw runtime_error("memory threshold exceeded");	  	  		
-            auto dims=hc.dims();
-              
-            map<size_t,double> indexValue; // intermediate stash to sort index vector
-            for (auto& i: tmpData)
+        auto dims=hc.dims();
+        vector<pair<size_t,double>> data;
+        data.reserve(tmpData.size());
+        for (auto& i: tmpData)
+          {
+            size_t idx=0;
+            assert (dims.size()==i.first.size());
+            assert(dimLabels.size()==dims.size());
+            for (int j=dims.size()-1; j>=0; --j)
               {
-                size_t idx=0;
-                assert (dims.size()==i.first.size());
-                assert(dimLabels.size()==dims.size());
-                for (int j=dims.size()-1; j>=0; --j)
-                  {
-                    assert(dimLabels[j].count(i.first[j]));
-                    idx = (idx*dims[j]) + dimLabels[j][i.first[j]];
-                  }
-                if (!isnan(i.second))
-                  indexValue.emplace(idx, i.second);
+                assert(dimLabels[j].count(i.first[j]));
+                idx = (idx*dims[j]) + dimLabels[j][i.first[j]];
               }
-
-            v.tensorInit.index(indexValue);
-            size_t j=0;
-            for (auto& i: indexValue)
-              v.tensorInit[j++]=i.second;
-            v.hypercube(hc);
-            v.tensorInit.hypercube(hc);
-          }                 
-
+            data.emplace_back(idx, i.second);
+          }
+        assembleTensorInit(v, hc, data, spec.missingValue);
       }
     catch (const std::bad_alloc&)
       { // replace with a more user friendly error message
@@ -580,4 +1046,430 @@ namespace minsky
     else
       loadValueFromCSVFileT<Parser>(v,input,spec);
   }
+
+  bool CSVSizing::sizes(const string& filename, const DataSpec& spec) const
+  {
+    boost::system::error_code ec;
+    return filename==this->filename && spec==this->spec &&
+      boost::filesystem::last_write_time(filename, ec)==mtime && !ec;
+  }
+
+  CSVSizing preflightCSVFile(const string& filename, const DataSpec& spec)
+  {
+    CSVSizing r;
+    r.filename=filename;
+    r.spec=spec;
+    // taken before reading, so that any subsequent change invalidates the sizing
+    r.mtime=boost::filesystem::last_write_time(filename);
+    MappedCSV csv(filename, spec);
+    size_t numLabelDims=0;
+    for (size_t i=0; i<spec.nColAxes(); ++i)
+      numLabelDims+=spec.dimensionCols.count(i);
+
+    struct ChunkCount
+    {
+      vector<unordered_set<string>> labels;
+      size_t numCells=0;
+      std::exception_ptr error;
+    };
+    vector<ChunkCount> counts(csv.numChunks());
+    csv.forEachChunk([&](size_t c, const char* b, const char* e) {
+        auto& count=counts[c];
+        try
+          {
+            count.labels.resize(numLabelDims);
+            Record fields;
+            string label;
+            for (auto next=b; b<e; b=next)
+              {
+                next=nextRecord(b,e,spec.quote,spec.escape);
+                splitRecord(b,next,spec,fields);
+                size_t numFields=fields.size();
+                if (numFields==0) continue;
+                if (numFields<=spec.nColAxes())
+                  throw NoDataColumns();
+                for (size_t i=0, dim=0; i<spec.nColAxes(); ++i)
+                  if (spec.dimensionCols.count(i))
+                    count.labels[dim++].insert(label.assign(fields[i].begin(), fields[i].end()));
+                size_t lastCol=numFields;
+                if (csv.tabularFormat)
+                  lastCol=std::min(lastCol, spec.nColAxes()+csv.horizontalLabels.size());
+                double v;
+                for (size_t col=spec.nColAxes(); col<lastCol; ++col)
+                  if (!isnan(spec.missingValue) ||
+                      parseNumber(fields[col], spec.decSeparator, v)==numberField)
+                    count.numCells++;
+              }
+          }
+        catch (...)
+          {
+            count.error=std::current_exception();
+          }
+      });
+
+    r.dims.resize(numLabelDims);
+    for (auto& count: counts)
+      if (count.error)
+        std::rethrow_exception(count.error);
+    for (size_t dim=0; dim<numLabelDims; ++dim)
+      {
+        auto& labels=counts[0].labels[dim];
+        for (size_t c=1; c<counts.size(); ++c)
+          {
+            labels.insert(counts[c].labels[dim].begin(), counts[c].labels[dim].end());
+            counts[c].labels[dim].clear();
+          }
+        r.dims[dim]=labels.size();
+      }
+    if (csv.tabularFormat)
+      r.dims.push_back(csv.horizontalLabels.size());
+    for (auto& count: counts)
+      r.numCells+=count.numCells;
+    return r;
+  }
+
+  namespace
+  {
+    /// load \a v from \a filename. If \a sizing is null, memory
+    /// use is checked once the labels and data cells are known.
+    void loadMappedCSV(VariableValue& v, const string& filename, const DataSpec& spec,
+                       const CSVSizing* sizing, CSVImportState* state)
+    {
+      MappedCSV csv(filename, spec);
+      Hypercube hc;
+      for (size_t i=0; i<spec.nColAxes(); ++i)
+        if (spec.dimensionCols.count(i))
+          {
+            hc.xvectors.push_back(i<spec.dimensionNames.size()? spec.dimensionNames[i]: "dim"+str(i));
+            hc.xvectors.back().dimension=spec.dimensions[i];
+          }
+      size_t numLabelDims=hc.xvectors.size();
+      if (csv.tabularFormat)
+        {
+          hc.xvectors.emplace_back(spec.horizontalDimName);
+          hc.xvectors.back().dimension=spec.horizontalDimension;
+          for (auto& i: csv.horizontalLabels) hc.xvectors.back().push_back(i);
+        }
+    
+      try
+        {
+          vector<CSVChunk> chunks(csv.numChunks(), CSVChunk(numLabelDims));
+          csv.forEachChunk([&](size_t c, const char* b, const char* e) {
+              parseChunk(chunks[c],b,e,spec,csv.horizontalLabels,csv.tabularFormat);
+            });
+          for (auto& chunk: chunks)
+            if (chunk.error)
+              std::rethrow_exception(chunk.error);
+
+          // merge labels in chunk order, so axes are ordered by first appearance in the file
+          vector<unordered_map<string,size_t>> labelIdx(numLabelDims);
+          if (sizing)
+            for (size_t dim=0; dim<numLabelDims && dim<sizing->dims.size(); ++dim)
+              labelIdx[dim].reserve(sizing->dims[dim]);
+          vector<vector<vector<size_t>>> labelMap(chunks.size(), vector<vector<size_t>>(numLabelDims));
+          for (size_t c=0; c<chunks.size(); ++c)
+            {
+              for (size_t dim=0; dim<numLabelDims; ++dim)
+                for (auto& label: chunks[c].labels[dim])
+                  {
+                    auto i=labelIdx[dim].emplace(label, labelIdx[dim].size());
+                    if (i.second)
+                      hc.xvectors[dim].push_back(label);
+                    labelMap[c][dim].push_back(i.first->second);
+                  }
+              chunks[c].labels.clear();
+              chunks[c].labelIdx.clear();
+            }
+          // without a preflight, the size is only known at this point
+          CSVSizing parsed;
+          if (!sizing)
+            {
+              for (auto& xv: hc.xvectors) parsed.dims.push_back(xv.size());
+              for (auto& chunk: chunks) parsed.numCells+=chunk.data.size();
+              checkTensorMemory(parsed);
+              sizing=&parsed;
+            }
+          if (state)
+            {
+              state->filename=filename;
+              state->offset=csv.bounds.back()-csv.begin;
+              state->labels.clear();
+              for (auto& i: labelIdx)
+                state->labels.emplace_back(i.begin(), i.end());
+              state->tabularFormat=csv.tabularFormat;
+              state->horizontalLabels=csv.horizontalLabels;
+            }
+          labelIdx.clear();
+
+          for (auto& xv: hc.xvectors)
+            xv.imposeDimension();
+        
+          vector<size_t> strides(hc.rank(), 1);
+          for (size_t i=1; i<strides.size(); ++i)
+            strides[i]=strides[i-1]*hc.xvectors[i-1].size();
+
+          // merge data, applying duplicate key actions between chunks
+          unordered_map<size_t,CellValue> cells;
+          cells.reserve(sizing->numCells);
+          for (size_t c=0; c<chunks.size(); ++c)
+            {
+              for (auto& i: chunks[c].data)
+                {
+                  size_t idx=0;
+                  for (size_t dim=0; dim<i.first.size(); ++dim)
+                    idx+=strides[dim]*(dim<numLabelDims? labelMap[c][dim][i.first[dim]]: i.first[dim]);
+                  auto j=cells.emplace(idx, i.second);
+                  if (!j.second && !combine(spec.duplicateKeyAction, j.first->second, i.second))
+                    {
+                      vector<string> key;
+                      for (size_t dim=0; dim<i.first.size(); ++dim)
+                        key.push_back(str(hc.xvectors[dim][dim<numLabelDims? labelMap[c][dim][i.first[dim]]: i.first[dim]]));
+                      throw DuplicateKey(key);
+                    }
+                }
+              chunks[c].data.clear();
+            }
+        
+          vector<pair<size_t,double>> data;
+          data.reserve(cells.size());
+          for (auto& i: cells)
+            data.emplace_back(i.first, spec.duplicateKeyAction==DataSpec::av? i.second.value/i.second.count: i.second.value);
+          cells.clear();
+          assembleTensorInit(v, hc, data, spec.missingValue);
+        }
+      catch (const std::bad_alloc&)
+        { // replace with a more user friendly error message
+          throw std::runtime_error("exhausted memory - try reducing the rank");
+        }
+      catch (const std::length_error&)
+        { // replace with a more user friendly error message
+          throw std::runtime_error("exhausted memory - try reducing the rank");
+        }
+    }
+  }
+
+  void loadValueFromCSVFile(VariableValue& v, const string& filename, const DataSpec& spec,
+                            CSVImportState* state)
+  {
+    loadMappedCSV(v, filename, spec, nullptr, state);
+  }
+
+  void loadValueFromCSVFile(VariableValue& v, const string& filename, const DataSpec& spec,
+                            const CSVSizing& sizing, CSVImportState* state)
+  {
+    // bail out before building any intermediate tables
+    checkTensorMemory(sizing);
+    loadMappedCSV(v, filename, spec, &sizing, state);
+  }
+
+  bool appendValueFromCSVFile(VariableValue& v, const string& filename, const DataSpec& spec,
+                              CSVImportState& state)
+  {
+    size_t numLabelDims=state.labels.size();
+    if (state.filename!=filename || v.tensorInit.rank()!=numLabelDims+state.tabularFormat)
+      return false;
+    MappedFile file(filename);
+    if (size_t(file.end-file.begin)<state.offset)
+      return false; // file has been truncated or rewritten
+    // only import complete records
+    auto b=file.begin+state.offset, e=file.end;
+    while (e>b && e[-1]!='\n') --e;
+    if (b==e) return true; // nothing new
+    if (b>file.begin && b[-1]!='\n')
+      return false; // previous import ended partway through a record
+
+    try
+      {
+        // parse the new records, into new labels not yet committed to state
+        Hypercube hc=v.tensorInit.hypercube();
+        auto oldDims=hc.dims();
+        vector<map<string,size_t>> newLabels(numLabelDims);
+        map<vector<size_t>,CellValue> cells;
+        Record fields;
+        vector<size_t> key;
+        string label;
+        for (auto next=b; b<e; b=next)
+          {
+            next=nextRecord(b,e,spec.quote,spec.escape);
+            splitRecord(b,next,spec,fields);
+            if (fields.size()==0) continue;
+            if (fields.size()<=spec.nColAxes())
+              throw NoDataColumns();
+            key.clear();
+            for (size_t i=0, dim=0; i<spec.nColAxes(); ++i)
+              if (spec.dimensionCols.count(i))
+                {
+                  label.assign(fields[i].begin(), fields[i].end());
+                  auto l=state.labels[dim].find(label);
+                  if (l!=state.labels[dim].end())
+                    key.push_back(l->second);
+                  else
+                    {
+                      auto n=newLabels[dim].emplace(label, oldDims[dim]+newLabels[dim].size());
+                      if (n.second)
+                        hc.xvectors[dim].push_back(label);
+                      key.push_back(n.first->second);
+                    }
+                  ++dim;
+                }
+            for (size_t col=0; col+spec.nColAxes()<fields.size(); ++col)
+              {
+                if (state.tabularFormat)
+                  {
+                    if (col>=state.horizontalLabels.size()) break;
+                    key.push_back(col);
+                  }
+                double x;
+                bool valueExists=true;
+                if (parseNumber(fields[col+spec.nColAxes()], spec.decSeparator, x)!=numberField)
+                  {
+                    x=spec.missingValue;
+                    valueExists=!isnan(spec.missingValue);
+                  }
+                if (valueExists)
+                  {
+                    auto i=cells.emplace(key, x);
+                    if (!i.second && !combine(spec.duplicateKeyAction, i.first->second, x))
+                      {
+                        vector<string> keyLabels;
+                        for (size_t c=0; c<spec.nColAxes(); ++c)
+                          if (spec.dimensionCols.count(c))
+                            keyLabels.push_back(fields[c].to_string());
+                        if (state.tabularFormat)
+                          keyLabels.push_back(state.horizontalLabels[col]);
+                        throw DuplicateKey(keyLabels);
+                      }
+                  }
+                if (state.tabularFormat)
+                  key.pop_back();
+              }
+          }
+
+        // hypercube indices change as axes are extended, so remap existing data
+        auto dims=hc.dims();
+        vector<size_t> strides(dims.size(),1);
+        for (size_t i=1; i<dims.size(); ++i)
+          strides[i]=strides[i-1]*dims[i-1];
+        auto remap=[&](size_t idx) {
+          size_t r=0;
+          for (size_t i=0; i<dims.size(); ++i)
+            {
+              r+=strides[i]*(idx%oldDims[i]);
+              idx/=oldDims[i];
+            }
+          return r;
+        };
+        vector<pair<size_t,CellValue>> newCells;
+        for (auto& i: cells)
+          {
+            size_t idx=0;
+            for (size_t j=0; j<i.first.size(); ++j)
+              idx+=strides[j]*i.first[j];
+            if (spec.duplicateKeyAction==DataSpec::av)
+              i.second.value/=i.second.count;
+            i.second.count=1;
+            newCells.emplace_back(idx, i.second);
+          }
+        cells.clear();
+        sort(newCells.begin(), newCells.end(),
+             [](const pair<size_t,CellValue>& x, const pair<size_t,CellValue>& y)
+             {return x.first<y.first;});
+        // averages cannot be combined without the counts of the original import
+        auto combineExisting=[&](CellValue& x, const CellValue& y, size_t idx) {
+          if (spec.duplicateKeyAction==DataSpec::av)
+            return false;
+          if (!combine(spec.duplicateKeyAction, x, y))
+            {
+              vector<string> key;
+              for (size_t i=0; i<dims.size(); ++i)
+                key.push_back(str(hc.xvectors[i][(idx/strides[i])%dims[i]]));
+              throw DuplicateKey(key);
+            }
+          return true;
+        };
+
+        auto& tensor=v.tensorInit;
+        if (tensor.index().empty())
+          { // dense case
+            checkTensorMemory(hc.numElements()*sizeof(double), hc.numElements());
+            vector<double> data(hc.numElements(), spec.missingValue);
+            for (size_t i=0; i<tensor.size(); ++i)
+              data[remap(i)]=tensor[i];
+            auto missing=[&](double x) {
+              return isnan(spec.missingValue)? isnan(x): x==spec.missingValue;
+            };
+            for (auto& i: newCells)
+              {
+                // cells beyond the original axes cannot have been imported before
+                bool existing=!missing(data[i.first]);
+                for (size_t j=0; existing && j<dims.size(); ++j)
+                  existing=(i.first/strides[j])%dims[j]<oldDims[j];
+                if (existing)
+                  {
+                    CellValue x(data[i.first]);
+                    if (!combineExisting(x, i.second, i.first)) return false;
+                    data[i.first]=x.value;
+                  }
+                else
+                  data[i.first]=i.second.value;
+              }
+            v.index({});
+            v.hypercube(hc);
+            tensor.index({});
+            tensor.hypercube(hc);
+            memcpy(tensor.begin(), data.data(), data.size()*sizeof(double));
+          }
+        else
+          { // sparse case, merging two sorted sequences
+            vector<size_t> index;
+            vector<double> data;
+            auto oldIndex=tensor.index().begin();
+            size_t i=0, j=0;
+            while (i<tensor.size() || j<newCells.size())
+              if (j==newCells.size() || (i<tensor.size() && remap(oldIndex[i])<newCells[j].first))
+                {
+                  index.push_back(remap(oldIndex[i]));
+                  data.push_back(tensor[i++]);
+                }
+              else if (i==tensor.size() || newCells[j].first<remap(oldIndex[i]))
+                {
+                  if (!isnan(newCells[j].second.value))
+                    {
+                      index.push_back(newCells[j].first);
+                      data.push_back(newCells[j].second.value);
+                    }
+                  ++j;
+                }
+              else
+                {
+                  CellValue x(tensor[i++]);
+                  if (!combineExisting(x, newCells[j].second, newCells[j].first)) return false;
+                  index.push_back(newCells[j++].first);
+                  data.push_back(x.value);
+                }
+            checkTensorMemory(data.size()*sizeof(double), data.size());
+            Index idx;
+            idx.assignSorted(index.begin(), index.end());
+            tensor.index(std::move(idx));
+            memcpy(tensor.begin(), data.data(), data.size()*sizeof(double));
+            v.hypercube(hc);
+            tensor.hypercube(hc);
+          }
+        tensor.updateTimestamp();
+
+        // commit the new labels
+        for (size_t dim=0; dim<numLabelDims; ++dim)
+          state.labels[dim].insert(newLabels[dim].begin(), newLabels[dim].end());
+        state.offset=e-file.begin;
+        return true;
+      }
+    catch (const std::bad_alloc&)
+      { // replace with a more user friendly error message
+        throw std::runtime_error("exhausted memory - try reducing the rank");
+      }
+    catch (const std::length_error&)
+      { // replace with a more user friendly error message
+        throw std::runtime_error("exhausted memory - try reducing the rank");
+      }
+  }
 }
@@ -22,10 +22,15 @@
 #include "dimension.h"
 #include "classdesc_access.h"
 
+#include <boost/utility/string_ref.hpp>
 #include <stddef.h>
+#include <ctime>
 #include <string>
 #include <set>
+#include <map>
 #include <fstream>
+#include <limits>
+#include <vector>
 
 namespace minsky
 {
@@ -64,6 +69,10 @@ namespace minsky
     }
 
     void setDataArea(size_t row, size_t col);
+
+    /// true if \a x specifies the same import
+    bool operator==(const DataSpec& x) const;
+    bool operator!=(const DataSpec& x) const {return !operator==(x);}
     
     std::vector<civita::Dimension> dimensions;
     std::vector<std::string> dimensionNames;
@@ -93,12 +102,98 @@ namespace minsky
     void guessRemainder(std::istream&, char separator);
   };
 
+  enum FieldType {numberField, missingField, invalidField};
+  
+  /// locale independent conversion of a numerical data field. Spaces,
+  /// surrounding quotes and thousands separators ('.' or ',' other
+  /// than \a decSeparator) are ignored, and a trailing '%' scales the
+  /// value by 1/100. Empty fields and conventional missing value
+  /// tokens (NA, N/A, #N/A, null, -, ...) return missingField. The
+  /// field is only converted to \a value if numberField is returned.
+  /// Missing value tokens apply to data cells, and do not make a
+  /// column numerical when guessing the format, as they may be labels.
+  FieldType parseNumber(boost::string_ref field, char decSeparator, double& value);
+
+  /// size of the tensor that would be imported from a CSV file
+  struct CSVSizing
+  {
+    /// number of distinct labels along each dimension
+    std::vector<size_t> dims;
+    /// number of data cells present. Overestimates the number of
+    /// tensor elements if duplicate keys are combined
+    size_t numCells=0;
+    /// number of elements in the hypercube (saturating on overflow)
+    size_t numElements() const {
+      size_t r=1;
+      for (auto i: dims)
+        if (i && r>std::numeric_limits<size_t>::max()/i)
+          return std::numeric_limits<size_t>::max();
+        else
+          r*=i;
+      return r;
+    }
+    size_t denseBytes() const {
+      auto n=numElements();
+      return n>std::numeric_limits<size_t>::max()/sizeof(double)?
+        std::numeric_limits<size_t>::max(): n*sizeof(double);
+    }
+    /// sparse tensors store an index alongside each value
+    size_t sparseBytes() const {return numCells*(sizeof(double)+sizeof(size_t));}
+    /// true if a dense tensor needs no more memory than a sparse one
+    bool dense() const {return denseBytes()<=sparseBytes();}
+    size_t bytes() const {return std::min(denseBytes(), sparseBytes());}
+    /// file sized, its modification time when sized, and the spec it
+    /// was sized according to
+    std::string filename;
+    std::time_t mtime=0;
+    DataSpec spec;
+    /// true if this sizes the current content of \a filename, according to \a spec
+    bool sizes(const std::string& filename, const DataSpec& spec) const;
+  };
+
+  /// state retained from importing a CSV file, allowing rows
+  /// subsequently appended to the file to be imported incrementally
+  struct CSVImportState
+  {
+    std::string filename;
+    /// end of the last complete record imported
+    size_t offset=0;
+    /// position along each dimension of the labels imported so far
+    std::vector<std::map<std::string,size_t>> labels;
+    bool tabularFormat=false;
+    std::vector<std::string> horizontalLabels;
+  };
+
+  /// stream through a CSV file, counting the distinct labels along
+  /// each dimension and the data cells, without building the tensor
+  CSVSizing preflightCSVFile(const std::string& filename, const DataSpec& spec);
+  
   /// creates a report CSV file from input, with errors sorted at
   /// begining of file, with a column for error messages
   void reportFromCSVFile(std::istream& input, std::ostream& output, const DataSpec& spec);
 
   /// load a variableValue from a stream according to data spec
   void loadValueFromCSVFile(VariableValue&,std::istream&,const DataSpec&);
+  /// load a variableValue from a file according to data spec. The
+  /// file is memory mapped and parsed in parallel, in a single pass,
+  /// so memory use is checked once the file has been parsed. If \a
+  /// state is provided, it is filled in for a subsequent
+  /// appendValueFromCSVFile.
+  void loadValueFromCSVFile(VariableValue&,const std::string& filename,const DataSpec&,
+                            CSVImportState* state=nullptr);
+  /// as above, with \a sizing previously obtained from
+  /// preflightCSVFile, so memory use is checked before parsing.
+  void loadValueFromCSVFile(VariableValue&,const std::string& filename,const DataSpec&,
+                            const CSVSizing& sizing, CSVImportState* state=nullptr);
+  /// import records appended to \a filename since the import that
+  /// produced \a state, extending the hypercube axes of the value as
+  /// needed.
+  /// @return false if the records cannot be appended (eg the file has
+  /// been truncated, or averages would need recomputing), in which
+  /// case the value and state are unchanged, and the file must be
+  /// imported afresh.
+  bool appendValueFromCSVFile(VariableValue&,const std::string& filename,const DataSpec&,
+                              CSVImportState& state);
 }
 
 #include "CSVParser.cd"
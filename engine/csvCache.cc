@@ -0,0 +1,247 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "csvCache.h"
+#include "mappedTensor.h"
+#include "minsky.h"
+#include "minsky_epilogue.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <fstream>
+#include <cstring>
+using namespace std;
+using namespace boost::interprocess;
+
+namespace minsky
+{
+  namespace
+  {
+    const char cacheMagic[]="MinskyCSVCache1";
+
+    /// identifies the CSV file and import options a sidecar was made from
+    struct Key
+    {
+      string path, spec;
+      uint64_t size=0, hash=0;
+      int64_t mtime=0;
+    };
+
+    void packSpec(pack_t& buf, const DataSpec& spec)
+    {
+      buf<<spec.separator<<spec.quote<<spec.escape<<spec.decSeparator
+         <<spec.mergeDelimiters<<spec.columnar<<spec.missingValue
+         <<uint64_t(spec.headerRow)<<uint64_t(spec.nRowAxes())<<uint64_t(spec.nColAxes())
+         <<spec.horizontalDimName<<int(spec.horizontalDimension.type)<<spec.horizontalDimension.units
+         <<int(spec.duplicateKeyAction)<<uint64_t(spec.dimensionCols.size());
+      for (auto i: spec.dimensionCols)
+        buf<<i;
+      buf<<uint64_t(spec.dimensions.size());
+      for (auto& i: spec.dimensions)
+        buf<<int(i.type)<<i.units;
+      buf<<uint64_t(spec.dimensionNames.size());
+      for (auto& i: spec.dimensionNames)
+        buf<<i;
+    }
+    
+    /// key of \a csvFile, apart from its content hash, which is
+    /// expensive to compute, so deferred until the other fields match
+    Key makeKey(const string& csvFile, const DataSpec& spec)
+    {
+      Key r;
+      r.path=boost::filesystem::absolute(csvFile).string();
+      r.size=boost::filesystem::file_size(csvFile);
+      r.mtime=boost::filesystem::last_write_time(csvFile);
+      pack_t buf;
+      packSpec(buf,spec);
+      r.spec.assign(buf.data(), buf.size());
+      return r;
+    }
+
+    /// FNV-1a hash of the file contents, taken a word at a time
+    uint64_t contentHash(const string& filename)
+    {
+      uint64_t h=14695981039346656037ULL;
+      if (boost::filesystem::file_size(filename)==0) return h;
+      file_mapping file(filename.c_str(), read_only);
+      mapped_region region(file, read_only);
+      auto p=static_cast<const char*>(region.get_address());
+      auto end=p+region.get_size();
+      uint64_t word;
+      for (; p+sizeof(word)<=end; p+=sizeof(word))
+        {
+          memcpy(&word,p,sizeof(word));
+          h=(h^word)*1099511628211ULL;
+        }
+      for (; p<end; ++p)
+        h=(h^uint8_t(*p))*1099511628211ULL;
+      return h;
+    }
+
+    /// padding needed to align the data arrays following the header
+    size_t padding(size_t offset) {return (sizeof(double)-offset%sizeof(double))%sizeof(double);}
+  }
+
+  bool CSVCache::store(const VariableValue& v, const string& csvFile, const DataSpec& spec)
+  {
+    auto& tensor=v.tensorInit;
+    if (tensor.rank()==0) return false;
+    auto tmpName=boost::filesystem::unique_path(fileName(csvFile)+".%%%%%%").string();
+    try
+      {
+        auto key=makeKey(csvFile,spec);
+        if (key.size<minFileSize) return false;
+        key.hash=contentHash(csvFile);
+
+        pack_t header;
+        header<<string(cacheMagic)<<key.path<<key.size<<key.mtime<<key.hash<<key.spec;
+        header<<uint64_t(tensor.rank());
+        for (auto& xv: tensor.hypercube().xvectors)
+          {
+            header<<xv.name<<int(xv.dimension.type)<<xv.dimension.units<<uint64_t(xv.size());
+            for (auto& i: xv)
+              header<<str(i,xv.dimension.units);
+          }
+        header<<uint64_t(tensor.size())<<uint64_t(tensor.index().size());
+
+        {
+          ofstream f(tmpName, ios::binary);
+          uint64_t headerSize=header.size();
+          f.write(reinterpret_cast<const char*>(&headerSize), sizeof(headerSize));
+          f.write(header.data(), header.size());
+          // align the arrays so they can be used directly from the mapped file
+          const char pad[sizeof(double)]={};
+          f.write(pad, padding(sizeof(headerSize)+headerSize));
+          f.write(reinterpret_cast<const char*>(tensor.begin()), tensor.size()*sizeof(double));
+          for (auto i: tensor.index())
+            {
+              uint64_t x=i;
+              f.write(reinterpret_cast<const char*>(&x), sizeof(x));
+            }
+          if (!f) throw runtime_error("failed to write "+tmpName);
+        }
+        // rename, so concurrent readers never see a partially written sidecar
+        boost::filesystem::rename(tmpName, fileName(csvFile));
+        return true;
+      }
+    catch (...)
+      {
+        // caching is opportunistic - eg the directory may not be writable
+        boost::system::error_code ec;
+        boost::filesystem::remove(tmpName, ec);
+        return false;
+      }
+  }
+
+  bool CSVCache::restore(VariableValue& v, const string& csvFile, const DataSpec& spec)
+  {
+    auto cacheFile=fileName(csvFile);
+    try
+      {
+        if (!boost::filesystem::exists(cacheFile) || !boost::filesystem::exists(csvFile))
+          return false;
+        auto key=makeKey(csvFile,spec);
+        file_mapping file(cacheFile.c_str(), read_only);
+        mapped_region region(file, read_only);
+        auto begin=static_cast<const char*>(region.get_address());
+        size_t size=region.get_size();
+
+        uint64_t headerSize;
+        if (size<sizeof(headerSize)) return false;
+        memcpy(&headerSize, begin, sizeof(headerSize));
+        if (sizeof(headerSize)+headerSize>size) return false;
+        pack_t header;
+        header.packraw(begin+sizeof(headerSize), headerSize);
+
+        string magic, path, specBuf;
+        uint64_t fileSize, hash;
+        int64_t mtime;
+        header>>magic;
+        if (magic!=cacheMagic) return false;
+        header>>path>>fileSize>>mtime>>hash>>specBuf;
+        // an unchanged size and modification time identify an
+        // unchanged file, so the content is only hashed if the file
+        // has been touched since the sidecar was written
+        if (path!=key.path || fileSize!=key.size || specBuf!=key.spec ||
+            (mtime!=key.mtime && hash!=contentHash(csvFile)))
+          return false;
+
+        Hypercube hc;
+        uint64_t rank;
+        header>>rank;
+        for (size_t i=0; i<rank; ++i)
+          {
+            hc.xvectors.emplace_back();
+            auto& xv=hc.xvectors.back();
+            int type;
+            uint64_t numLabels;
+            header>>xv.name>>type>>xv.dimension.units>>numLabels;
+            xv.dimension.type=Dimension::Type(type);
+            string label;
+            for (size_t j=0; j<numLabels; ++j)
+              {
+                header>>label;
+                xv.push_back(label);
+              }
+          }
+        uint64_t numValues, numIndices;
+        header>>numValues>>numIndices;
+        size_t offset=sizeof(headerSize)+headerSize;
+        offset+=padding(offset);
+        size_t bytes=numValues*sizeof(double);
+        if (offset+bytes+numIndices*sizeof(uint64_t)!=size ||
+            (numIndices==0 && numValues!=hc.numElements()) ||
+            (numIndices>0 && numIndices!=numValues) ||
+            !cminsky().checkMemAllocation(bytes, bytes))
+          return false;
+        auto values=reinterpret_cast<const double*>(begin+offset);
+        // values are read in place from the sidecar, rather than copied
+        std::shared_ptr<MappedTensorData> mappedValues;
+        if (numValues>0)
+          mappedValues=make_shared<MappedTensorData>(cacheFile, offset, numValues);
+
+        // mirror the layout produced by loadValueFromCSVFile. tensorInit
+        // is set first, so v does not allocate room for mapped values.
+        if (mappedValues)
+          v.tensorInit.deferData(mappedValues);
+        if (numIndices==0)
+          { // dense case
+            v.tensorInit.index({});
+            v.tensorInit.hypercube(hc);
+            v.index({});
+            v.hypercube(hc);
+          }
+        else
+          { // sparse case
+            auto indices=reinterpret_cast<const uint64_t*>(values+numValues);
+            Index index;
+            index.assignSorted(indices, indices+numIndices);
+            v.tensorInit.index(std::move(index));
+            v.tensorInit.hypercube(hc);
+            v.hypercube(hc);
+          }
+        return true;
+      }
+    catch (...)
+      {
+        return false; // a corrupt sidecar just means parsing the file again
+      }
+  }
+}
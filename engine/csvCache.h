@@ -0,0 +1,55 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CSVCACHE_H
+#define CSVCACHE_H
+
+#include <string>
+#include <stddef.h>
+
+namespace minsky
+{
+  class VariableValue;
+  class DataSpec;
+
+  /// Binary sidecar cache of CSV imports. After a CSV file is
+  /// imported, the resulting hypercube, index and values are written
+  /// next to it, keyed by the file's path, size, modification time
+  /// and content hash, and by the DataSpec used. Later imports of the
+  /// unchanged file with the same spec map the sidecar rather than
+  /// parsing the text. The content hash is only checked if the
+  /// modification time differs.
+  class CSVCache
+  {
+  public:
+    /// files smaller than this are parsed faster than they are hashed
+    static const size_t minFileSize=1<<20;
+    /// name of the sidecar file of \a csvFile
+    static std::string fileName(const std::string& csvFile) {return csvFile+".mkycache";}
+    /// write a sidecar for \a v, just imported from \a csvFile according to \a spec
+    /// @return true if the sidecar was written
+    static bool store(const VariableValue& v, const std::string& csvFile, const DataSpec& spec);
+    /// load \a v from the sidecar of \a csvFile
+    /// @return false if there is no sidecar valid for \a csvFile and
+    /// \a spec, in which case \a v is left untouched
+    static bool restore(VariableValue& v, const std::string& csvFile, const DataSpec& spec);
+  };
+}
+
+#endif
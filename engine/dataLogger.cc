@@ -0,0 +1,247 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dataLogger.h"
+#include <ecolab.h>
+#include "minsky_epilogue.h"
+
+#include <sstream>
+#include <stdint.h>
+#include <string.h>
+using namespace std;
+using ecolab::error;
+
+namespace minsky
+{
+  namespace
+  {
+    const char binaryMagic[]="MinskyBinaryLog1";
+    const size_t magicLen=sizeof(binaryMagic)-1;
+
+    template <class T> void writeBin(ostream& o, const T& x)
+    {o.write(reinterpret_cast<const char*>(&x), sizeof(x));}
+    template <class T> bool readBin(istream& i, T& x)
+    {return bool(i.read(reinterpret_cast<char*>(&x), sizeof(x)));}
+  }
+  
+  DataLogger::DataLogger(const string& filename, const vector<Column>& columns,
+                         Format format, size_t blockRecords):
+    os(filename, format==binary? ios::out|ios::binary: ios::out),
+    format(format), m_columns(columns), blockSize(max(blockRecords,size_t(1))*(columns.size()+1))
+  {
+    if (!os)
+      throw error("cannot open log file %s", filename.c_str());
+    switch (format)
+      {
+      case text:
+        os<<"#time";
+        for (auto& c: m_columns)
+          os<<" "<<c.name;
+        os<<"\n";
+        break;
+      case binary:
+        os.write(binaryMagic, magicLen);
+        writeBin(os, uint32_t(m_columns.size()));
+        for (auto& c: m_columns)
+          {
+            writeBin(os, uint32_t(c.name.size()));
+            os.write(c.name.data(), c.name.size());
+          }
+        break;
+      }
+    front.reserve(blockSize);
+    back.reserve(blockSize);
+    writer=boost::thread([this]() {run();});
+  }
+
+  DataLogger::~DataLogger()
+  {
+    try {flush();}
+    catch (...) {} // destructors must not throw
+    {
+      boost::lock_guard<boost::mutex> lock(mutex);
+      done=true;
+    }
+    cond.notify_all();
+    writer.join();
+  }
+
+  void DataLogger::log(double t, const vector<double>& stocks, const vector<double>& flows)
+  {
+    if (failed)
+      {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        checkWriteError();
+      }
+    front.push_back(t);
+    for (auto& c: m_columns)
+      {
+        auto& v=c.flow? flows: stocks;
+        front.push_back(c.idx>=0 && size_t(c.idx)<v.size()? v[c.idx]: nan(""));
+      }
+    if (front.size()>=blockSize)
+      swapBuffers();
+  }
+
+  void DataLogger::remap(const vector<Column>& columns)
+  {
+    if (columns.size()!=m_columns.size())
+      throw error("inconsistent number of logged variables");
+    m_columns=columns;
+  }
+  
+  void DataLogger::swapBuffers()
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (backFull)
+      cond.wait(lock);
+    checkWriteError();
+    back.swap(front);
+    front.clear();
+    backFull=true;
+    cond.notify_all();
+  }
+
+  void DataLogger::flush()
+  {
+    if (!front.empty())
+      swapBuffers();
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (backFull)
+      cond.wait(lock);
+    os.flush();
+    if (!os && writeError.empty())
+      writeError="error writing log file";
+    checkWriteError();
+  }
+
+  void DataLogger::close()
+  {
+    flush();
+    os.close();
+    if (!os)
+      throw error("error closing log file");
+  }
+
+  void DataLogger::checkWriteError()
+  {
+    if (!writeError.empty())
+      {
+        // reported once
+        string msg;
+        msg.swap(writeError);
+        failed=false;
+        throw error("%s",msg.c_str());
+      }
+  }
+
+  void DataLogger::run()
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    for (;;)
+      {
+        while (!backFull && !done)
+          cond.wait(lock);
+        if (backFull)
+          {
+            // the producer does not touch back whilst backFull is set
+            lock.unlock();
+            string err;
+            try
+              {
+                writeBlock(back);
+                if (!os) err="error writing log file";
+              }
+            catch (const std::exception& ex)
+              {
+                err=ex.what();
+              }
+            lock.lock();
+            if (!err.empty() && writeError.empty())
+              {
+                writeError=err;
+                failed=true;
+              }
+            backFull=false;
+            cond.notify_all();
+          }
+        else if (done)
+          break;
+      }
+  }
+
+  void DataLogger::writeBlock(const vector<double>& block)
+  {
+    switch (format)
+      {
+      case text:
+        {
+          ostringstream buf;
+          size_t width=m_columns.size()+1;
+          for (size_t i=0; i+width<=block.size(); i+=width)
+            {
+              buf<<block[i];
+              for (size_t j=1; j<width; ++j)
+                buf<<" "<<block[i+j];
+              buf<<"\n";
+            }
+          os<<buf.str();
+          break;
+        }
+      case binary:
+        os.write(reinterpret_cast<const char*>(block.data()), block.size()*sizeof(double));
+        break;
+      }
+  }
+
+  void convertBinaryLog(const string& binaryFile, const string& textFile)
+  {
+    ifstream is(binaryFile, ios::binary);
+    char magic[magicLen];
+    if (!is.read(magic, magicLen) || strncmp(magic, binaryMagic, magicLen)!=0)
+      throw error("%s is not a binary log file", binaryFile.c_str());
+    uint32_t n;
+    if (!readBin(is, n))
+      throw error("%s is truncated", binaryFile.c_str());
+
+    ofstream os(textFile);
+    if (!os)
+      throw error("cannot open %s", textFile.c_str());
+    os<<"#time";
+    for (uint32_t i=0; i<n; ++i)
+      {
+        uint32_t len;
+        if (!readBin(is, len))
+          throw error("%s is truncated", binaryFile.c_str());
+        string name(len,'\0');
+        is.read(&name[0], len);
+        os<<" "<<name;
+      }
+    os<<"\n";
+
+    vector<double> record(n+1);
+    while (is.read(reinterpret_cast<char*>(record.data()), record.size()*sizeof(double)))
+      {
+        os<<record[0];
+        for (size_t i=1; i<record.size(); ++i)
+          os<<" "<<record[i];
+        os<<"\n";
+      }
+  }
+}
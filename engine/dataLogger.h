@@ -0,0 +1,111 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATALOGGER_H
+#define DATALOGGER_H
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace minsky
+{
+  /// Writes the values of a selection of simulation variables to a
+  /// log file. Variables are resolved to positions in the stock/flow
+  /// vectors up front, and values are accumulated into blocks that
+  /// are written out by a background thread, so logging does not
+  /// hold up the simulation.
+  class DataLogger
+  {
+  public:
+    enum Format {text, binary};
+    /// a logged variable, resolved to a location in the stock or
+    /// flow vectors
+    struct Column
+    {
+      std::string name;
+      bool flow; ///< true if located in flowVars, otherwise stockVars
+      int idx; ///< -1 if the variable is not currently allocated
+      Column(const std::string& name="", bool flow=true, int idx=-1):
+        name(name), flow(flow), idx(idx) {}
+    };
+
+    /// @param blockRecords number of records accumulated before being
+    /// passed to the writer thread
+    /// @throw ecolab::error if \a filename cannot be opened
+    DataLogger(const std::string& filename, const std::vector<Column>& columns,
+               Format format=text, size_t blockRecords=1024);
+    /// flushes any outstanding records. Write errors are ignored -
+    /// call close() to have them reported.
+    ~DataLogger();
+    DataLogger(const DataLogger&)=delete;
+    void operator=(const DataLogger&)=delete;
+
+    /// append a record of the logged variables at time \a t
+    /// @throw ecolab::error if the writer thread failed to write an
+    /// earlier block
+    void log(double t, const std::vector<double>& stocks, const std::vector<double>& flows);
+    /// update variable locations (eg after a reset). \a columns
+    /// must correspond one-to-one with those the logger was opened with.
+    void remap(const std::vector<Column>& columns);
+    /// write out all records logged so far
+    /// @throw ecolab::error if a write failed
+    void flush();
+    /// flush, and close the log file
+    /// @throw ecolab::error if a write failed
+    void close();
+
+    const std::vector<Column>& columns() const {return m_columns;}
+    
+  private:
+    std::ofstream os;
+    Format format;
+    std::vector<Column> m_columns;
+    size_t blockSize; ///< number of doubles in a block
+    /// front is filled by log(), back is written by the writer thread
+    std::vector<double> front, back;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool backFull=false, done=false;
+    /// error writing a block, reported on the logging thread
+    std::string writeError;
+    std::atomic<bool> failed{false};
+    boost::thread writer;
+
+    /// pass the front buffer to the writer thread, waiting for it to
+    /// finish any previous block
+    void swapBuffers();
+    void writeBlock(const std::vector<double>&);
+    /// throw writeError, if any. mutex must be held.
+    void checkWriteError();
+    void run();
+  };
+
+  /// convert a log file written in DataLogger::binary format to the
+  /// text format: a header line of variable names, followed by space
+  /// separated records
+  void convertBinaryLog(const std::string& binaryFile, const std::string& textFile);
+}
+
+#endif
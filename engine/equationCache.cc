@@ -0,0 +1,323 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "equationCache.h"
+#include "minsky.h"
+#include "minsky_epilogue.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+using namespace std;
+
+namespace minsky
+{
+  namespace
+  {
+    const char cacheMagic[]="MinskyEquationCache";
+
+    /// all items of the model, in a fixed traversal order, so that
+    /// items can be referred to by position in the cache file
+    vector<ItemPtr> allItems(const Minsky& m)
+    {
+      vector<ItemPtr> r;
+      m.model->recursiveDo
+        (&Group::items, [&](Items&, Items::iterator i) {
+          r.push_back(*i);
+          return false;
+        });
+      return r;
+    }
+
+    /// description of a VariableValue referred to by the equations
+    struct ValueDesc
+    {
+      string valueId; ///< set if this refers to an entry of variableValues
+      int type=VariableType::undefined;
+      int idx=-1;
+      string name;
+      string units;
+    };
+
+    void packValue(pack_t& buf, const VariableValue& v, const map<const VariableValue*,string>& named)
+    {
+      auto n=named.find(&v);
+      buf<<(n==named.end()? string(): n->second)<<int(v.type())<<v.idx()<<v.name<<v.units.str();
+    }
+
+    ValueDesc unpackValue(pack_t& buf)
+    {
+      ValueDesc r;
+      buf>>r.valueId>>r.type>>r.idx>>r.name>>r.units;
+      return r;
+    }
+
+    void readFile(const string& filename, pack_t& buf)
+    {
+      ifstream f(filename, ios::binary);
+      char b[4096];
+      while (f.read(b,sizeof(b)), f.gcount()>0)
+        buf.packraw(b,f.gcount());
+    }
+  }
+
+  VariableValue EquationCache::makeValue(int type, int idx, const std::string& name, const std::string& units)
+  {
+    VariableValue r(VariableType::Type(type));
+    r.m_idx=idx;
+    r.name=name;
+    r.units=Units(units);
+    return r;
+  }
+
+  string EquationCache::fileName(const Minsky& m, const string& dir)
+  {
+    return dir+"/"+m.modelHash()+"-"+Minsky::minskyVersion+".eqc";
+  }
+
+  bool EquationCache::store(const Minsky& m, const string& filename)
+  {
+    // tensor valued models carry hypercube and tensor expression
+    // state that is not represented here
+    for (auto& v: m.variableValues)
+      if (v.second->rank()>0)
+        return false;
+    for (auto& e: m.equations)
+      if (!dynamic_cast<const ScalarEvalOp*>(e.get()) || e->type()==OperationType::constant)
+        return false;
+
+    auto items=allItems(m);
+    map<const Item*,int> itemIdx;
+    for (size_t i=0; i<items.size(); ++i)
+      itemIdx[items[i].get()]=i;
+    auto itemRef=[&](const Item* i) {
+      auto j=itemIdx.find(i);
+      return j==itemIdx.end()? -1: j->second;
+    };
+    map<const VariableValue*,string> named;
+    for (auto& v: m.variableValues)
+      named[v.second.get()]=v.first;
+    
+    pack_t buf;
+    buf<<string(cacheMagic)<<string(Minsky::minskyVersion)<<items.size();
+
+    buf<<m.variableValues.size();
+    for (auto& v: m.variableValues)
+      buf<<v.first<<int(v.second->type())<<v.second->idx()<<v.second->name<<
+        v.second->init<<v.second->units.str();
+    buf<<ValueVector::stockVars<<ValueVector::flowVars;
+
+    buf<<m.equations.size();
+    for (auto& e: m.equations)
+      {
+        buf<<int(e->type())<<e->out<<e->in1<<e->in2.size();
+        for (auto& s: e->in2)
+          {
+            buf<<s.size();
+            for (auto& j: s)
+              buf<<j.weight<<j.idx;
+          }
+        buf<<e->flow1<<e->flow2<<e->xflow<<itemRef(e->state.get());
+      }
+
+    buf<<m.integrals.size();
+    for (auto& i: m.integrals)
+      {
+        packValue(buf,i.stock,named);
+        packValue(buf,i.input,named);
+        buf<<itemRef(i.operation);
+      }
+
+    // variable values attached to output ports
+    pack_t portBuf;
+    size_t numPorts=0;
+    for (size_t i=0; i<items.size(); ++i)
+      for (size_t j=0; j<items[i]->ports.size(); ++j)
+        {
+          auto& p=items[i]->ports[j];
+          if (p->input()) continue;
+          auto v=p->getVariableValue();
+          if (v && v->idx()>=0)
+            {
+              portBuf<<i<<j;
+              packValue(portBuf,*v,named);
+              ++numPorts;
+            }
+        }
+    buf<<numPorts;
+    buf.packraw(portBuf.data(),portBuf.size());
+
+    // write to a unique temporary, then rename, so concurrent
+    // processes never see a partially written cache file
+    auto tmpName=boost::filesystem::unique_path(filename+".%%%%%%").string();
+    {
+      ofstream f(tmpName, ios::binary);
+      f.write(buf.data(), buf.size());
+      if (!f) return false;
+    }
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmpName, filename, ec);
+    if (ec)
+      boost::filesystem::remove(tmpName, ec);
+    return !ec;
+  }
+
+  bool EquationCache::restore(Minsky& m, const string& filename)
+  {
+    if (!boost::filesystem::exists(filename))
+      return false;
+    pack_t buf;
+    readFile(filename, buf);
+
+    // read and validate everything before touching the model, so a
+    // stale or corrupt cache just results in equations being constructed
+    struct Entry
+    {
+      string valueId, name, init, units;
+      int type, idx;
+    };
+    vector<Entry> entries;
+    vector<double> stocks, flows;
+    EvalOpVector equations;
+    vector<Integral> integrals;
+    vector<pair<shared_ptr<Port>, ValueDesc>> ports;
+    try
+      {
+        string magic, version;
+        buf>>magic;
+        if (magic!=cacheMagic) return false;
+        buf>>version;
+        if (version!=Minsky::minskyVersion) return false;
+
+        auto items=allItems(m);
+        size_t numItems;
+        buf>>numItems;
+        if (numItems!=items.size()) return false;
+        auto item=[&](int i)->ItemPtr {
+          if (i<0) return nullptr;
+          if (size_t(i)>=items.size())
+            throw error("invalid item reference");
+          return items[i];
+        };
+
+        size_t numEntries, numExisting=0;
+        buf>>numEntries;
+        entries.resize(numEntries);
+        for (auto& e: entries)
+          {
+            buf>>e.valueId>>e.type>>e.idx>>e.name>>e.init>>e.units;
+            auto v=m.variableValues.find(e.valueId);
+            if (v!=m.variableValues.end())
+              {
+                // layout of named variables must agree with that just allocated
+                if (v->second->type()!=e.type || v->second->idx()!=e.idx)
+                  return false;
+                numExisting++;
+              }
+          }
+        if (numExisting!=m.variableValues.size())
+          return false;
+        
+        buf>>stocks>>flows;
+        if (stocks.size()<ValueVector::stockVars.size() || flows.size()<ValueVector::flowVars.size())
+          return false;
+
+        size_t numEquations;
+        buf>>numEquations;
+        for (size_t i=0; i<numEquations; ++i)
+          {
+            int type, stateIdx;
+            buf>>type;
+            auto op=ScalarEvalOp::create(OperationType::Type(type));
+            if (!op) return false;
+            equations.emplace_back(op);
+            size_t n;
+            buf>>op->out>>op->in1>>n;
+            op->in2.resize(n);
+            for (auto& s: op->in2)
+              {
+                buf>>n;
+                s.resize(n);
+                for (auto& j: s)
+                  buf>>j.weight>>j.idx;
+              }
+            buf>>op->flow1>>op->flow2>>op->xflow>>stateIdx;
+            if (op->out<0 || size_t(op->out)>=flows.size())
+              return false;
+            op->state=dynamic_pointer_cast<OperationBase>(item(stateIdx));
+          }
+
+        size_t numIntegrals;
+        buf>>numIntegrals;
+        for (size_t i=0; i<numIntegrals; ++i)
+          {
+            auto stock=unpackValue(buf), input=unpackValue(buf);
+            int opIdx;
+            buf>>opIdx;
+            integrals.emplace_back(makeValue(input.type,input.idx,input.name,input.units));
+            integrals.back().stock=makeValue(stock.type,stock.idx,stock.name,stock.units);
+            integrals.back().operation=dynamic_cast<IntOp*>(item(opIdx).get());
+          }
+
+        size_t numPorts;
+        buf>>numPorts;
+        for (size_t i=0; i<numPorts; ++i)
+          {
+            size_t itemIdx, portIdx;
+            buf>>itemIdx>>portIdx;
+            auto it=item(itemIdx);
+            if (portIdx>=it->ports.size())
+              return false;
+            ports.emplace_back(it->ports[portIdx], unpackValue(buf));
+          }
+      }
+    catch (const std::exception&)
+      {
+        return false;
+      }
+
+    // now install the cached program
+    for (auto& e: entries)
+      {
+        auto v=m.variableValues.find(e.valueId);
+        if (v==m.variableValues.end())
+          {
+            v=m.variableValues.emplace(e.valueId, VariableValuePtr(VariableType::Type(e.type))).first;
+            v->second->m_idx=e.idx;
+            v->second->name=e.name;
+          }
+        v->second->init=e.init;
+        v->second->units=Units(e.units);
+      }
+    ValueVector::stockVars.swap(stocks);
+    ValueVector::flowVars.swap(flows);
+    m.equations.swap(equations);
+    m.integrals.swap(integrals);
+    for (auto& p: ports)
+      {
+        auto v=m.variableValues.find(p.second.valueId);
+        if (!p.second.valueId.empty() && v!=m.variableValues.end())
+          p.first->setVariableValue(v->second);
+        else
+          p.first->setVariableValue
+            (make_shared<VariableValue>
+             (makeValue(p.second.type,p.second.idx,p.second.name,p.second.units)));
+      }
+    return true;
+  }
+}
@@ -0,0 +1,51 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EQUATIONCACHE_H
+#define EQUATIONCACHE_H
+
+#include <string>
+
+namespace minsky
+{
+  class Minsky;
+  class VariableValue;
+
+  /// Persistent on-disk cache of the compiled equation program and
+  /// variable layout of a model, allowing Minsky::constructEquations
+  /// to skip DAG construction when loading a previously seen
+  /// model. Only scalar models are cached.
+  class EquationCache
+  {
+    static VariableValue makeValue(int type, int idx, const std::string& name, const std::string& units);
+  public:
+    /// name of cache file for \a m within directory \a dir
+    static std::string fileName(const Minsky& m, const std::string& dir);
+    /// write the equations just constructed in \a m to \a filename
+    /// @return true if the model was cacheable, and the file written
+    static bool store(const Minsky& m, const std::string& filename);
+    /// install the equation program cached in \a filename into \a m,
+    /// which must have just been garbage collected.
+    /// @return false if the cache is missing or inconsistent with the
+    /// model, in which case \a m is left untouched
+    static bool restore(Minsky& m, const std::string& filename);
+  };
+}
+
+#endif
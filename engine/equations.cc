@@ -87,6 +87,7 @@ namespace MathDAG
         try
           {
             auto ec=make_shared<EvalCommon>();
+            ec->arena=cminsky().tensorArena;
             TensorPtr rhs=tensorOpFactory.create(*state,TensorsFromPort(ec));
             if (!rhs) return false;
             result->hypercube(rhs->hypercube());
@@ -156,7 +157,12 @@ namespace MathDAG
       }
     assert(result->idx()>=0);
     if (r && r->isFlowVar() && (r!=result || !result->isFlowVar()))
-      ev.push_back(EvalOpPtr(OperationType::copy, nullptr, *r, *result));
+      {
+        if (result->inPlace()) // not in the value vector
+          ev.emplace_back(EvalOpPtr(new TensorEval(r,result)));
+        else
+          ev.push_back(EvalOpPtr(OperationType::copy, nullptr, *r, *result));
+      }
     doOneEvent(true);
     return result;
   }
@@ -133,7 +133,7 @@ namespace minsky
   double EvalOp<OperationType::constant>::d2(double x1, double x2) const
   {return 0;}
 
-  double EvalOpBase::t;
+  thread_local double EvalOpBase::t;
   string EvalOpBase::timeUnit;
 
   template <>
@@ -851,6 +851,11 @@ namespace minsky
     auto t=ScalarEvalOp::create(op);
     reset(t);
     assert(t->numArgs()==0 || (from1.idx()>=0 && (t->numArgs()==1 || from2.idx()>=0)));
+    // scalar operations index the value vector, which does not hold values read in place
+    if ((t->numArgs()>0 && from1.inPlace() && from1.size()>1) ||
+        (t->numArgs()>1 && from2.inPlace() && from2.size()>1))
+      throw error("tensor %s stored in place cannot be used in a scalar operation",
+                  (from1.inPlace()? from1: from2).name.c_str());
     t->state=dynamic_pointer_cast<OperationBase>(state);
       
     switch (t->numArgs())
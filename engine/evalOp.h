@@ -49,8 +49,9 @@ namespace minsky
   {
     typedef OperationType::Type Type;
 
-    // value used for the time operator
-    static double t;
+    /// value used for the time operator, per thread, as the GUI and free running
+    /// solver threads evaluate at different times
+    static thread_local double t;
     static std::string timeUnit;
 
     /// indexes into the flow/stock variables vector
@@ -0,0 +1,93 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include <stddef.h>
+
+namespace minsky
+{
+  /// Lock-free single producer, single consumer ring buffer of fixed
+  /// width frames of doubles. The producer never blocks - if the
+  /// consumer has not kept up, and the buffer is full, the frame is
+  /// dropped and counted.
+  class FrameRing
+  {
+    std::vector<double> data;
+    size_t m_width=0, m_capacity=0;
+    /// frame counters. head is only written by the producer, tail
+    /// only by the consumer
+    std::atomic<size_t> head{0}, tail{0};
+    std::atomic<size_t> m_dropped{0};
+  public:
+    FrameRing() {}
+    FrameRing(size_t width, size_t capacity) {resize(width, capacity);}
+    FrameRing(const FrameRing&)=delete;
+    void operator=(const FrameRing&)=delete;
+
+    /// set frame width and number of frames held, discarding
+    /// contents. Must not be called concurrently with push or pop.
+    void resize(size_t width, size_t capacity) {
+      m_width=width;
+      m_capacity=std::max(capacity,size_t(1));
+      data.resize(m_width*m_capacity);
+      head=tail=m_dropped=0;
+    }
+    /// number of doubles in a frame
+    size_t width() const {return m_width;}
+    size_t capacity() const {return m_capacity;}
+    /// number of frames available to the consumer
+    size_t size() const {return head.load(std::memory_order_acquire)-tail.load(std::memory_order_acquire);}
+    bool empty() const {return size()==0;}
+    /// number of frames dropped due to the buffer being full
+    size_t dropped() const {return m_dropped;}
+
+    /// producer: append \a frame (of width() doubles) to the buffer
+    /// @return false if the frame was dropped
+    bool push(const double* frame) {
+      size_t h=head.load(std::memory_order_relaxed);
+      if (h-tail.load(std::memory_order_acquire)>=m_capacity)
+        {
+          ++m_dropped;
+          return false;
+        }
+      std::copy(frame, frame+m_width, data.begin()+(h%m_capacity)*m_width);
+      head.store(h+1, std::memory_order_release);
+      return true;
+    }
+
+    /// consumer: remove the oldest frame into \a frame
+    /// @return false if no frame is available
+    bool pop(double* frame) {
+      size_t t=tail.load(std::memory_order_relaxed);
+      if (t==head.load(std::memory_order_acquire))
+        return false;
+      auto src=data.begin()+(t%m_capacity)*m_width;
+      std::copy(src, src+m_width, frame);
+      tail.store(t+1, std::memory_order_release);
+      return true;
+    }
+  };
+}
+
+#endif
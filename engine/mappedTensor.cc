@@ -0,0 +1,141 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mappedTensor.h"
+#include "minsky_epilogue.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+using boost::interprocess::file_mapping;
+using boost::interprocess::mapped_region;
+using boost::interprocess::read_only;
+
+namespace minsky
+{
+  MappedTensorData::ScratchFile::~ScratchFile()
+  {
+    if (!name.empty())
+      {
+        boost::system::error_code ec;
+        boost::filesystem::remove(name, ec);
+      }
+  }
+
+  namespace
+  {
+    /// convert elements [\a begin, \a end) of \a x to single
+    /// precision, writing them to \a dest
+    void toSingle(const civita::TensorVal& x, size_t begin, size_t end,
+                  float* dest, PrecisionLoss& loss)
+    {
+      for (size_t i=begin; i<end; ++i, ++dest)
+        {
+          double v=x[i];
+          *dest=v;
+          loss.add(v, *dest);
+        }
+    }
+
+    /// convert \a n single precision elements to double. A separate
+    /// loop so the compiler can vectorise it.
+    void toDouble(const float* x, size_t n, double* dest)
+    {
+      for (size_t i=0; i<n; ++i)
+        dest[i]=x[i];
+    }
+  }
+
+  SinglePrecisionTensorData::SinglePrecisionTensorData(const civita::TensorVal& x):
+    values(x.size())
+  {toSingle(x, 0, x.size(), values.data(), precisionLoss);}
+
+  void SinglePrecisionTensorData::load(double* d) const
+  {toDouble(values.data(), values.size(), d);}
+
+  MappedTensorData::MappedTensorData(const string& filename, size_t offset, size_t n,
+                                     bool single, bool isScratch):
+    scratch{isScratch? filename: string()}, n(n), single(single)
+  {
+    if (n==0)
+      throw runtime_error("cannot map empty tensor data");
+    file=file_mapping(filename.c_str(), read_only);
+    region=mapped_region(file, read_only, offset, n*(single? sizeof(float): sizeof(double)));
+    // tensor operations mostly pass through the data in order
+    region.advise(mapped_region::advice_sequential);
+  }
+
+  shared_ptr<MappedTensorData> MappedTensorData::spill
+  (const civita::TensorVal& x, bool singlePrecision)
+  {
+    auto name=(boost::filesystem::temp_directory_path()/
+               boost::filesystem::unique_path("minsky-%%%%-%%%%-%%%%.tensor")).string();
+    PrecisionLoss loss;
+    try
+      {
+        ofstream f(name, ios::binary);
+        // written a block at a time, so that data already in place is
+        // not copied into memory in full
+        vector<double> block;
+        vector<float> singleBlock;
+        const size_t blockSize=1<<16;
+        for (size_t i=0; i<x.size(); i+=blockSize)
+          {
+            size_t end=min(x.size(), i+blockSize);
+            if (singlePrecision)
+              {
+                singleBlock.resize(end-i);
+                toSingle(x, i, end, singleBlock.data(), loss);
+                f.write(reinterpret_cast<const char*>(singleBlock.data()),
+                        singleBlock.size()*sizeof(float));
+              }
+            else
+              {
+                block.clear();
+                for (size_t j=i; j<end; ++j)
+                  block.push_back(x[j]);
+                f.write(reinterpret_cast<const char*>(block.data()), block.size()*sizeof(double));
+              }
+          }
+        if (!f.flush())
+          throw runtime_error("failed to write "+name);
+      }
+    catch (...)
+      {
+        boost::system::error_code ec;
+        boost::filesystem::remove(name, ec);
+        throw;
+      }
+    shared_ptr<MappedTensorData> r(new MappedTensorData(name, 0, x.size(), singlePrecision, true));
+    r->precisionLoss=loss;
+    return r;
+  }
+
+  void MappedTensorData::load(double* d) const
+  {
+    if (single)
+      toDouble(floatData(), n, d);
+    else
+      memcpy(d, data(), n*sizeof(double));
+  }
+}
@@ -0,0 +1,121 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAPPEDTENSOR_H
+#define MAPPEDTENSOR_H
+
+#include "tensorVal.h"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace minsky
+{
+  /// largest differences between tensor data and its single
+  /// precision representation
+  struct PrecisionLoss
+  {
+    double maxAbs=0, maxRel=0;
+    /// account for \a x being stored as \a y
+    void add(double x, float y) {
+      double d=std::fabs(x-y);
+      if (d>maxAbs) maxAbs=d;
+      if (x!=0 && d/std::fabs(x)>maxRel) maxRel=d/std::fabs(x);
+    }
+  };
+
+  /// tensor data held outside of TensorVal, and read in place
+  class InPlaceTensorData: public civita::TensorValLoader
+  {
+  public:
+    /// precision lost storing the original data in single precision
+    PrecisionLoss precisionLoss;
+    /// the original data, where held in single precision, so that
+    /// the model is saved, and converted back, without loss
+    std::shared_ptr<const civita::TensorValLoader> fullPrecision;
+    bool singlePrecision() const {return floatData()!=nullptr;}
+    /// bytes of data held in memory
+    virtual size_t residentBytes() const=0;
+    /// bytes of data mapped from file
+    virtual size_t mappedBytes() const=0;
+  };
+
+  /// Tensor data held in memory in single precision, halving the
+  /// memory and bandwidth used by reading it. Elements are converted
+  /// to double as they are read, so operations still accumulate in
+  /// double precision.
+  class SinglePrecisionTensorData: public InPlaceTensorData
+  {
+    std::vector<float> values;
+  public:
+    explicit SinglePrecisionTensorData(const civita::TensorVal& x);
+    size_t size() const override {return values.size();}
+    const float* floatData() const override {return values.data();}
+    void load(double* d) const override;
+    size_t residentBytes() const override {return values.size()*sizeof(float);}
+    size_t mappedBytes() const override {return 0;}
+  };
+
+  /// Tensor data held in a memory mapped file, and read in place,
+  /// so that it occupies the page cache rather than resident
+  /// memory. Pages are read as tensor operations reach them, and may
+  /// be discarded once passed, allowing data larger than physical
+  /// memory to be used. The data is immutable - TensorVal loads a
+  /// copy on non-const access.
+  class MappedTensorData: public InPlaceTensorData
+  {
+    /// scratch file removed once unmapped, if any. Declared first,
+    /// so it is destroyed last.
+    struct ScratchFile
+    {
+      std::string name;
+      ~ScratchFile();
+    } scratch;
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    size_t n;
+    bool single; ///< elements are floats rather than doubles
+    MappedTensorData(const std::string& filename, size_t offset, size_t n,
+                     bool single, bool scratch);
+  public:
+    /// map \a n doubles at \a offset bytes into \a filename. \a offset
+    /// should be a multiple of sizeof(double).
+    MappedTensorData(const std::string& filename, size_t offset, size_t n):
+      MappedTensorData(filename, offset, n, false, false) {}
+    /// copy the data of \a x into a scratch file in the temporary
+    /// directory, and map that
+    /// @param singlePrecision store the data as floats
+    static std::shared_ptr<MappedTensorData> spill
+    (const civita::TensorVal& x, bool singlePrecision=false);
+
+    size_t size() const override {return n;}
+    const double* data() const override
+    {return single? nullptr: static_cast<const double*>(region.get_address());}
+    const float* floatData() const override
+    {return single? static_cast<const float*>(region.get_address()): nullptr;}
+    void load(double* d) const override;
+    size_t residentBytes() const override {return 0;}
+    size_t mappedBytes() const override {return region.get_size();}
+  };
+}
+
+#endif
@@ -146,7 +146,7 @@ namespace minsky
     virtual void setArguments(const std::vector<TensorPtr>& a1,
                               const std::vector<TensorPtr>& a2)
     {
-      auto pa1=make_shared<AccumArgs<op>>(), pa2=make_shared<AccumArgs<op>>();
+      auto pa1=makeArenaShared<AccumArgs<op>>(), pa2=makeArenaShared<AccumArgs<op>>();
       pa1->setArguments(a1,{},0); pa2->setArguments(a2,{},0);
       civita::BinOp::setArguments(pa1, pa2);
     }
@@ -168,12 +168,14 @@ namespace minsky
     struct is_equal {const static bool value=I==J;};
   }
 
-  //register factory functions for all binary ops
+  //register factory functions for all binary ops. Operations created
+  //are owned by the graph they are created for, so are allocated from
+  //its arena.
   template <template<OperationType::Type> class T, int op, int to>
   typename classdesc::enable_if<Not<is_equal<op, to>>, void>::T
   registerOps(TensorOpFactory& tensorOpFactory)
   {
-    tensorOpFactory.registerType<T<OperationType::Type(op)>>(OperationType::Type(op));
+    tensorOpFactory.registerType<ArenaAllocated<T<OperationType::Type(op)>>>(OperationType::Type(op));
     registerOps<T, op+1, to>(tensorOpFactory);
   }
 
@@ -184,7 +186,7 @@ namespace minsky
 
   TensorOpFactory::TensorOpFactory()
   {
-    registerType<TimeOp>(OperationType::time);
+    registerType<ArenaAllocated<TimeOp>>(OperationType::time);
     registerOps<MinskyTensorOp, OperationType::euler, OperationType::add>(*this);
     registerOps<MultiWireBinOp, OperationType::add, OperationType::log>(*this); 
     registerOps<TensorBinOp, OperationType::log, OperationType::copy>(*this);   
@@ -442,6 +444,7 @@ namespace minsky
   class RavelTensor: public civita::ITensor
   {
     const Ravel& ravel;
+    shared_ptr<civita::RavelChain> ravelChain;
     vector<TensorPtr> chain;
     
     CLASSDESC_ACCESS(Ravel);
@@ -450,8 +453,19 @@ namespace minsky
 
     void setArgument(const TensorPtr& a,const std::string&,double) override {
       // not sure how to avoid this const cast here
-      const_cast<Ravel&>(ravel).populateHypercube(a->hypercube());
-      chain=civita::createRavelChain(ravel.getState(), a);
+      auto& r=const_cast<Ravel&>(ravel);
+      // the chain is kept by the ravel, so outlives this calculation's arena
+      TensorArena::Scope heap(nullptr);
+      r.populateHypercube(a->hypercube());
+      if (!r.chain) r.chain=make_shared<civita::RavelChain>();
+      // the ravel's chain is taken over from the graph it was last
+      // used by, once released. Whilst another graph still uses it,
+      // this one has a chain of its own, so as not to rebind the other
+      // graph's argument.
+      if (!ravelChain)
+        ravelChain=r.chain.use_count()==1? r.chain: make_shared<civita::RavelChain>();
+      ravelChain->update(ravel.getState(), a);
+      chain=ravelChain->chain();
     }
 
     double operator[](size_t i) const override {return chain.empty()? 0: (*chain.back())[i];}
@@ -466,9 +480,10 @@ namespace minsky
   std::shared_ptr<ITensor> TensorOpFactory::create
   (const Item& it, const TensorsFromPort& tfp)
   {
+    TensorArena::Scope scope(tfp.ev? tfp.ev->arena.get(): nullptr);
     if (auto ravel=dynamic_cast<const Ravel*>(&it))
 	    {
-	      auto r=make_shared<RavelTensor>(*ravel);
+	      auto r=makeArenaShared<RavelTensor>(*ravel);
 	      r->setArguments(tfp.tensorsFromPorts(it.ports));
 	      return r;
 	    }
@@ -495,10 +510,10 @@ namespace minsky
           op->throw_error(ex.what());
         }
     else if (auto v=it.variableCast())
-      return make_shared<ConstTensorVarVal>(v->vValue(), tfp.ev);
+      return makeArenaShared<ConstTensorVarVal>(v->vValue(), tfp.ev);
     else if (auto sw=dynamic_cast<const SwitchIcon*>(&it))
       {
-        auto r=make_shared<SwitchTensor>();
+        auto r=makeArenaShared<SwitchTensor>();
         r->setArguments(tfp.tensorsFromPorts(it.ports));
         return r;
       }
@@ -562,11 +577,13 @@ namespace minsky
   TensorEval::TensorEval(const shared_ptr<VariableValue>& dest, const shared_ptr<VariableValue>& src):
     result(dest,make_shared<EvalCommon>())
   {
+    result.ev->arena=cminsky().tensorArena;
     result.index(src->index());
     result.hypercube(src->hypercube());
     Operation<OperationType::copy> tmp;
-    auto copy=dynamic_pointer_cast<ITensor>(tensorOpFactory.create(tmp));
-    copy->setArgument(make_shared<ConstTensorVarVal>(src,result.ev));
+    TensorArena::Scope scope(result.ev->arena.get());
+    auto copy=dynamic_pointer_cast<ITensor>(tensorOpFactory.create(tmp,TensorsFromPort(result.ev)));
+    copy->setArgument(makeArenaShared<ConstTensorVarVal>(src,result.ev));
     rhs=move(copy);
     assert(result.size()==rhs->size());
   }   
@@ -578,8 +595,15 @@ namespace minsky
         assert(result.idx()>=0);
         result.ev->update(fv, n, sv);
         //        assert(result.size()==rhs->size());
-        result.hypercube(rhs->hypercube());
-        for (size_t i=0; i<rhs->size(); ++i)
+        // The result's hypercube is set at construction, and when the
+        // equations are evaluated at reset, so is only set here if it
+        // has changed since. It is shared with the GUI thread, so the
+        // free running solver leaves it alone, and fills only the
+        // elements already allocated.
+        if (!cminsky().freeRunning() && result.hypercube()!=rhs->hypercube())
+          result.hypercube(rhs->hypercube());
+        size_t size=min(rhs->size(), result.size());
+        for (size_t i=0; i<size; ++i)
           {
             auto v=(*rhs)[i];
             result[i]=v;
@@ -39,6 +39,9 @@ namespace minsky
     const double* m_stockVars=nullptr;
     ITensor::Timestamp m_timestamp;
   public:
+    /// arena the tensor operations of the calculation are allocated
+    /// from, if any
+    TensorArenaPtr arena;
     double* flowVars() const {return m_flowVars;}
     size_t fvSize() const {return m_fvSize;}
     const double* stockVars() const {return m_stockVars;}
@@ -106,6 +109,7 @@ namespace minsky
     /// 
     ITensor::Timestamp timestamp() const override {return ev->timestamp();}
     double operator[](size_t i) const override {
+      if (value->inPlace()) return (*value)[i]; // parameters read in place
       return value->isFlowVar()? ev->flowVars()[value->idx()+i]: ev->stockVars()[value->idx()+i];
     }
     TensorVarValBase(const std::shared_ptr<VV>& vv, const shared_ptr<EvalCommon>& ev):
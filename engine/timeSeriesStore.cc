@@ -0,0 +1,243 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "timeSeriesStore.h"
+#include <ecolab.h>
+#include "minsky_epilogue.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <math.h>
+#include <string.h>
+using namespace std;
+using ecolab::error;
+
+namespace minsky
+{
+  void TimeSeriesStore::setColumns(const vector<Column>& columns)
+  {
+    m_columns=columns;
+    clear();
+  }
+
+  void TimeSeriesStore::remap(const vector<Column>& columns)
+  {
+    if (columns.size()!=m_columns.size())
+      throw error("inconsistent number of time series columns");
+    m_columns=columns;
+  }
+
+  int TimeSeriesStore::column(const string& name) const
+  {
+    for (size_t i=0; i<m_columns.size(); ++i)
+      if (m_columns[i].name==name)
+        return i;
+    return -1;
+  }
+
+  size_t TimeSeriesStore::memoryUsage() const
+  {
+    size_t r=0;
+    for (auto& c: chunks)
+      {
+        r+=c.compressed.size();
+        for (auto& d: c.data)
+          r+=d.capacity()*sizeof(double);
+      }
+    return r;
+  }
+
+  void TimeSeriesStore::append(double t, const vector<double>& stocks, const vector<double>& flows)
+  {
+    if (chunks.empty() || chunks.back().n>=chunkSize)
+      {
+        // compress the oldest chunk that falls out of the uncompressed window
+        if (chunks.size()>uncompressedChunks)
+          compress(chunks[chunks.size()-uncompressedChunks-1]);
+        chunks.emplace_back();
+        auto& c=chunks.back();
+        c.data.resize(m_columns.size()+1);
+        for (auto& d: c.data)
+          d.reserve(chunkSize);
+        c.tmin=c.tmax=t;
+      }
+    auto& c=chunks.back();
+    c.data[0].push_back(t);
+    for (size_t i=0; i<m_columns.size(); ++i)
+      {
+        auto& col=m_columns[i];
+        auto& v=col.flow? flows: stocks;
+        c.data[i+1].push_back(col.idx>=0 && size_t(col.idx)<v.size()? v[col.idx]: nan(""));
+      }
+    c.tmin=min(c.tmin,t);
+    c.tmax=max(c.tmax,t);
+    c.n++;
+    m_size++;
+    if (c.n==1) evict();
+  }
+
+  void TimeSeriesStore::evict()
+  {
+    if (!maxRecords) return;
+    while (chunks.size()>1 && m_size-chunks.front().n>=maxRecords)
+      {
+        m_size-=chunks.front().n;
+        chunks.pop_front();
+      }
+  }
+
+  void TimeSeriesStore::compress(Chunk& c) const
+  {
+    if (c.data.empty()) return;
+    vector<double> buf;
+    buf.reserve(c.n*c.data.size());
+    for (auto& d: c.data)
+      buf.insert(buf.end(), d.begin(), d.end());
+    uLongf len=compressBound(buf.size()*sizeof(double));
+    c.compressed.resize(len);
+    if (compress2(reinterpret_cast<Bytef*>(&c.compressed[0]), &len,
+                  reinterpret_cast<const Bytef*>(buf.data()), buf.size()*sizeof(double),
+                  Z_BEST_SPEED)!=Z_OK)
+      {
+        // leave chunk uncompressed
+        c.compressed.clear();
+        return;
+      }
+    c.compressed.resize(len);
+    c.compressed.shrink_to_fit();
+    c.data.clear();
+    c.data.shrink_to_fit();
+  }
+
+  const vector<vector<double>>& TimeSeriesStore::data
+  (const Chunk& c, vector<vector<double>>& buffer) const
+  {
+    if (!c.data.empty())
+      return c.data;
+    vector<double> buf(c.n*(m_columns.size()+1));
+    uLongf len=buf.size()*sizeof(double);
+    if (uncompress(reinterpret_cast<Bytef*>(buf.data()), &len,
+                   reinterpret_cast<const Bytef*>(c.compressed.data()), c.compressed.size())!=Z_OK ||
+        len!=buf.size()*sizeof(double))
+      throw error("corrupt time series data");
+    buffer.resize(m_columns.size()+1);
+    for (size_t i=0; i<buffer.size(); ++i)
+      buffer[i].assign(buf.begin()+i*c.n, buf.begin()+(i+1)*c.n);
+    return buffer;
+  }
+
+  void TimeSeriesStore::visitChunks
+  (double t0, double t1, const function<void(const vector<vector<double>>&,size_t)>& f) const
+  {
+    vector<vector<double>> buffer;
+    for (auto& c: chunks)
+      if (c.tmax>=t0 && c.tmin<=t1)
+        f(data(c, buffer), c.n);
+  }
+
+  void TimeSeriesStore::visit(int col, const Visitor& f) const
+  {
+    visit(col, -numeric_limits<double>::max(), numeric_limits<double>::max(), f);
+  }
+
+  void TimeSeriesStore::visit(int col, double t0, double t1, const Visitor& f) const
+  {
+    if (col<-1 || col>=int(m_columns.size()))
+      throw error("invalid time series column %d",col);
+    visitChunks(t0, t1, [&](const vector<vector<double>>& d, size_t n)
+                {f(d[0].data(), d[col+1].data(), n);});
+  }
+
+  void TimeSeriesStore::query(int col, double t0, double t1, size_t maxPoints,
+                              vector<double>& t, vector<double>& y) const
+  {
+    t.clear(); y.clear();
+    visit(col, t0, t1, [&](const double* ct, const double* cy, size_t n)
+          {
+            for (size_t i=0; i<n; ++i)
+              if (ct[i]>=t0 && ct[i]<=t1)
+                {
+                  t.push_back(ct[i]);
+                  y.push_back(cy[i]);
+                }
+          });
+
+    if (maxPoints<2 || t.size()<=maxPoints) return;
+    // downsample by retaining the extreme values within each interval
+    size_t intervals=maxPoints/2;
+    vector<double> dt, dy;
+    dt.reserve(maxPoints); dy.reserve(maxPoints);
+    for (size_t b=0; b<intervals; ++b)
+      {
+        size_t begin=b*t.size()/intervals, end=(b+1)*t.size()/intervals;
+        if (begin==end) continue;
+        size_t mn=begin, mx=begin;
+        for (size_t i=begin+1; i<end; ++i)
+          {
+            if (y[i]<y[mn]) mn=i;
+            if (y[i]>y[mx]) mx=i;
+          }
+        // output in time order
+        for (auto i: {min(mn,mx), max(mn,mx)})
+          {
+            dt.push_back(t[i]);
+            dy.push_back(y[i]);
+            if (mn==mx) break;
+          }
+      }
+    t.swap(dt);
+    y.swap(dy);
+  }
+
+  void TimeSeriesStore::exportAsCSV(const string& filename, const vector<int>& cols) const
+  {
+    vector<int> selected=cols;
+    if (selected.empty())
+      for (size_t i=0; i<m_columns.size(); ++i)
+        selected.push_back(i);
+    for (auto c: selected)
+      if (c<0 || size_t(c)>=m_columns.size())
+        throw error("invalid column %d",c);
+    
+    ofstream os(filename);
+    if (!os)
+      throw error("cannot open %s",filename.c_str());
+    os<<"t";
+    for (auto c: selected)
+      os<<","<<m_columns[c].name;
+    os<<"\n";
+    // data[0] is time, so column c is data[c+1]
+    visitChunks(-numeric_limits<double>::max(), numeric_limits<double>::max(),
+                [&](const vector<vector<double>>& d, size_t n)
+                {
+                  for (size_t i=0; i<n; ++i)
+                    {
+                      os<<d[0][i];
+                      for (auto c: selected)
+                        os<<","<<d[c+1][i];
+                      os<<"\n";
+                    }
+                });
+    os.close();
+    if (!os)
+      throw error("error writing %s",filename.c_str());
+  }
+}
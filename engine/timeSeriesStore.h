@@ -0,0 +1,118 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TIMESERIESSTORE_H
+#define TIMESERIESSTORE_H
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+namespace minsky
+{
+  /// Columnar store of simulation history. Each step appends a
+  /// record of the time and selected variable values, which are held
+  /// in fixed size chunks, one array per column. Older chunks are
+  /// compressed to conserve memory.
+  class TimeSeriesStore
+  {
+  public:
+    /// a stored variable, resolved to a location in the stock or flow vectors
+    struct Column
+    {
+      std::string name;
+      bool flow; ///< true if located in flowVars, otherwise stockVars
+      int idx; ///< -1 if the variable is not currently allocated
+      Column(const std::string& name="", bool flow=true, int idx=-1):
+        name(name), flow(flow), idx(idx) {}
+    };
+
+    /// number of records held in each chunk
+    size_t chunkSize=4096;
+    /// number of most recent full chunks that are left uncompressed
+    size_t uncompressedChunks=4;
+    /// if nonzero, chunks are discarded once they hold none of the
+    /// most recent maxRecords records, bounding memory use
+    size_t maxRecords=0;
+
+    /// set the variables stored, discarding any existing data
+    void setColumns(const std::vector<Column>& columns);
+    /// update variable locations (eg after a reset). \a columns must
+    /// correspond one-to-one with the existing columns.
+    void remap(const std::vector<Column>& columns);
+    const std::vector<Column>& columns() const {return m_columns;}
+    /// index of the column named \a name, or -1 if not present
+    int column(const std::string& name) const;
+    /// discard all data
+    void clear() {chunks.clear(); m_size=0;}
+    /// number of records stored
+    size_t size() const {return m_size;}
+    /// number of bytes of memory used to hold data
+    size_t memoryUsage() const;
+
+    /// append a record of the stored variables at time \a t
+    void append(double t, const std::vector<double>& stocks, const std::vector<double>& flows);
+
+    typedef std::function<void(const double*,const double*,size_t)> Visitor;
+    /// call \a f(t,y,n) for each chunk's run of times and values of
+    /// column \a col. Uncompressed chunks are passed without copying.
+    void visit(int col, const Visitor& f) const;
+    /// as visit(col,f), restricted to chunks overlapping [t0,t1]
+    void visit(int col, double t0, double t1, const Visitor& f) const;
+
+    /// extract times \a t and values \a y of column \a col lying in
+    /// [t0,t1]. If there are more than \a maxPoints of them, the range
+    /// is divided into intervals, and just the minimum and maximum
+    /// values of each interval are returned, preserving the extrema
+    /// of the series for plotting.
+    void query(int col, double t0, double t1, size_t maxPoints,
+               std::vector<double>& t, std::vector<double>& y) const;
+
+    /// write data of columns \a cols, or all columns if empty, as
+    /// CSV, one row per record
+    void exportAsCSV(const std::string& filename, const std::vector<int>& cols={}) const;
+    
+  private:
+    struct Chunk
+    {
+      size_t n=0; ///< number of records
+      double tmin, tmax; ///< range of time in this chunk
+      /// time, followed by each column. Empty if compressed.
+      std::vector<std::vector<double>> data;
+      std::string compressed;
+    };
+    std::vector<Column> m_columns;
+    std::deque<Chunk> chunks;
+    size_t m_size=0;
+
+    void compress(Chunk&) const;
+    /// discard oldest chunks in excess of maxRecords
+    void evict();
+    /// call \a f(data,n) for each chunk overlapping [t0,t1]
+    void visitChunks(double t0, double t1, const std::function
+                     <void(const std::vector<std::vector<double>>&,size_t)>& f) const;
+    /// uncompressed data of \a chunk, using \a buffer if decompression is needed
+    const std::vector<std::vector<double>>& data
+    (const Chunk& chunk, std::vector<std::vector<double>>& buffer) const;
+  };
+}
+
+#endif
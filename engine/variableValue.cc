@@ -20,6 +20,7 @@
 #include "flowCoef.h"
 #include "str.h"
 #include "minsky.h"
+#include "mappedTensor.h"
 #include "minsky_epilogue.h"
 #include <error.h>
 
@@ -32,6 +33,8 @@ namespace minsky
 
   double& VariableValue::operator[](size_t i)
   {
+    // writing to values read in place writes to a copy of tensorInit
+    if (m_inPlace) return tensorInit[i];
     assert((isFlowVar() && i+m_idx<ValueVector::flowVars.size()) ||
            (!isFlowVar() && i+m_idx<ValueVector::stockVars.size()));
     return *(&valRef()+i);
@@ -41,9 +44,27 @@ namespace minsky
   {
     index(x.index());
     hypercube(x.hypercube());
+    if (m_inPlace)
+      {
+        // values are those of tensorInit, which need only be updated
+        // if x is not the same mapped data
+        if (!x.readInPlace() || x.deferredData()!=tensorInit.deferredData())
+          tensorInit=x;
+        valRef()=x[0];
+        return *this;
+      }
     assert((isFlowVar() && x.size()+m_idx<=ValueVector::flowVars.size()) ||
            (!isFlowVar() && x.size()+m_idx<=ValueVector::stockVars.size()));
-    memcpy(&valRef(), x.begin(), x.size()*sizeof(x[0]));
+    // single precision or deferred data is converted as it is read,
+    // rather than loaded into x
+    if (auto d=x.inPlaceData())
+      memcpy(&valRef(), d, x.size()*sizeof(x[0]));
+    else
+      {
+        auto v=&valRef();
+        for (size_t i=0; i<x.size(); ++i)
+          v[i]=x[i];
+      }
     return *this;
   }
 
@@ -58,6 +79,9 @@ namespace minsky
  
   VariableValue& VariableValue::allocValue()                                        
   {    
+    // values read in place come from tensorInit, so only the first value,
+    // used by scalar operations, is held in the value vector
+    m_inPlace=m_type==parameter && tensorInit.readInPlace() && tensorInit.size()==size();
     switch (m_type)
       {
       case undefined:
@@ -68,7 +92,7 @@ namespace minsky
       case constant:
       case parameter:
         m_idx=ValueVector::flowVars.size();
-        ValueVector::flowVars.resize(ValueVector::flowVars.size()+size());
+        ValueVector::flowVars.resize(ValueVector::flowVars.size()+(m_inPlace? 1: size()));
         break;
       case stock:
       case integral:
@@ -112,7 +136,7 @@ namespace minsky
       case tempFlow:
       case constant:
       case parameter:
-        if (size_t(m_idx+size())<=ValueVector::flowVars.size())
+        if (size_t(m_idx+(m_inPlace? 1: size()))<=ValueVector::flowVars.size())
           return ValueVector::flowVars[m_idx]; 
       case stock:
       case integral: 
@@ -128,7 +152,13 @@ namespace minsky
   (const VariableValues& v, set<string>& visited) const
   {
     if (tensorInit.rank()>0)
-      return tensorInit;
+      {
+        // decode any deferred data once, rather than in each
+        // copy. Data read in place is shared by copies.
+        if (!tensorInit.readInPlace())
+          tensorInit.loadData();
+        return tensorInit;
+      }
     
     FlowCoef fc(init);
     if (trimWS(fc.name).empty())
@@ -228,6 +258,48 @@ namespace minsky
         }
   }
 
+  void VariableValue::storeTensorInit(size_t mappedThreshold, bool singlePrecision)
+  {
+    if (m_type!=parameter || tensorInit.rank()==0) return;
+    auto current=dynamic_cast<const InPlaceTensorData*>(tensorInit.deferredData().get());
+    bool mapped=tensorInit.size()*(singlePrecision? sizeof(float): sizeof(double))>mappedThreshold;
+    if (current)
+      {
+        if (current->singlePrecision()==singlePrecision && (current->mappedBytes()>0)==mapped)
+          return;
+      }
+    else if (!singlePrecision && !mapped)
+      return;
+    try
+      {
+        // data already held in single precision is converted from its original
+        auto full=current && current->singlePrecision()? current->fullPrecision: tensorInit.deferredData();
+        if (full && full!=tensorInit.deferredData())
+          tensorInit.deferData(full);
+        if (!singlePrecision && mapped && dynamic_cast<const MappedTensorData*>(full.get()))
+          return; // the original is already mapped
+        shared_ptr<InPlaceTensorData> data;
+        if (mapped)
+          data=MappedTensorData::spill(tensorInit, singlePrecision);
+        else if (singlePrecision)
+          data=make_shared<SinglePrecisionTensorData>(tensorInit);
+        if (!data)
+          {
+            tensorInit.loadData();
+            return;
+          }
+        if (singlePrecision)
+          // the original is kept out of memory: its encoding, a mapped
+          // file, or failing those, a scratch file
+          data->fullPrecision=full? full: MappedTensorData::spill(tensorInit);
+        tensorInit.deferData(data);
+      }
+    catch (...)
+      {
+        // no room for a scratch file, so keep the data as it is
+      }
+  }
+
 
   int VariableValue::scope(const std::string& name) 
   {
@@ -304,6 +376,8 @@ namespace minsky
     ValueVector::flowVars.clear();
     for (auto& v: *this) {
       v.second->reset_idx();  // Set idx of all flowvars and stockvars to -1 on reset. For ticket 1049		
+      v.second->storeTensorInit(cminsky().mappedTensorThreshold,
+                                cminsky().singlePrecisionParameters);
       v.second->allocValue().reset(*this);
     }
 }
@@ -424,8 +498,9 @@ namespace minsky
     for (auto& i: hypercube().xvectors)
       of<<"\""<<i.name<<"\",";
     of<<"value$\n";
-    for (auto d=begin(); d!=end(); ++i, ++d)
-      if (isfinite(*d))
+    // indexed rather than iterated, so that values are read in place
+    for (; i<size(); ++i)
+      if (isfinite((*this)[i]))
         {
           size_t stride=1;
           for (size_t j=0; j<rank(); ++j)
@@ -433,7 +508,7 @@ namespace minsky
               of << "\""<<str(hypercube().xvectors[j][(i/stride) % hypercube().xvectors[j].size()]) << "\",";
               stride*=hypercube().xvectors[j].size();
             }
-          of << *d << endl;
+          of << (*this)[i] << endl;
         }
   }
 }
@@ -46,12 +46,17 @@ namespace minsky
   private:
     Type m_type;
     int m_idx; /// index into value vector
+    /// values are read in place from tensorInit, such as from a mapped
+    /// file, rather than from the value vector, which holds just the
+    /// first value
+    bool m_inPlace=false;
     double& valRef(); 
     const double& valRef() const;
     std::vector<unsigned> m_dims;
     
     friend class VariableManager;
     friend struct SchemaHelper;
+    friend class EquationCache;
   public:
     /// variable has an input port
     bool lhs() const {
@@ -89,11 +94,17 @@ namespace minsky
     double value(size_t i=0) const {return operator[](i);}
     int idx() const {return m_idx;}
     void reset_idx() {m_idx=-1;}    
+    /// true if values are read in place from tensorInit's data, rather
+    /// than the value vector
+    bool inPlace() const {return m_inPlace;}
+    const double* inPlaceData() const override
+    {return m_inPlace? tensorInit.inPlaceData(): m_idx<0? nullptr: &valRef();}
 
     // values are always live
     Timestamp timestamp() const override {return Timestamp::clock::now();}
     
-    double operator[](size_t i) const override {return *(&valRef()+i);}
+    double operator[](size_t i) const override
+    {return m_inPlace? tensorInit[i]: *(&valRef()+i);}
     double& operator[](size_t i) override;
 
     const Index& index() const override {
@@ -172,6 +183,12 @@ namespace minsky
       return initValue(v, visited);
     }
     void reset(const VariableValues&); 
+    /// store a parameter's tensorInit data in single precision if \a
+    /// singlePrecision, and in a mapped scratch file if more than \a
+    /// mappedThreshold bytes, so that it is read in place rather than
+    /// held in memory as doubles. The original data is kept out of
+    /// memory, for saving, and for converting back.
+    void storeTensorInit(size_t mappedThreshold, bool singlePrecision);
 
     /// check that name is a valid valueId (useful for assertions)
     static bool isValueId(const std::string& name) {	
@@ -120,6 +120,10 @@ proc CSVImportDialog {} {
 
         scale .wiring.csvImport.hscroll -orient horiz -from -100 -to 1000 -showvalue 0 -command scrollTable
         pack .wiring.csvImport.hscroll -fill x -expand 1 -side top
+
+        # size estimate of the import, reported by the preflight pass
+        label .wiring.csvImport.sizing -text ""
+        pack .wiring.csvImport.sizing -side top
         
         buttonBar .wiring.csvImport {}
         # redefine OK command to not delete the the import window on error
@@ -161,7 +165,11 @@ proc CSVImportDialog {} {
 proc csvImportDialogOK {} {
     global csvParms
     minsky.value.csvDialog.spec.horizontalDimName $csvParms(horizontalDimension)
-    set csvImportFailed [catch {loadVariableFromCSV minsky.value.csvDialog.spec "$csvParms(url)"} err]	
+    set csvImportFailed [catch {
+        .wiring.csvImport.sizing configure -text [minsky.value.csvDialog.preflight]
+        update idletasks
+        loadVariableFromCSV minsky.value.csvDialog.spec "$csvParms(url)"
+    } err]	
     if $csvImportFailed {
         toplevel .csvImportError
         label .csvImportError.errMsg -text $err
@@ -335,6 +335,7 @@ set preferencesVars {
     wrapLaTeXLines        "Wrap long equations in LaTeX export" 1 bool
     panopticon        "Enable panopticon" 1 bool
     focusFollowsMouse        "Focus follows mouse" 1 bool    
+    freeRun        "Free running simulation" 0 bool    
 }
 lappend preferencesVars defaultFont "Font" [defaultFont] font
 
@@ -1133,9 +1134,10 @@ pack .controls.zoomOut .controls.zoomIn .controls.zoomOrig .controls.zoomFit -si
 set delay [simulationDelay]
 
 proc runstop {} {
-    global classicMode
+    global classicMode preferences recordingReplay simTMax
     if [running] {
         running 0
+        minsky.stopFreeRun
         doPushHistory 1
         if {$classicMode} {
             .controls.run configure -text run
@@ -1150,9 +1152,28 @@ proc runstop {} {
         } else {
             .controls.run configure -image stopButton
         }
-        step
-        simulate
+        if {$preferences(freeRun) && !$recordingReplay} {
+            minsky.startFreeRun $simTMax
+            pollFreeRun
+        } else {
+            step
+            simulate
+        }
+    }
+}
+
+# consume results from a free running simulation
+proc pollFreeRun {} {
+    global simTMax preferences
+    if {![running]} return
+    if {[catch minsky.pollFreeRun errMsg options]} {
+        runstop
+        return -options $options $errMsg
     }
+    if {$simTMax<[t]} {runstop}
+    .controls.statusbar configure -text "t: [t] dropped frames: [minsky.droppedFrames]"
+    if $preferences(godleyDisplay) redrawAllGodleyTables
+    after [minsky.maxWaitMS] pollFreeRun
 }
 
 set simTMax Inf
@@ -1257,6 +1278,7 @@ proc openNamedFile {ofname} {
         eval minsky.load {[autoBackupName]}
     } else {
         eval minsky.load {$ofname}
+        waitForAutoSave
         file delete [autoBackupName]
     }
     doPushHistory 0
@@ -1307,6 +1329,7 @@ proc save {} {
     if [string length $fname] {
         set workDir [file dirname $fname]
         eval minsky.save {$fname}
+        waitForAutoSave
         file delete [autoBackupName]
     }
 }
@@ -1603,7 +1626,7 @@ proc exit {} {
     if {[edited]||[file exists [autoBackupName]]} {
         switch [tk_messageBox -message "Save before exiting?" -type yesnocancel] {
             yes save
-            no {file delete [autoBackupName]}
+            no {waitForAutoSave; file delete [autoBackupName]}
             cancel {return -level [info level]}
         }
     }
@@ -22,6 +22,7 @@
 #include "minsky.h"
 #include "godleyTableWindow.h"
 #include "variableInstanceList.h"
+#include "autoSaver.h"
 #include <fstream>
 #include <memory>
 
@@ -73,10 +74,25 @@ namespace minsky
       eventRecord.reset();
     }
 
-    std::unique_ptr<std::string> autoSaveFile;
     void setAutoSaveFile(const std::string& file) {
-      autoSaveFile.reset(new std::string(file));
+      autoSaver.reset(new AutoSaver(file));
     }
+    /// write the most recent history state to the autosave file, if
+    /// set. The file is written on a background thread.
+    void autoSave() {
+      if (autoSaver)
+        try
+          {
+            autoSaver->save(history.snapshot());
+          }
+        catch (...)
+          { // unable to autosave
+            autoSaver.reset();
+            throw std::runtime_error("Unable to autosave to this location");
+          }
+    }
+    /// wait for any autosave in progress to be written
+    void waitForAutoSave() {if (autoSaver) autoSaver->flush();}
     
     /// flag to indicate whether a TCL should be pushed onto the
     /// history stack, or logged in a recording. This is used to avoid
@@ -354,6 +370,17 @@ namespace minsky
           if (auto v=canvas.item->variableCast())
             v->importFromCSV(filename, *spec->memberptr);
     }
+
+    /// as loadVariableFromCSV, but only importing rows appended to
+    /// the file since it was last loaded
+    void appendVariableFromCSV(const std::string& specVar, const std::string& filename)
+    {
+      auto i=TCL_obj_properties().find(specVar);
+      if (i!=TCL_obj_properties().end())
+        if (auto spec=dynamic_cast<member_entry<DataSpec>*>(i->second.get()))
+          if (auto v=canvas.item->variableCast())
+            v->appendFromCSV(filename, *spec->memberptr);
+    }
     
     /// load from a file
     void load(const std::string& filename) {
@@ -419,9 +446,10 @@ namespace minsky
     void runItemDeletedCallback(const Item& item) override
     {tclcmd()<<item.deleteCallback<<'\n';}
     
-    bool checkMemAllocation(size_t bytes) const override {
+    bool checkMemAllocation(size_t bytes, size_t mappedBytes=0) const override {
       bool r=true;
-      if (ecolab::mainWin && bytes>0.2*physicalMem())
+      // mapped bytes are paged in and out as needed
+      if (ecolab::mainWin && bytes>mappedBytes && bytes-mappedBytes>0.2*physicalMem())
         {
           tclcmd cmd;
           cmd<<"tk_messageBox -message {Allocation will use more than 50% of available memory. Do you want to proceed?} -type yesno\n";
@@ -434,6 +462,7 @@ namespace minsky
     OperationType::Group classifyOp(OperationType::Type o) const {return OperationType::classify(o);}
   private:
     std::unique_ptr<char[]> _defaultFont;
+    std::unique_ptr<AutoSaver> autoSaver;
 
   };
 }
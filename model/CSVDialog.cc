@@ -43,6 +43,7 @@
 #include <string>                                                                
 #include <stdexcept>                                                                                                                         
 #include <sstream>      
+#include <iomanip>
 
 using namespace std;
 using namespace minsky;
@@ -61,6 +62,33 @@ void CSVDialog::reportFromFile(const std::string& input, const std::string& outp
   reportFromCSVFile(is,of,spec);
 }
 
+namespace
+{
+  string formatBytes(size_t bytes)
+  {
+    const char* units[]={"B","KB","MB","GB","TB","PB","EB"};
+    double b=bytes;
+    size_t i=0;
+    for (; b>=1024 && i<sizeof(units)/sizeof(units[0])-1; ++i) b/=1024;
+    ostringstream r;
+    r<<setprecision(3)<<b<<units[i];
+    return r.str();
+  }
+}
+
+std::string CSVDialog::preflight()
+{
+  sizing=preflightCSVFile(url.find("://")==string::npos? url: loadWebFile(url), spec);
+  ostringstream r;
+  for (size_t i=0; i<sizing.dims.size(); ++i)
+    r<<(i? "x": "")<<sizing.dims[i];
+  r<<" hypercube, "<<sizing.numCells<<" data cells: "<<(sizing.dense()? "dense": "sparse")
+   <<" layout needs "<<formatBytes(sizing.bytes())
+   <<" ("<<(sizing.dense()? "sparse ": "dense ")
+   <<formatBytes(std::max(sizing.denseBytes(), sizing.sparseBytes()))<<")";
+  return r.str();
+}
+
 namespace
 {
   // manage temporary files
@@ -55,6 +55,14 @@ namespace minsky
     /// web. Result is cached for 5 minutes.
     std::string loadWebFile(const std::string& url); 
     void reportFromFile(const std::string& input, const std::string& output);
+    /// result of the most recent preflight
+    CSVSizing sizing;
+    /// state of the last import, for appending rows subsequently added to the file
+    classdesc::Exclude<CSVImportState> importState;
+    /// size the import of \a url according to spec, prior to
+    /// loading. Returns a description of the tensor shape and memory
+    /// required.
+    std::string preflight();
     void requestRedraw() {if (surface.get()) surface->requestRedraw();}
     /// return column mouse is over
     size_t columnOver(double x);
@@ -0,0 +1,107 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "autoSaver.h"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace minsky
+{
+  AutoSaver::AutoSaver(const string& fileName): m_fileName(fileName)
+  {
+    writer=boost::thread([this]() {run();});
+  }
+
+  AutoSaver::~AutoSaver()
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(mutex);
+      stop=true;
+    }
+    cond.notify_all();
+    writer.join();
+  }
+
+  void AutoSaver::save(UndoHistory::Snapshot&& snapshot)
+  {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    if (!errMsg.empty())
+      {
+        string msg;
+        msg.swap(errMsg);
+        throw runtime_error(msg);
+      }
+    pending.reset(new UndoHistory::Snapshot(move(snapshot)));
+    cond.notify_all();
+  }
+
+  void AutoSaver::flush()
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (pending || writing)
+      cond.wait(lock);
+    if (!errMsg.empty())
+      {
+        string msg;
+        msg.swap(errMsg);
+        throw runtime_error(msg);
+      }
+  }
+
+  void AutoSaver::run()
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    for (;;)
+      {
+        while (!pending && !stop)
+          cond.wait(lock);
+        if (!pending) return; // stopped, with nothing left to write
+        unique_ptr<UndoHistory::Snapshot> snapshot;
+        snapshot.swap(pending);
+        writing=true;
+        lock.unlock();
+        string err;
+        try
+          {
+            // write to a temporary, then rename, so that an
+            // interrupted write doesn't destroy the previous save
+            string tmpName=m_fileName+".tmp";
+            {
+              ofstream f(tmpName);
+              snapshot->save(f);
+              f.close(); // flush, so that write errors are detected
+              if (!f)
+                throw runtime_error("cannot write to "+tmpName);
+            }
+            boost::filesystem::rename(tmpName, m_fileName);
+          }
+        catch (const std::exception& ex)
+          {
+            err=ex.what();
+          }
+        lock.lock();
+        writing=false;
+        if (!err.empty()) errMsg=err;
+        cond.notify_all();
+      }
+  }
+}
@@ -0,0 +1,60 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUTOSAVER_H
+#define AUTOSAVER_H
+
+#include "undoHistory.h"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <memory>
+#include <string>
+
+namespace minsky
+{
+  /// Writes snapshots of a model to a file on a background thread,
+  /// via a temporary file that is renamed over the previous save, so
+  /// that the file is always complete. Snapshots requested whilst a
+  /// write is in progress are coalesced, so only the latest is written.
+  class AutoSaver
+  {
+    std::string m_fileName;
+    std::unique_ptr<UndoHistory::Snapshot> pending;
+    bool writing=false, stop=false;
+    std::string errMsg; ///< error reported by the writer thread
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    boost::thread writer;
+    void run();
+  public:
+    explicit AutoSaver(const std::string& fileName);
+    /// writes any pending snapshot before returning
+    ~AutoSaver();
+    const std::string& fileName() const {return m_fileName;}
+    /// queue \a snapshot to be written, replacing any snapshot not yet started
+    /// @throw if a previous write failed
+    void save(UndoHistory::Snapshot&& snapshot);
+    /// wait until all queued snapshots are written
+    /// @throw if a write failed
+    void flush();
+  };
+}
+
+#endif
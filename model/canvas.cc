@@ -664,6 +664,9 @@ namespace minsky
                     
           }
         setItemFocus(model->addItem(newItem));
+        // a cloned Godley table's variables are created in its new group
+        if (auto godley=dynamic_cast<GodleyIcon*>(newItem.get()))
+          godley->update();
         model->normaliseGroupRefs(model);
       }
   }
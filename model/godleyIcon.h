@@ -106,12 +106,16 @@ namespace minsky
     /// updates the variable lists with the Godley table
     void update();
     
+    /// the clone has no variables until update() is called, once it
+    /// has been added to a group, so that its variables are created
+    /// in that group, rather than this's
     GodleyIcon* clone() const override {
-      auto r=new GodleyIcon(*this);  
-	  r->update();       
-	  r->group.reset();
-	  return r;
-    }      
+      auto r=new GodleyIcon(*this);
+      r->m_flowVars.clear();
+      r->m_stockVars.clear();
+      r->group.reset();
+      return r;
+    }
 
     /// returns the variable if point (x,y) is within a
     /// variable icon, null otherwise, indicating that the Godley table
@@ -22,6 +22,8 @@
 #include "wire.h"
 #include "operation.h"
 #include "minsky.h"
+#include "godleyIcon.h"
+#include "ravelWrap.h"
 #include <cairo_base.h>
 #include "minsky_epilogue.h"
 using namespace std;
@@ -34,18 +36,171 @@ namespace minsky
 {
   SVGRenderer Group::svgRenderer;
 
-  // assigned the cloned equivalent of a port
-  void asgClonedPort(shared_ptr<Port>& p, const map<Item*,ItemPtr>& cloneMap)
+  namespace
   {
-    auto clone=cloneMap.find(&p->item());
-    auto& oports=p->item().ports;
-    if (clone!=cloneMap.end())
-      {
-        auto opIt=find(oports.begin(), oports.end(), p);
-        assert(opIt != oports.end());
-        // set the new port to have the equivalent position in the clone
-        p=clone->second->ports[opIt-oports.begin()];
-      }
+    /// state of a deep copy, shared between the levels of the group
+    /// heirarchy, as wires may connect items at different levels
+    struct GroupCopier
+    {
+      map<const Item*,ItemPtr> cloneMap;
+      map<const RavelLockGroup*,shared_ptr<RavelLockGroup>> lockGroups;
+      /// wires to be copied once all items are, with their destination
+      vector<pair<const Wire*,Group*>> wires;
+
+      void copyItems(const GroupItems& src, Group& dest);
+      /// copy attributes and contents of \a src into \a dest
+      void copyGroup(const Group& src, Group& dest);
+      void copyWires();
+      /// the cloned equivalent of \a p, or null if its item is not cloned
+      shared_ptr<Port> clonedPort(const shared_ptr<Port>& p) const;
+    };
+
+    void copyTensorInit(const VariableBase& from, const VariableBase& to)
+    {
+      // variables moved into a new scope have a new value
+      auto fromVal=from.vValue(), toVal=to.vValue();
+      if (fromVal && toVal && fromVal!=toVal && fromVal->tensorInit.rank()>0)
+        {
+          toVal->tensorInit=fromVal->tensorInit;
+          toVal->hypercube(toVal->tensorInit.hypercube());
+        }
+    }
+    
+    void GroupCopier::copyItems(const GroupItems& src, Group& dest)
+    {
+      set<const Item*> srcItems;
+      for (auto& i: src.items) srcItems.insert(i.get());
+      map<const IntOp*,bool> integrals;
+      for (auto& i: src.items)
+        {
+          if (auto v=i->variableCast())
+            {
+              auto controller=v->controller.lock();
+              // Godley table variables are recreated by the cloned table
+              if (dynamic_cast<GodleyIcon*>(controller.get()) && srcItems.count(controller.get()))
+                continue;
+            }
+          if (auto integ=dynamic_cast<const IntOp*>(i.get()))
+            integrals.emplace(integ, integ->coupled());
+          auto clone=cloneMap[i.get()]=dest.addItem(i->clone());
+          if (auto v=i->variableCast())
+            copyTensorInit(*v, *clone->variableCast());
+          if (auto godley=dynamic_cast<const GodleyIcon*>(i.get()))
+            if (auto clonedGodley=dynamic_cast<GodleyIcon*>(clone.get()))
+              {
+                // create the clone's table variables in dest
+                clonedGodley->update();
+                // match table variables by name, so that wires attached to them are copied
+                map<string,VariablePtr> clonedVars;
+                for (auto& v: clonedGodley->flowVars()) clonedVars[v->name()]=v;
+                for (auto& v: clonedGodley->stockVars()) clonedVars[v->name()]=v;
+                for (auto vars: {&godley->flowVars(), &godley->stockVars()})
+                  for (auto& v: *vars)
+                    {
+                      auto c=clonedVars.find(v->name());
+                      if (c!=clonedVars.end())
+                        cloneMap[v.get()]=c->second;
+                    }
+              }
+          if (auto ravel=dynamic_cast<const Ravel*>(i.get()))
+            if (ravel->lockGroup)
+              if (auto clonedRavel=dynamic_pointer_cast<Ravel>(clone))
+                {
+                  auto& lockGroup=lockGroups[ravel->lockGroup.get()];
+                  if (!lockGroup) lockGroup=make_shared<RavelLockGroup>();
+                  clonedRavel->lockGroup=lockGroup;
+                  lockGroup->ravels.push_back(clonedRavel);
+                }
+        }
+
+      for (auto& i: src.groups)
+        {
+          auto g=make_shared<Group>();
+          g->self=g;
+          cloneMap[i.get()]=dest.addGroup(g);
+          copyGroup(*i,*g);
+        }
+      
+      for (auto& w: src.wires)
+        wires.emplace_back(w.get(), &dest);
+
+      // reattach integral variables to their cloned counterparts
+      for (auto i: integrals)
+        if (auto newIntegral=dynamic_cast<IntOp*>(cloneMap[i.first].get()))
+          {
+            auto intVar=cloneMap.find(i.first->intVar.get());
+            auto newIntVar=intVar!=cloneMap.end()?
+              dynamic_pointer_cast<VariableBase>(intVar->second): VariablePtr();
+            if (newIntVar && newIntegral->intVar != newIntVar)
+              {
+                dest.removeItem(*newIntegral->intVar);
+                newIntegral->intVar=newIntVar;
+              }
+            if (i.second != newIntegral->coupled())
+              newIntegral->toggleCoupled();
+          }
+    }
+
+    void GroupCopier::copyGroup(const Group& src, Group& dest)
+    {
+      dest.detailedText=src.detailedText;
+      dest.tooltip=src.tooltip;
+      dest.m_x=src.m_x;
+      dest.m_y=src.m_y;
+      dest.m_sf=src.m_sf;
+      dest.rotation(src.rotation());
+      dest.iWidth(src.iWidth());
+      dest.iHeight(src.iHeight());
+      dest.title=src.title;
+      dest.bookmarks=src.bookmarks;
+      copyItems(src, dest);
+      
+      for (auto& v: src.inVariables)
+        {
+          assert(cloneMap.count(v.get()));
+          dest.inVariables.push_back(dynamic_pointer_cast<VariableBase>(cloneMap[v.get()]));
+          dest.inVariables.back()->controller=dest.self;
+        }
+      for (auto& v: src.outVariables)
+        {
+          assert(cloneMap.count(v.get()));
+          dest.outVariables.push_back(dynamic_pointer_cast<VariableBase>(cloneMap[v.get()]));
+          dest.outVariables.back()->controller=dest.self;
+        }
+      if (src.displayPlot)
+        {
+          auto plot=cloneMap.find(src.displayPlot.get());
+          if (plot!=cloneMap.end())
+            dest.displayPlot=dynamic_pointer_cast<PlotWidget>(plot->second);
+        }
+      dest.computeRelZoom();
+    }
+
+    shared_ptr<Port> GroupCopier::clonedPort(const shared_ptr<Port>& p) const
+    {
+      auto clone=cloneMap.find(&p->item());
+      if (clone==cloneMap.end()) return nullptr;
+      // set the new port to have the equivalent position in the clone
+      auto& oports=p->item().ports;
+      auto opIt=find(oports.begin(), oports.end(), p);
+      assert(opIt != oports.end());
+      size_t i=opIt-oports.begin();
+      return i<clone->second->ports.size()? clone->second->ports[i]: nullptr;
+    }
+    
+    void GroupCopier::copyWires()
+    {
+      for (auto& w: wires)
+        {
+          auto from=clonedPort(w.first->from()), to=clonedPort(w.first->to());
+          if (from && to)
+            {
+              auto newWire=w.second->addWire(new Wire(from,to,w.first->coords()));
+              newWire->detailedText=w.first->detailedText;
+              newWire->tooltip=w.first->tooltip;
+            }
+        }
+    }
   }
 
   GroupPtr Group::copy() const
@@ -57,56 +212,22 @@ namespace minsky
       g->addGroup(r);
     else
       return GroupPtr(); // do nothing if we attempt to clone the entire model
-    
-    // a map of original to cloned items (weak references)
-    map<Item*,ItemPtr> cloneMap;
-    map<IntOp*,bool> integrals;
-    for (auto& i: items)
-      if (auto integ=dynamic_cast<IntOp*>(i.get()))
-        integrals.emplace(integ, integ->coupled());
-    for (auto& i: items)
-      cloneMap[i.get()]=r->addItem(i->clone());
-    for (auto& i: groups)
-      cloneMap[i.get()]=r->addGroup(i->copy());
-    for (auto& w: wires) 
-      {
-        auto f=w->from(), t=w->to();
-        asgClonedPort(f,cloneMap);
-        asgClonedPort(t,cloneMap);
-        r->addWire(new Wire(f,t,w->coords()));
-      }
-  
-    for (auto& v: inVariables)
-      {
-        assert(cloneMap.count(v.get()));
-        r->inVariables.push_back(dynamic_pointer_cast<VariableBase>(cloneMap[v.get()]));
-        r->inVariables.back()->controller=self;
-      }
-    for (auto& v: outVariables)
-      {
-        assert(cloneMap.count(v.get()));
-        r->outVariables.push_back(dynamic_pointer_cast<VariableBase>(cloneMap[v.get()]));
-        r->outVariables.back()->controller=self;
-      }
-    // reattach integral variables to their cloned counterparts
-    for (auto i: integrals)
-      {
-        if (auto newIntegral=dynamic_cast<IntOp*>(cloneMap[i.first].get()))
-          {
-            auto newIntVar=dynamic_pointer_cast<VariableBase>(cloneMap[i.first->intVar.get()]);
-            if (newIntVar && newIntegral->intVar != newIntVar)
-              {
-                r->removeItem(*newIntegral->intVar);
-                newIntegral->intVar=newIntVar;
-              }
-            if (i.second != newIntegral->coupled())
-              newIntegral->toggleCoupled();
-          }
-      }
-    r->computeRelZoom();
+
+    GroupCopier copier;
+    copier.copyGroup(*this, *r);
+    copier.copyWires();
     return r;
   }
 
+  void Group::copyContentsInto(Group& dest, map<const Item*,ItemPtr>* cloneMap) const
+  {
+    GroupCopier copier;
+    copier.copyItems(*this, dest);
+    copier.copyWires();
+    if (cloneMap)
+      cloneMap->swap(copier.cloneMap);
+  }
+
   ItemPtr Group::removeItem(const Item& it)
   {
     for (auto i=items.begin(); i!=items.end(); ++i)
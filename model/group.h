@@ -194,6 +194,11 @@ namespace minsky
     bool nocycles() const override; 
 
     GroupPtr copy() const;
+    /// copy the items, groups and wires of this into \a dest, cloning
+    /// them directly rather than via the schema. Wires connected to
+    /// items not copied are omitted. If \a cloneMap is not null, it
+    /// receives the clone of each item copied.
+    void copyContentsInto(Group& dest, std::map<const Item*,ItemPtr>* cloneMap=nullptr) const;
     Group* clone() const override {throw error("Groups cannot be cloned");}
     static SVGRenderer svgRenderer;
 
@@ -20,6 +20,8 @@
 #include "classdesc_access.h"
 #include "minsky.h"
 #include "flowCoef.h"
+#include "equationCache.h"
+#include "mappedTensor.h"
 
 #include "TCL_obj_stl.h"
 #include <gsl/gsl_errno.h>
@@ -32,16 +34,17 @@
 //#include <thread>
 // std::thread apparently not supported on MXE for now...
 #include <boost/thread.hpp>
+#include <boost/filesystem.hpp>
 using namespace std;
 
 using namespace minsky;
 using namespace classdesc;
 using namespace boost::posix_time;
 
+const char* minsky::schemaURL="http://minsky.sf.net/minsky";
+
 namespace
 {
-  const char* schemaURL="http://minsky.sf.net/minsky";
-
   inline bool isFinite(const double y[], size_t n)
   {
     for (size_t i=0; i<n; ++i)
@@ -172,25 +175,151 @@ namespace minsky
   
   void Minsky::openLogFile(const string& name)
   {
-    outputDataFile.reset(new ofstream(name));
-    *outputDataFile<< "#time";
+    dataLogger.reset();
+    logValueIds.clear();
     for (auto& v: variableValues)
       if (logVarList.count(v.first))
-        *outputDataFile<<" "<<v.second->name;
-    *outputDataFile<<endl;
+        logValueIds.push_back(v.first);
+    dataLogger.reset(new DataLogger(name, logColumns(), binaryLog? DataLogger::binary: DataLogger::text));
   }
 
-  /// write current state of all variables to the log file
-  void Minsky::logVariables() const
+  vector<DataLogger::Column> Minsky::logColumns() const
   {
-    if (outputDataFile)
+    vector<DataLogger::Column> r;
+    for (auto& i: logValueIds)
       {
-        *outputDataFile<<t;
-        for (auto& v: variableValues)
-          if (logVarList.count(v.first))
-            *outputDataFile<<" "<<v.second->value();
-        *outputDataFile<<endl;
+        auto v=variableValues.find(i);
+        if (v!=variableValues.end())
+          r.emplace_back(v->second->name, v->second->isFlowVar(), v->second->idx());
+        else
+          r.emplace_back(VariableValue::uqName(i));
       }
+    return r;
+  }
+
+  vector<TimeSeriesStore::Column> Minsky::timeSeriesColumns() const
+  {
+    vector<TimeSeriesStore::Column> r;
+    for (auto& v: variableValues)
+      if (timeSeriesVarList.empty()?
+          (v.second->size()==1 && v.second->idx()>=0 && !v.second->temp() &&
+           v.second->type()!=VariableType::constant):
+          timeSeriesVarList.count(v.first)>0)
+        r.emplace_back(v.first, v.second->isFlowVar(), v.second->idx());
+    return r;
+  }
+
+  vector<string> Minsky::timeSeriesNames() const
+  {
+    vector<string> r;
+    for (auto& c: timeSeries.columns())
+      r.push_back(c.name);
+    return r;
+  }
+
+  vector<double> Minsky::timeSeriesQuery(const string& valueId, double t0, double t1, unsigned maxPoints) const
+  {
+    int col=timeSeries.column(valueId);
+    if (col<0)
+      throw error("%s not recorded",valueId.c_str());
+    vector<double> t, y, r;
+    timeSeries.query(col, t0, t1, maxPoints, t, y);
+    r.reserve(2*t.size());
+    for (size_t i=0; i<t.size(); ++i)
+      {
+        r.push_back(t[i]);
+        r.push_back(y[i]);
+      }
+    return r;
+  }
+
+  namespace
+  {
+    /// recorded columns of \a store, indexed by variable location
+    map<pair<bool,int>,int> recordedColumns(const TimeSeriesStore& store)
+    {
+      map<pair<bool,int>,int> r;
+      for (size_t i=0; i<store.columns().size(); ++i)
+        {
+          auto& c=store.columns()[i];
+          r[make_pair(c.flow,c.idx)]=i;
+        }
+      return r;
+    }
+
+    /// true if \a p plots against time, having no x variables connected
+    bool againstTime(const PlotWidget& p)
+    {
+      for (auto& x: p.xvars)
+        if (x) return false;
+      return true;
+    }
+
+    /// columns recorded for the pens of \a p, if it plots against
+    /// time, and all its pens are recorded, otherwise empty
+    vector<int> recordedPens(const PlotWidget& p, const map<pair<bool,int>,int>& columnOf)
+    {
+      vector<int> r;
+      if (!againstTime(p)) return r;
+      for (auto& v: p.yvars)
+        if (v)
+          {
+            auto c=columnOf.find(make_pair(v->isFlowVar(), v->idx()));
+            if (c==columnOf.end()) return {};
+            r.push_back(c->second);
+          }
+      return r;
+    }
+  }
+
+  void Minsky::plotTimeSeries(double t0, double t1, unsigned maxPoints)
+  {
+    auto columnOf=recordedColumns(timeSeries);
+    
+    model->recursiveDo
+      (&Group::items,
+       [&](Items&, Items::iterator i)
+       {
+         auto p=dynamic_cast<PlotWidget*>(i->get());
+         if (!p || !againstTime(*p)) return false;
+         vector<double> t, y;
+         bool replotted=false;
+         for (size_t pen=0; pen<p->yvars.size(); ++pen)
+           if (auto& v=p->yvars[pen])
+             {
+               auto c=columnOf.find(make_pair(v->isFlowVar(), v->idx()));
+               if (c==columnOf.end()) continue;
+               if (!replotted)
+                 {
+                   p->clear();
+                   replotted=true;
+                 }
+               if (maxPoints)
+                 {
+                   timeSeries.query(c->second, t0, t1, maxPoints, t, y);
+                   for (size_t j=0; j<t.size(); ++j)
+                     p->addPt(pen, t[j], y[j]);
+                 }
+               else // plot directly from the store, without copying
+                 timeSeries.visit
+                   (c->second, t0, t1, [&](const double* ct, const double* cy, size_t n)
+                    {
+                      for (size_t j=0; j<n; ++j)
+                        if (ct[j]>=t0 && ct[j]<=t1)
+                          p->addPt(pen, ct[j], cy[j]);
+                    });
+             }
+         if (replotted)
+           p->requestRedraw();
+         return false;
+       });
+  }
+
+  /// write current state of all variables to the log file
+  void Minsky::logVariables() const
+  {
+    if (dataLogger)
+      dataLogger->log(t, stockVars, flowVars);
   }        
         
       
@@ -201,6 +330,8 @@ namespace minsky
     equations.clear();
     integrals.clear();
     variableValues.clear();
+    clipboardCopy.reset(); // its variables refer to the previous model
+    clipboardValues.clear();
     
     flowVars.clear();
     stockVars.clear();
@@ -249,15 +380,45 @@ namespace minsky
 
   void Minsky::copy() const
   {
+    clipboardCopy.reset();
+    clipboardValues.clear();
+    clipboardText.clear();
     if (canvas.selection.empty())
       putClipboard(""); // clear clipboard
     else
       {
+        // The XML is needed regardless of the clone, as the clipboard
+        // may be pasted into another instance, and tells paste()
+        // whether it still holds this copy.
         schema3::Minsky m(canvas.selection);
         ostringstream os;
         xml_pack_t packer(os, schemaURL);
         xml_pack(packer, "Minsky", m);
-        putClipboard(os.str());
+        clipboardText=os.str();
+        putClipboard(clipboardText);
+
+        // values created for the clone's variables as they are added
+        // to it are moved into clipboardValues
+        set<string> existingValues;
+        for (auto& i: variableValues)
+          existingValues.insert(i.first);
+        clipboardCopy.reset(new Group);
+        clipboardCopy->self=clipboardCopy;
+        canvas.selection.copyContentsInto(*clipboardCopy);
+        clipboardCopy->recursiveDo(&Group::items,
+                                   [&](Items&,Items::iterator i) {
+                                     if (auto v=(*i)->variableCast())
+                                       if (auto val=v->vValue())
+                                         clipboardValues[v]=
+                                           ClipboardValue{val->init, val->units.str(), val->tensorInit};
+                                     return false;
+                                   });
+        auto& values=minsky().variableValues;
+        for (auto i=values.begin(); i!=values.end(); )
+          if (existingValues.count(i->first))
+            ++i;
+          else
+            values.erase(i++);
       }
   }
 
@@ -282,12 +443,36 @@ namespace minsky
 
   void Minsky::paste()
   {
-    istringstream is(getClipboard());
-    xml_unpack_t unpacker(is);
-    schema3::Minsky m(unpacker);
     GroupPtr g(new Group);
     g->self=g;
-    m.populateGroup(*g);
+    auto clipboard=getClipboard();
+    if (clipboardCopy && clipboard==clipboardText)
+      {
+        map<const Item*,ItemPtr> cloneMap;
+        clipboardCopy->copyContentsInto(*g, &cloneMap);
+        // recreate values of the pasted variables, as populateGroup does
+        for (auto& i: cloneMap)
+          if (auto v=i.second->variableCast())
+            {
+              auto value=clipboardValues.find(i.first->variableCast());
+              if (value==clipboardValues.end()) continue;
+              v->init(value->second.init);
+              v->setUnits(value->second.units);
+              if (value->second.tensorInit.rank())
+                if (auto val=v->vValue())
+                  {
+                    val->tensorInit=value->second.tensorInit;
+                    val->hypercube(val->tensorInit.hypercube());
+                  }
+            }
+      }
+    else
+      {
+        istringstream is(clipboard);
+        xml_unpack_t unpacker(is);
+        schema3::Minsky m(unpacker);
+        m.populateGroup(*g);
+      }
     // Default pasting no longer occurs as grouped items or as a group within a group. Fix for tickets 1080/1098    
     canvas.selection.clear();    
 
@@ -363,19 +548,50 @@ namespace minsky
       if (strcmp(bom,"\357\273\277")==0) return; //skipped BOM
       s.seekg(0); //rewind input stream
     }
+
+    /// read a schema from \a inf, streaming it if of the current
+    /// schema, otherwise converting from an older schema
+    void readSchema(istream& inf, schema3::Minsky& schema)
+    {
+      auto start=inf.tellg();
+      if (schema3::streamLoad(inf, schema)) return;
+      inf.clear();
+      inf.seekg(start);
+      xml_unpack_t saveFile(inf);
+      schema=schema3::Minsky(saveFile);
+    }
+
+    /// read a model file of either format, tensor data of binary
+    /// files being placed in \a tensors
+    /// @return true if the file was binary
+    bool readModelFile(const string& filename, schema3::Minsky& schema,
+                       schema3::TensorPayloads& tensors)
+    {
+      {
+        ifstream inf(filename, ios::binary);
+        if (!inf)
+          throw runtime_error("failed to open "+filename);
+        if (schema3::isBinaryModel(inf))
+          {
+            schema3::readBinary(inf, schema, tensors);
+            return true;
+          }
+      }
+      ifstream inf(filename);
+      stripByteOrderingMarker(inf);
+      readSchema(inf, schema);
+      return false;
+    }
   }
 
   void Minsky::insertGroupFromFile(const char* file)
   {
-    ifstream inf(file);
-    if (!inf)
-      throw runtime_error(string("failed to open ")+file);
-    stripByteOrderingMarker(inf);
-    xml_unpack_t saveFile(inf);
-    schema3::Minsky currentSchema(saveFile);
+    schema3::Minsky currentSchema;
+    schema3::TensorPayloads tensors;
+    readModelFile(file, currentSchema, tensors);
 
     GroupPtr g(new Group);
-    currentSchema.populateGroup(*model->addGroup(g));
+    currentSchema.populateGroup(*model->addGroup(g), tensors);
     g->resizeOnContents();
     canvas.itemFocus=g;
   }
@@ -451,7 +667,14 @@ namespace minsky
     garbageCollect();
     equations.clear();
     integrals.clear();
+    // the previous equations' tensor operations have been released,
+    // so their arena is released once replaced. Size the new one to
+    // hold what they used.
+    tensorArena=new TensorArena
+      (tensorArena? tensorArena->highWater(): TensorArena::defaultSlabSize);
+    EvalOpBase::timeUnit=timeUnit;
 
+    // unit errors are reported whether or not the equations are cached
     try
       {
         dimensionalAnalysis();
@@ -461,13 +684,23 @@ namespace minsky
         // do not block reset() on dimensional analysis failure
         message(ex.what());
       }
+
+    string cacheFile;
+    if (!equationCacheDir.empty())
+      cacheFile=EquationCache::fileName(*this, equationCacheDir);
     
-    EvalOpBase::timeUnit=timeUnit;
+    if (!cacheFile.empty() && EquationCache::restore(*this, cacheFile))
+      ++equationCacheHits;
+    else
+      {
+        MathDAG::SystemOfEquations system(*this);
+        assert(variableValues.validEntries());
+        system.populateEvalOpVector(equations, integrals);
+        assert(variableValues.validEntries());
 
-    MathDAG::SystemOfEquations system(*this);
-    assert(variableValues.validEntries());
-    system.populateEvalOpVector(equations, integrals);
-    assert(variableValues.validEntries());
+        if (!cacheFile.empty())
+          EquationCache::store(*this, cacheFile);
+      }
     
     // attach the plots
     model->recursiveDo
@@ -806,6 +1039,7 @@ namespace minsky
 
   void Minsky::reset()
   {
+    stopFreeRun();
     // do not reset while simulation is running
     if (RKThreadRunning)
       {
@@ -817,6 +1051,16 @@ namespace minsky
     BusyCursor busy(*this);
     EvalOpBase::t=t=t0;
     constructEquations();
+    equationsTimestamp=canvas.model.timestamp;
+    // variables may have moved in the stock/flow vectors
+    if (dataLogger)
+      dataLogger->remap(logColumns());
+    // start a new history
+    timeSeries.maxRecords=timeSeriesMaxRecords;
+    if (recordTimeSeries)
+      timeSeries.setColumns(timeSeriesColumns());
+    else
+      timeSeries.setColumns({});
     // if no stock variables in system, add a dummy stock variable to
     // make the simulation proceed
     if (stockVars.empty()) stockVars.resize(1,0);
@@ -834,6 +1078,7 @@ namespace minsky
       
     // update flow variable
     evalEquations();
+    recordTimeSeriesPoint();
     
     model->recursiveDo
       (&Group::items,
@@ -872,6 +1117,11 @@ namespace minsky
 
   void Minsky::step()
   {
+    if (freeRunning())
+      {
+        pollFreeRun();
+        return;
+      }
     if (reset_flag())
       reset();
     running=true;
@@ -885,24 +1135,7 @@ namespace minsky
       try
         { 
           double tp=reverse? -t: t;
-          if (ode)
-            {
-              gsl_odeiv2_driver_set_nmax(ode->driver, nSteps);
-              // we need to update Minsky's t synchronously to support the t operator
-              // potentially means t and stockVars out of sync on GUI, but should still be thread safe
-              err=gsl_odeiv2_driver_apply(ode->driver, &tp, numeric_limits<double>::max(), 
-                                          &stockVarsCopy[0]);
-            }
-          else // do explicit Euler method
-            {
-              vector<double> d(stockVarsCopy.size());
-              for (int i=0; i<nSteps; ++i, tp+=stepMax)
-                {
-                  evalEquations(&d[0], tp, &stockVarsCopy[0]);
-                  for (size_t j=0; j<d.size(); ++j)
-                    stockVarsCopy[j]+=d[j];
-                }
-            }
+          err=rkStep(stockVarsCopy, tp);
           t=reverse? -tp:tp;
         }
       catch (const std::exception& ex)
@@ -939,17 +1172,7 @@ namespace minsky
         return;
       }
 
-    switch (err)
-      {
-      case GSL_SUCCESS: case GSL_EMAXITER: break;
-      case GSL_FAILURE:
-        throw error("unspecified error GSL_FAILURE returned");
-      case GSL_EBADFUNC: 
-        gsl_odeiv2_driver_reset(ode->driver);
-        throw error("Invalid arithmetic operation detected");
-      default:
-        throw error("gsl error: %s",gsl_strerror(err));
-      }
+    checkRKerror(err);
 
     stockVars.swap(stockVarsCopy);
 
@@ -957,6 +1180,7 @@ namespace minsky
     evalEquations();
 
     logVariables();
+    recordTimeSeriesPoint();
 
     model->recursiveDo
       (&Group::items, 
@@ -973,6 +1197,257 @@ namespace minsky
 
   }
 
+  int Minsky::rkStep(vector<double>& stocks, double& tp)
+  {
+    int err=GSL_SUCCESS;
+    if (ode)
+      {
+        gsl_odeiv2_driver_set_nmax(ode->driver, nSteps);
+        err=gsl_odeiv2_driver_apply(ode->driver, &tp, numeric_limits<double>::max(), 
+                                    &stocks[0]);
+      }
+    else // do explicit Euler method
+      {
+        vector<double> d(stocks.size());
+        for (int i=0; i<nSteps; ++i, tp+=stepMax)
+          {
+            evalEquations(&d[0], tp, &stocks[0]);
+            for (size_t j=0; j<d.size(); ++j)
+              stocks[j]+=d[j];
+          }
+      }
+    return err;
+  }
+
+  void Minsky::checkRKerror(int err)
+  {
+    switch (err)
+      {
+      case GSL_SUCCESS: case GSL_EMAXITER: break;
+      case GSL_FAILURE:
+        throw error("unspecified error GSL_FAILURE returned");
+      case GSL_EBADFUNC: 
+        gsl_odeiv2_driver_reset(ode->driver);
+        throw error("Invalid arithmetic operation detected");
+      default:
+        throw error("gsl error: %s",gsl_strerror(err));
+      }
+  }
+
+  void Minsky::startFreeRun(double tmax)
+  {
+    if (freeRunning()) return;
+    if (reset_flag())
+      reset();
+    running=true;
+
+    // publish the values of everything plotted, displayed in a sheet or logged
+    set<FrameSlice> slices;
+    auto addSlice=[&](const VariableValue& v) {
+      if (v.idx()>=0 && v.type()!=VariableType::undefined)
+        slices.insert(FrameSlice{v.isFlowVar(), size_t(v.idx()), v.size()});
+    };
+    model->recursiveDo
+      (&Group::items,
+       [&](Items&, Items::iterator i)
+       {
+         if (auto p=dynamic_cast<PlotWidget*>(i->get()))
+           {
+             for (auto& v: p->yvars) if (v) addSlice(*v);
+             for (auto& v: p->xvars) if (v) addSlice(*v);
+           }
+         else if (auto s=dynamic_cast<Sheet*>(i->get()))
+           if (auto v=s->ports[0]->getVariableValue())
+             addSlice(*v);
+         return false;
+       });
+    for (auto& v: variableValues)
+      if (logVarList.count(v.first))
+        addSlice(*v.second);
+    if (recordTimeSeries)
+      for (auto& c: timeSeries.columns())
+        if (c.idx>=0)
+          slices.insert(FrameSlice{c.flow, size_t(c.idx), 1});
+    frameSlices.assign(slices.begin(), slices.end());
+
+    parameterSlices.clear();
+    freeRunParameters.clear();
+    for (auto& v: variableValues)
+      if (v.second->type()==VariableType::parameter && v.second->idx()>=0)
+        {
+          parameterSlices.push_back(FrameSlice{true, size_t(v.second->idx()), v.second->size()});
+          freeRunParameters.insert(freeRunParameters.end(), flowVars.begin()+v.second->idx(),
+                                   flowVars.begin()+v.second->idx()+v.second->size());
+        }
+    freeRunParameterUpdates.clear();
+    freeRunParametersChanged=false;
+
+    size_t width=1;
+    for (auto& s: frameSlices) width+=s.size;
+    frames.reset(new FrameRing(width, freeRunBufferFrames));
+
+    // the solver works on private copies of the state, so the GUI
+    // thread may update stockVars and flowVars from published frames
+    freeRunStocks=stockVars;
+    freeRunFlows=flowVars;
+    freeRunT=reverse? -t: t;
+    freeRunTMax=tmax;
+    freeRunStop=false;
+    freeRunExited=false;
+    threadErrMsg.clear();
+    RKThreadRunning=true;
+    freeRunThread.reset(new boost::thread([this]() {freeRun();}));
+  }
+
+  void Minsky::freeRun()
+  {
+    vector<double> frame(frames->width()), flow(freeRunFlows.size()), stocks;
+    string errMsg;
+    try
+      {
+        for (unsigned n=1; !freeRunStop; ++n)
+          {
+            if (freeRunParametersChanged)
+              {
+                boost::mutex::scoped_lock lock(freeRunMutex);
+                for (auto& i: freeRunParameterUpdates)
+                  freeRunFlows[i.first]=i.second;
+                freeRunParameterUpdates.clear();
+                freeRunParametersChanged=false;
+              }
+            // step a copy, so that a failed step leaves the last good state
+            stocks=freeRunStocks;
+            double tp=freeRunT;
+            checkRKerror(rkStep(stocks, tp));
+            freeRunStocks.swap(stocks);
+            freeRunT=tp;
+            bool finished=(reverse? -freeRunT: freeRunT)>=freeRunTMax;
+            if (!finished && n%max(freeRunDecimation,1U)) continue;
+
+            // evaluate flow variables into a private copy
+            flow=freeRunFlows;
+            EvalOpBase::t=reverse? -freeRunT: freeRunT;
+            for (auto& eq: equations)
+              eq->eval(&flow[0], flow.size(), &freeRunStocks[0]);
+
+            auto f=frame.begin();
+            *f++=reverse? -freeRunT: freeRunT;
+            for (auto& s: frameSlices)
+              {
+                auto& src=s.flow? flow: freeRunStocks;
+                f=copy(src.begin()+s.idx, src.begin()+s.idx+s.size, f);
+              }
+            frames->push(&frame[0]);
+            if (finished) break;
+          }
+      }
+    catch (const std::exception& ex)
+      {
+        errMsg=ex.what();
+      }
+    catch (...)
+      {
+        errMsg="Unknown exception thrown on ODE solver thread";
+      }
+    boost::mutex::scoped_lock lock(freeRunMutex);
+    threadErrMsg=errMsg;
+    freeRunExited=true;
+  }
+
+  void Minsky::passParameterChanges()
+  {
+    vector<pair<size_t,double>> changes;
+    auto p=freeRunParameters.begin();
+    for (auto& s: parameterSlices)
+      for (size_t i=s.idx; i<s.idx+s.size; ++i, ++p)
+        if (flowVars[i]!=*p && !(std::isnan(flowVars[i]) && std::isnan(*p)))
+          {
+            *p=flowVars[i];
+            changes.emplace_back(i, *p);
+          }
+    if (changes.empty()) return;
+    boost::mutex::scoped_lock lock(freeRunMutex);
+    freeRunParameterUpdates.insert(freeRunParameterUpdates.end(), changes.begin(), changes.end());
+    freeRunParametersChanged=true;
+  }
+
+  size_t Minsky::pollFreeRun()
+  {
+    if (!frames) return 0;
+    passParameterChanges();
+    // checked before consuming frames, so that all frames published
+    // before the solver exited are consumed
+    bool exited;
+    string errMsg;
+    {
+      boost::mutex::scoped_lock lock(freeRunMutex);
+      exited=freeRunExited;
+      errMsg.swap(threadErrMsg);
+    }
+    vector<double> frame(frames->width());
+    size_t n=0;
+    for (; frames->pop(&frame[0]); ++n)
+      {
+        t=frame[0];
+        auto f=frame.begin()+1;
+        for (auto& s: frameSlices)
+          {
+            auto& dst=s.flow? flowVars: stockVars;
+            copy(f, f+s.size, dst.begin()+s.idx);
+            f+=s.size;
+          }
+        // parameters are set by the GUI thread, so frames computed
+        // before a change do not revert it
+        auto p=freeRunParameters.begin();
+        for (auto& s: parameterSlices)
+          {
+            copy(p, p+s.size, flowVars.begin()+s.idx);
+            p+=s.size;
+          }
+        logVariables();
+        recordTimeSeriesPoint();
+        model->recursiveDo
+          (&Group::items, 
+           [&](Items&, Items::iterator i) 
+           {(*i)->updateIcon(t); return false;});
+      }
+
+    if (exited && freeRunThread)
+      {
+        // solver thread has reached tmax, or failed
+        stopFreeRun();
+        if (!errMsg.empty())
+          throw runtime_error(errMsg);
+      }
+    
+    if (n)
+      {
+        time_duration maxWait=milliseconds(maxWaitMS);
+        if ((microsec_clock::local_time()-(ptime&)lastRedraw) > maxWait)
+          {
+            canvas.requestRedraw();
+            lastRedraw=microsec_clock::local_time();
+          }
+      }
+    return n;
+  }
+
+  void Minsky::stopFreeRun()
+  {
+    if (!freeRunThread) return;
+    freeRunStop=true;
+    freeRunThread->join();
+    freeRunThread.reset();
+    RKThreadRunning=false;
+    freeRunFlows.clear();
+    // discard undisplayed frames, and pick up the solver's last good state
+    frames.reset();
+    stockVars.swap(freeRunStocks);
+    t=reverse? -freeRunT: freeRunT;
+    evalEquations();
+    canvas.requestRedraw();
+  }
+
   string Minsky::diagnoseNonFinite() const
   {
     // firstly check if any variables are not finite
@@ -993,8 +1468,9 @@ namespace minsky
     EvalOpBase::t=reverse? -t: t;
     double reverseFactor=reverse? -1: 1;
     // firstly evaluate the flow variables. Initialise to flowVars so
-    // that no input vars are correctly initialised
-    vector<double> flow(flowVars);
+    // that no input vars are correctly initialised. The free running
+    // solver uses its private copy.
+    vector<double> flow(freeRunFlows.empty()? flowVars: freeRunFlows);
     for (size_t i=0; i<equations.size(); ++i)
       equations[i]->eval(&flow[0], flow.size(), vars);
 
@@ -1022,7 +1498,7 @@ namespace minsky
     double reverseFactor=reverse? -1: 1;
     // firstly evaluate the flow variables. Initialise to flowVars so
     // that no input vars are correctly initialised
-    vector<double> flow=flowVars;
+    vector<double> flow(freeRunFlows.empty()? flowVars: freeRunFlows);
     for (size_t i=0; i<equations.size(); ++i)
       equations[i]->eval(&flow[0], flow.size(), sv);
 
@@ -1068,18 +1544,61 @@ namespace minsky
     fileVersion=minskyVersion;
   }
 
+  void Minsky::saveBinary(const std::string& filename, bool compress)
+  {
+    schema3::TensorPayloads tensors;
+    schema3::Minsky m(*this, &tensors);
+    ofstream of(filename, ios::binary);
+    if (!of)
+      throw runtime_error("cannot save to "+filename);
+    schema3::writeBinary(of, m, tensors, compress);
+    flags &= ~is_edited;
+    fileVersion=minskyVersion;
+  }
+
+  int Minsky::tensorCompressionLevel() const
+  {return encodeSettings.level;}
+  
+  void Minsky::setTensorCompressionLevel(int level)
+  {
+    if (level<0 || level>9)
+      throw error("compression level %d out of range 0-9",level);
+    encodeSettings.level=level;
+  }
+
+  void Minsky::convertModelFile(const std::string& from, const std::string& to) const
+  {
+    schema3::Minsky schema;
+    schema3::TensorPayloads tensors;
+    if (readModelFile(from, schema, tensors))
+      {
+        schema3::embedTensorData(schema, tensors);
+        ofstream of(to);
+        xml_pack_t saveFile(of, schemaURL);
+        saveFile.prettyPrint=true;
+        xml_pack(saveFile, "Minsky", schema);
+        if (!of)
+          throw runtime_error("cannot save to "+to);
+      }
+    else
+      {
+        schema3::extractTensorData(schema, tensors);
+        ofstream of(to, ios::binary);
+        if (!of)
+          throw runtime_error("cannot save to "+to);
+        schema3::writeBinary(of, schema, tensors);
+      }
+  }
+
   void Minsky::load(const std::string& filename) 
   {
     BusyCursor busy(*this);
     clearAllMaps();
 
-    ifstream inf(filename);
-    if (!inf)
-      throw runtime_error("failed to open "+filename);
-    stripByteOrderingMarker(inf);
-    xml_unpack_t saveFile(inf);
-    schema3::Minsky currentSchema(saveFile);
-    *this=currentSchema;
+    schema3::Minsky currentSchema;
+    schema3::TensorPayloads tensors;
+    readModelFile(filename, currentSchema, tensors);
+    *this=currentSchema.toMinsky(tensors);
     if (currentSchema.schemaVersion<currentSchema.version)
       message("You are converting the model from an older version of Minsky. "
               "Once you save this file, you may not be able to open this file"
@@ -1104,6 +1623,221 @@ namespace minsky
     flags=reset_needed|fullEqnDisplay_needed;
   }
 
+  namespace
+  {
+    const char checkpointMagic[]="MinskyCheckpoint";
+    const int checkpointVersion=1;
+
+    /// add \a buf to \a h, a 64 bit FNV-1a hash
+    void fnv1a(uint64_t& h, const pack_t& buf)
+    {
+      for (size_t i=0; i<buf.size(); ++i)
+        {
+          h^=static_cast<unsigned char>(buf.data()[i]);
+          h*=1099511628211ULL;
+        }
+    }
+
+    /// clear attributes of \a i that only affect its layout
+    void clearLayout(schema3::Item& i)
+    {
+      i.x=i.y=0;
+      i.scaleFactor=1;
+      i.width.reset();
+      i.height.reset();
+      i.bookmarks.reset();
+    }
+
+    // apply \a f to all plots in the model, in a fixed traversal order
+    template <class F> void forAllPlots(Group& g, F f)
+    {
+      g.recursiveDo
+        (&Group::items, [&](Items&, Items::iterator i) {
+          if (auto p=dynamic_cast<PlotWidget*>(i->get()))
+            f(*p);
+          return false;
+        });
+    }
+  }
+
+  std::string Minsky::modelHash() const
+  {
+    if (!m_modelHash.empty() && modelHashTimestamp==canvas.model.timestamp)
+      return m_modelHash;
+    // tensor data is hashed as packed, rather than encoded into the schema
+    schema3::TensorPayloads tensors;
+    schema3::Minsky m(*this, &tensors);
+    m.zoomFactor=1;
+    m.bookmarks.clear();
+    for (auto& i: m.items) clearLayout(i);
+    for (auto& i: m.groups) clearLayout(i);
+    for (auto& i: m.wires) i.coords.reset();
+    pack_t buf;
+    buf<<m;
+    uint64_t h=14695981039346656037ULL;
+    fnv1a(h, buf);
+    for (auto& i: tensors)
+      fnv1a(h, *i.second);
+    char r[17];
+    snprintf(r,sizeof(r),"%016llx",static_cast<unsigned long long>(h));
+    m_modelHash=r;
+    modelHashTimestamp=canvas.model.timestamp;
+    return m_modelHash;
+  }
+
+  string Minsky::tensorStorageReport() const
+  {
+    ostringstream r;
+    r<<"name\telements\tprecision\tresident bytes\tmapped bytes\tmax abs difference\tmax rel difference\n";
+    size_t totalResident=0, totalMapped=0;
+    for (auto& i: variableValues)
+      {
+        auto& v=*i.second;
+        if (v.rank()==0) continue;
+        auto storage=dynamic_cast<const InPlaceTensorData*>(v.tensorInit.deferredData().get());
+        size_t resident=storage? storage->residentBytes(): 0, mapped=storage? storage->mappedBytes(): 0;
+        if (!storage && !v.tensorInit.deferredData() && v.tensorInit.rank()>0)
+          resident+=v.tensorInit.size()*sizeof(double);
+        if (!v.inPlace() && v.idx()>=0)
+          resident+=v.size()*sizeof(double); // value vector
+        PrecisionLoss loss;
+        if (storage) loss=storage->precisionLoss;
+        r<<v.name<<'\t'<<v.size()<<'\t'<<(storage && storage->singlePrecision()? "single": "double")
+         <<'\t'<<resident<<'\t'<<mapped<<'\t'<<loss.maxAbs<<'\t'<<loss.maxRel<<'\n';
+        totalResident+=resident;
+        totalMapped+=mapped;
+      }
+    r<<"total\t\t\t"<<totalResident<<'\t'<<totalMapped<<"\t\t\n";
+    return r.str();
+  }
+
+  Minsky::~Minsky()
+  {
+    freeRunStop=true;
+    if (freeRunThread)
+      freeRunThread->join();
+    if (checkpointThread)
+      checkpointThread->join();
+  }
+
+  void Minsky::checkpoint(const std::string& filename)
+  {
+    if (freeRunning())
+      throw error("cannot checkpoint whilst free running");
+    if (RKThreadRunning)
+      throw error("cannot checkpoint while simulation is stepping");
+    waitForCheckpoint();
+    // take a consistent copy of the simulation state on this thread,
+    // whilst the RK thread is not running
+    auto buf=make_shared<pack_t>();
+    *buf<<string(checkpointMagic)<<checkpointVersion<<modelHash()<<t<<t0<<
+      stockVars<<flowVars<<(ode? ode->driver->h: 0.0);
+    vector<const ecolab::Plot*> plots;
+    forAllPlots(*model, [&](const PlotWidget& p){plots.push_back(&p);});
+    *buf<<plots.size();
+    for (auto p: plots)
+      *buf<<*p;
+
+    checkpointThread.reset(new boost::thread([=]() {
+          try
+            {
+              // write to a temporary, then rename, so that an
+              // interrupted write doesn't destroy the previous checkpoint
+              string tmpName=filename+".tmp";
+              {
+                ofstream f(tmpName, ios::binary);
+                f.write(buf->data(), buf->size());
+                if (!f)
+                  throw runtime_error("cannot write checkpoint to "+tmpName);
+              }
+              boost::filesystem::rename(tmpName, filename);
+            }
+          catch (const std::exception& ex)
+            {
+              checkpointErrMsg=ex.what();
+            }
+        }));
+  }
+
+  void Minsky::waitForCheckpoint()
+  {
+    if (checkpointThread)
+      {
+        checkpointThread->join();
+        checkpointThread.reset();
+      }
+    if (!checkpointErrMsg.empty())
+      {
+        string msg;
+        msg.swap(checkpointErrMsg);
+        throw error("%s",msg.c_str());
+      }
+  }
+
+  void Minsky::restoreCheckpoint(const std::string& filename)
+  {
+    if (RKThreadRunning)
+      throw error("cannot restore checkpoint while simulation is stepping");
+    
+    ifstream f(filename, ios::binary);
+    if (!f)
+      throw runtime_error("failed to open "+filename);
+    pack_t buf;
+    char b[4096];
+    while (f.read(b,sizeof(b)), f.gcount()>0)
+      buf.packraw(b,f.gcount());
+
+    string magic, hash;
+    int version;
+    buf>>magic;
+    if (magic!=checkpointMagic)
+      throw error("%s is not a Minsky checkpoint file",filename.c_str());
+    buf>>version;
+    if (version>checkpointVersion)
+      throw error("checkpoint version %d not supported",version);
+    buf>>hash;
+    if (hash!=modelHash())
+      throw error("checkpoint %s was taken from a different model",filename.c_str());
+
+    double tc, t0c, h;
+    vector<double> stocks, flows;
+    buf>>tc>>t0c>>stocks>>flows>>h;
+
+    // equations only need constructing if the model has changed since
+    // they were last constructed
+    if (equations.empty() || canvas.model.timestamp>equationsTimestamp ||
+        stocks.size()!=stockVars.size() || flows.size()!=flowVars.size())
+      {
+        t0=t0c;
+        reset();
+        if (stocks.size()!=stockVars.size() || flows.size()!=flowVars.size())
+          throw error("checkpoint %s inconsistent with model",filename.c_str());
+      }
+
+    EvalOpBase::t=t=tc;
+    t0=t0c;
+    stockVars.swap(stocks);
+    flowVars.swap(flows);
+    if (ode && h>0)
+      gsl_odeiv2_driver_reset_hstart(ode->driver, h);
+
+    size_t numPlots;
+    buf>>numPlots;
+    vector<PlotWidget*> plots;
+    forAllPlots(*model, [&](PlotWidget& p){plots.push_back(&p);});
+    if (numPlots!=plots.size())
+      throw error("checkpoint %s inconsistent with model",filename.c_str());
+    for (auto p: plots)
+      {
+        buf>>static_cast<ecolab::Plot&>(*p);
+        p->requestRedraw();
+      }
+
+    // simulation can continue from here without a reset
+    flags &= ~reset_needed;
+    canvas.requestRedraw();
+  }
+
   void Minsky::exportSchema(const char* filename, int schemaLevel)
   {
     xsd_generate_t x;
@@ -1290,47 +2024,10 @@ namespace minsky
   
   bool Minsky::pushHistory()
   {
-    // go via a schema object, as serialising minsky::Minsky has
-    // problems due to port management
-    schema3::Minsky m(*this);
-    pack_t buf;
-    buf<<m;
-    if (history.empty())
-      {
-        history.emplace_back();
-        buf.swap(history.back());
-        historyPtr=history.size();
-        return true;
-      }
-    while (history.size()>maxHistory)
-      history.pop_front();
-    if (memcmp(buf.data(), history.back().data(), buf.size())!=0)
-      {
-        // check XML versions differ (slower)
-        ostringstream prev, curr;
-        xml_pack_t prevXbuf(prev), currXbuf(curr);
-        xml_pack(currXbuf,"Minsky",m);
-        history.back().reseto()>>m;
-        xml_pack(prevXbuf,"Minsky",m);
-
-        if (curr.str()!=prev.str())
-          {
-            // This bit of code outputs an XML representation that can be
-            //        used for debugging issues related to unnecessary
-            //        history pushes.
-            //  buf.reseto()>>m;
-            //  xml_pack_t tb(cout);
-            //  tb.prettyPrint=true;
-            //  xml_pack(tb,"Minsky",m); 
-            //  cout<<"------"<<endl;
-            history.emplace_back();
-            buf.swap(history.back());
-            historyPtr=history.size();
-            return true;
-          }
-      }
+    bool pushed=history.push(*this);
+    history.prune(historyMemoryBudget);
     historyPtr=history.size();
-    return false;
+    return pushed;
   }
 
   void Minsky::undo(int changes)
@@ -1341,11 +2038,9 @@ namespace minsky
     historyPtr-=changes;
     if (historyPtr > 0 && historyPtr <= history.size())
       {
-        schema3::Minsky m;
-        history[historyPtr-1].reseto()>>m;
         clearAllMaps();
         model->clear();
-        m.populateGroup(*model);
+        history.restore(historyPtr-1, *model);
       }
     else
       historyPtr+=changes; // revert
@@ -1443,14 +2138,20 @@ namespace minsky
   void Minsky::exportAllPlotsAsCSV(const string& prefix) const
   {
     unsigned plotNum=0;
+    auto columnOf=recordedColumns(timeSeries);
     model->recursiveDo(&Group::items,
                        [&](Items&, Items::iterator i) {
                          if (auto p=dynamic_cast<PlotWidget*>(i->get()))
                            {
-                             if (!p->title.empty())
-                               p->exportAsCSV((prefix+"-"+p->title+".csv").c_str());
+                             string fileName=p->title.empty()?
+                               prefix+"-"+str(plotNum++)+".csv": prefix+"-"+p->title+".csv";
+                             // plots of recorded variables against time are
+                             // exported from the full history in timeSeries
+                             auto cols=timeSeries.size()? recordedPens(*p, columnOf): vector<int>();
+                             if (cols.empty())
+                               p->exportAsCSV(fileName.c_str());
                              else
-                               p->exportAsCSV((prefix+"-"+str(plotNum++)+".csv").c_str());
+                               timeSeries.exportAsCSV(fileName, cols);
                            }
                          return false;
                        });
@@ -42,12 +42,19 @@
 #include "parameterSheet.h"
 #include "dimension.h"
 #include "rungeKutta.h"
+#include "frameRing.h"
+#include "dataLogger.h"
+#include "timeSeriesStore.h"
+#include "undoHistory.h"
 
 #include <vector>
 #include <string>
 #include <set>
 #include <deque>
 
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include <ecolab.h>
 #include <xml_pack_base.h>
 #include <xml_unpack_base.h>
@@ -62,6 +69,9 @@ namespace minsky
   
   struct RKdata; // an internal structure for holding Runge-Kutta data
 
+  /// namespace of the Minsky XML schema
+  extern const char* schemaURL;
+
   // handle the display of rendered equations on the screen
   class EquationDisplay: public CairoSurface
   {
@@ -84,8 +94,15 @@ namespace minsky
   {
     EvalOpVector equations;
     vector<Integral> integrals;
+    /// tensor operations of equations, and their cached results, are
+    /// allocated from here
+    TensorArenaPtr tensorArena;
     shared_ptr<RKdata> ode;
-    shared_ptr<ofstream> outputDataFile;
+    shared_ptr<DataLogger> dataLogger;
+    /// valueIds of the variables being logged, in log file column order
+    std::vector<std::string> logValueIds;
+    /// history of the simulation run, when recordTimeSeries is set
+    TimeSeriesStore timeSeries;
     
     enum StateFlags {is_edited=1, reset_needed=2, fullEqnDisplay_needed=4};
     int flags=reset_needed;
@@ -102,14 +119,77 @@ namespace minsky
     
     /// used to report a thrown exception on the simulation thread
     std::string threadErrMsg;
+
+    /// background thread writing out checkpoint files
+    shared_ptr<boost::thread> checkpointThread;
+    /// used to report an error writing a checkpoint file
+    std::string checkpointErrMsg;
+    /// model timestamp at which the equations were last constructed
+    Canvas::Timestamp equationsTimestamp;
+    /// modelHash() as at modelHashTimestamp
+    mutable std::string m_modelHash;
+    mutable Canvas::Timestamp modelHashTimestamp;
+
+    /// solver thread used in free running mode
+    shared_ptr<boost::thread> freeRunThread;
+    /// frames of (t, selected values) published by the free running solver
+    shared_ptr<FrameRing> frames;
+    /// a contiguous range of the stock or flow vector published in each frame
+    struct FrameSlice
+    {
+      bool flow;
+      size_t idx, size;
+      bool operator<(const FrameSlice& x) const {
+        return flow<x.flow || (flow==x.flow && (idx<x.idx || (idx==x.idx && size<x.size)));
+      }
+    };
+    std::vector<FrameSlice> frameSlices;
+    /// requests the free running solver thread to exit
+    std::atomic<bool> freeRunStop{false};
+    /// solver state owned by the free running thread while it is
+    /// running. Holds the last successfully computed state.
+    std::vector<double> freeRunStocks;
+    double freeRunT=0;
+    /// the solver evaluates flow variables starting from this private
+    /// copy of flowVars, rather than flowVars, which the GUI thread
+    /// updates from published frames
+    std::vector<double> freeRunFlows;
+    /// simulation time at which the free running solver stops
+    double freeRunTMax=0;
+    /// guards freeRunExited and threadErrMsg, set by the free running
+    /// solver as it exits, and freeRunParameterUpdates
+    boost::mutex freeRunMutex;
+    bool freeRunExited=false;
+    /// ranges of flowVars holding parameters, which may be edited,
+    /// or set by sliders, whilst free running
+    std::vector<FrameSlice> parameterSlices;
+    /// parameter values last passed to the free running solver
+    std::vector<double> freeRunParameters;
+    /// (index, value) of parameters changed since the free running
+    /// solver last picked them up
+    std::vector<std::pair<size_t,double>> freeRunParameterUpdates;
+    std::atomic<bool> freeRunParametersChanged{false};
+    /// pass parameters changed by the GUI thread to the free running solver
+    void passParameterChanges();
+
+    /// copy of the items last put on the clipboard, pasted directly
+    /// rather than from the clipboard's contents whilst they are unchanged
+    mutable GroupPtr clipboardCopy;
+    /// clipboard contents corresponding to clipboardCopy
+    mutable std::string clipboardText;
+    /// value attributes of a variable on the clipboard
+    struct ClipboardValue
+    {
+      std::string init, units;
+      civita::TensorVal tensorInit;
+    };
+    /// values of clipboardCopy's variables, as at the time of copying.
+    /// These are kept here, rather than in variableValues, so that
+    /// variables cut or deleted from the model do not survive there.
+    mutable std::map<const VariableBase*, ClipboardValue> clipboardValues;
   protected:
     /// save history of model for undo
-    /* 
-       TODO: it should be sufficient to add move semantics to pack_t,
-       but for some reason copy semantics are required, requiring the
-       use of shared_ptr
-     */
-    std::deque<classdesc::pack_t> history;
+    UndoHistory history;
     size_t historyPtr;
 
     /// flag indicates that RK engine is computing a step
@@ -140,6 +220,22 @@ namespace minsky
 
     /// write current state of all variables to the log file
     void logVariables() const;
+    /// locations of the logged variables in the stock/flow vectors
+    std::vector<DataLogger::Column> logColumns() const;
+    /// variables recorded in timeSeries
+    std::vector<TimeSeriesStore::Column> timeSeriesColumns() const;
+    /// append current state to timeSeries, if recording
+    void recordTimeSeriesPoint() {
+      if (recordTimeSeries) timeSeries.append(t, stockVars, flowVars);
+    }
+
+    /// advance \a stocks by nSteps solver steps from time \a tp, updating \a tp
+    /// @return GSL error code
+    int rkStep(std::vector<double>& stocks, double& tp);
+    /// throw an appropriate exception for GSL error \a err
+    void checkRKerror(int err);
+    /// body of the free running solver thread
+    void freeRun();
 
     Exclude<boost::posix_time::ptime> lastRedraw;
 
@@ -211,6 +307,8 @@ namespace minsky
       model->iWidth(std::numeric_limits<float>::max());
       model->self=model;
     }
+    /// background threads refer to this, so must finish first
+    ~Minsky();
 
     GroupPtr model{new Group};
     Canvas canvas{model};
@@ -257,12 +355,53 @@ namespace minsky
     /// names of all variables
     void openLogFile(const string&);
     /// closes log file
-    void closeLogFile() {outputDataFile.reset();}
+    void closeLogFile() {
+      auto logger=dataLogger;
+      dataLogger.reset();
+      if (logger) logger->close(); // reports any write error
+    }
     std::set<string> logVarList;
+    /// if true, log files are written in a compact binary format,
+    /// which can be converted to text with convertBinaryLog
+    bool binaryLog=false;
+    /// convert a binary log file to the text log file format
+    void convertBinaryLog(const string& binaryFile, const string& textFile) const
+    {minsky::convertBinaryLog(binaryFile, textFile);}
+
+    /// @{ simulation history. If recordTimeSeries is set, the
+    /// variables named in timeSeriesVarList (or all scalar variables,
+    /// if empty) are recorded at each step, from the last reset.
+    bool recordTimeSeries=false;
+    std::set<string> timeSeriesVarList;
+    /// if nonzero, older records beyond the most recent
+    /// timeSeriesMaxRecords are discarded
+    size_t timeSeriesMaxRecords=0;
+    /// valueIds of the recorded variables
+    std::vector<std::string> timeSeriesNames() const;
+    /// number of records in the history
+    size_t timeSeriesSize() const {return timeSeries.size();}
+    /// return the history of variable \a valueId between \a t0 and
+    /// \a t1, downsampled to at most \a maxPoints, as a flattened
+    /// vector of (t, value) pairs
+    std::vector<double> timeSeriesQuery(const std::string& valueId, double t0, double t1, unsigned maxPoints) const;
+    /// export the whole history as a CSV file
+    void exportTimeSeriesAsCSV(const std::string& filename) const {timeSeries.exportAsCSV(filename);}
+    /// redraw plots against time from the recorded history between
+    /// \a t0 and \a t1, with at most \a maxPoints per pen
+    /// (0 for all points)
+    void plotTimeSeries(double t0, double t1, unsigned maxPoints);
+    /// @}
     
     /// construct the equations based on input data
     /// @throws ecolab::error if the data is inconsistent
     void constructEquations();
+    /// if set, a directory in which compiled equations are cached,
+    /// keyed by model content, so that subsequent loads of the same
+    /// model can skip equation construction
+    std::string equationCacheDir;
+    /// number of times constructEquations() installed equations from
+    /// the cache
+    unsigned equationCacheHits=0;
     /// evaluate the equations (stockVars.size() of them)
     void evalEquations(double result[], double t, const double vars[]);
     /// performs dimension analysis, throws if there is a problem
@@ -285,13 +424,68 @@ namespace minsky
     void reset(); ///<resets the variables back to their initial values
     void step();  ///< step the equations (by n steps, default 1)
 
+    /// @{ free running mode: the solver steps continuously on a
+    /// background thread, publishing frames of the time and the values
+    /// of plotted, sheet and logged variables, which are consumed by
+    /// pollFreeRun() at the GUI's own rate
+    /// @param tmax simulation time at which the solver stops
+    void startFreeRun(double tmax=std::numeric_limits<double>::infinity());
+    /// stop the solver, adopting its last successfully computed state
+    void stopFreeRun();
+    bool freeRunning() const {return freeRunThread.get();}
+    /// process frames published since the last call, updating plots
+    /// and the log file. Simulation time and displayed values are
+    /// updated to the most recent frame.
+    /// @return number of frames processed
+    /// @throw if the solver thread reported an error, in which case
+    /// the failed step's state is discarded
+    size_t pollFreeRun();
+    /// number of solver steps (each of nSteps) between published frames
+    unsigned freeRunDecimation=1;
+    /// capacity of the frame buffer. Frames are dropped rather than
+    /// stalling the solver if the buffer fills.
+    unsigned freeRunBufferFrames=1024;
+    /// number of frames dropped since the free run started
+    size_t droppedFrames() const {return frames? frames->dropped(): 0;}
+    /// @}
+
     /// save to a file
     void save(const std::string& filename);
-    /// load from a file
+    /// save to a file in binary model format, which is quicker to
+    /// save and load than XML for models containing large tensors
+    /// @param compress deflate tensor data
+    void saveBinary(const std::string& filename, bool compress=false);
+    /// zlib compression level (0-9) of tensor data saved in XML files
+    int tensorCompressionLevel() const;
+    void setTensorCompressionLevel(int level);
+    /// load from a file, which may be either XML or binary model format
     void load(const std::string& filename);
+    /// convert a model file between XML and binary model formats,
+    /// without going through the model, so that the conversion is
+    /// lossless. If \a from is binary, \a to is written as XML, and
+    /// vice versa.
+    void convertModelFile(const std::string& from, const std::string& to) const;
 
     void exportSchema(const char* filename, int schemaLevel=1);
 
+    /// write the current simulation state (time, stock and flow
+    /// variables, solver step size and plot data) to \a filename in
+    /// binary form. The state is copied immediately, and the file
+    /// written on a background thread.
+    void checkpoint(const std::string& filename);
+    /// restore simulation state written by checkpoint(). reset() is
+    /// only called if the equations are out of date with respect to the model.
+    /// @throw ecolab::error if the checkpoint was written from a different model
+    void restoreCheckpoint(const std::string& filename);
+    /// wait for any checkpoint write in progress to complete
+    /// @throw ecolab::error if the write failed
+    void waitForCheckpoint();
+    /// hash of the serialised model, less its layout, identifying the
+    /// model a checkpoint was taken from, or equations cached for. It
+    /// is only recomputed when the model timestamp changes, so model
+    /// changes should be followed by markEdited().
+    std::string modelHash() const;
+
     /// indicate operation item has error, if visible, otherwise contining group
     void displayErrorItem(const Item& op) const;
 
@@ -307,7 +501,20 @@ namespace minsky
 
     std::string fileVersion; ///< Minsky version file was saved under
     
-    unsigned maxHistory{100}; ///< maximum no. of history states to save
+    /// memory, in bytes, the undo history may use before its oldest states are discarded
+    size_t historyMemoryBudget{256*1024*1024};
+    /// parameters' tensor data larger than this, in bytes, is held in
+    /// a memory mapped file rather than in memory
+    size_t mappedTensorThreshold{256*1024*1024};
+    /// hold parameters' tensor data in single precision, halving the
+    /// memory and bandwidth it uses. Operations still accumulate in
+    /// double precision, and the model is saved in double precision.
+    bool singlePrecisionParameters=false;
+    /// tab separated table of tensor valued variables, giving their
+    /// storage precision, memory used, and largest absolute and
+    /// relative differences from their original values due to
+    /// single precision storage
+    std::string tensorStorageReport() const;
     int maxWaitMS=100; ///< maximum  wait in millisecond between redrawing canvaas during simulation
 
     /// clear history
@@ -369,8 +576,9 @@ namespace minsky
     virtual void runItemDeletedCallback(const Item&) {}
     
     /// check whether to proceed or abort, given a request to allocate
-    /// \a bytes of memory. Implemented in MinskyTCL
-    virtual bool checkMemAllocation(size_t bytes) const {return true;}
+    /// \a bytes of memory, of which \a mappedBytes are backed by a
+    /// mapped file, so need not be resident. Implemented in MinskyTCL
+    virtual bool checkMemAllocation(size_t bytes, size_t mappedBytes=0) const {return true;}
     
   };
 
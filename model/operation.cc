@@ -23,6 +23,7 @@
 #include "minsky.h"
 #include "str.h"
 #include "cairoItems.h"
+#include "CSVParser.h"
 
 #include <cairo_base.h>
 #include <pango.h>
@@ -877,9 +878,11 @@ namespace minsky
     // for now, we just read pairs of numbers, separated by
     // whitespace. Later, we need to add in the smarts to handle a
     // variety of CSV formats
-    double x, y;
-    while (f>>x>>y)
-      data[x]=y; // TODO: throw if more than one equal value of x provided?
+    string token;
+    double xy[2];
+    for (unsigned i=0; f>>token && parseNumber(token,'.',xy[i%2])==numberField; ++i)
+      if (i%2)
+        data[xy[0]]=xy[1]; // TODO: throw if more than one equal value of x provided?
 
     // trim any leading directory
     size_t p=fileName.rfind('/');
@@ -79,6 +79,19 @@ namespace minsky
       }
     };
 
+    /// \a n values of \a v from \a offset. Values read in place, such
+    /// as from a mapped file, are copied into \a buf through const
+    /// access, rather than loading the whole tensor.
+    const double* plotValues(const VariableValue& v, size_t offset, size_t n, vector<double>& buf)
+    {
+      if (!v.inPlace())
+        return v.begin()+offset;
+      buf.resize(n);
+      for (size_t i=0; i<n; ++i)
+        buf[i]=v[offset+i];
+      return buf.data();
+    }
+
   }
 
   PlotWidget::PlotWidget()
@@ -404,22 +417,22 @@ namespace minsky
               {
               case 0: // use t, when x variable not attached
                 x=t;
-                y=(*yvars[pen])[i];
+                y=yvars[pen]->value(i);
                 break;
               case 1: // use the value of attached variable
                 assert(xvars[0]->idx()>=0);
                 if (xvars[0]->size()>1)
                   throw_error("Tensor valued x inputs not supported");
-                x=(*xvars[0])[0];
-                y=(*yvars[pen])[i];
+                x=xvars[0]->value(0);
+                y=yvars[pen]->value(i);
                 break;
               default:
                 if (pen < xvars.size() && xvars[pen]->idx()>=0)
                   {
                     if (xvars[pen]->size()>1)
                       throw_error("Tensor valued x inputs not supported");
-                    x=(*xvars[pen])[0];
-                    y=(*yvars[pen])[i];
+                    x=xvars[pen]->value(0);
+                    y=yvars[pen]->value(i);
                   }
                 else
                   throw error("x input not wired for pen %d",(int)pen+1);
@@ -471,13 +484,13 @@ namespace minsky
           if (d.empty()) continue;
           
           // work out a reference to the x data
-          vector<double> xdefault;
-          double* x;
+          vector<double> xdefault, xbuf, ybuf;
+          const double* x;
           if (pen<xvars.size() && xvars[pen])
             {
               if (xvars[pen]->hypercube().xvectors[0].size()!=d[0])
                 throw error("x vector not same length as y vectors");
-              x=xvars[pen]->begin();
+              x=plotValues(*xvars[pen], 0, d[0], xbuf);
             }
           else
             {
@@ -534,7 +547,7 @@ namespace minsky
           // For feature 47
             for (size_t j=0 /*d[0]*/; j<std::min(maxNumTensorElementsToPlot*d[0], yv->size()); j+=d[0])
               {
-                setPen(extraPen, x, yv->begin()+j, d[0]);
+                setPen(extraPen, x, plotValues(*yv, j, d[0], ybuf), d[0]);
                 if (pen>=numLines)
                   assignSide(extraPen,Side::right);
                string label;
@@ -305,6 +305,25 @@ namespace minsky
       noRavelSetup();
   }
 
+  Ravel* Ravel::clone() const
+  {
+    // released only once the data file, if any, has loaded
+    unique_ptr<Ravel> r(new Ravel);
+    r->detailedText=detailedText;
+    r->tooltip=tooltip;
+    r->m_x=m_x;
+    r->m_y=m_y;
+    r->m_sf=m_sf;
+    r->rotation(rotation());
+    r->axisDimensions=axisDimensions;
+    if (!m_filename.empty())
+      r->loadFile(m_filename);
+    // applied again once data is loaded from an input
+    r->initState=initState.empty()? getState(): initState;
+    r->applyState(r->initState);
+    return r.release();
+  }
+
   Ravel::~Ravel()
   {
     if (ravelAvailable()) // NB during shutdown, ravel may be unloaded before getting here
@@ -24,6 +24,8 @@
 #include "cairoRenderer.h"
 #include "ravelState.h"
 
+namespace civita {class RavelChain;}
+
 namespace minsky 
 {
   using namespace civita;
@@ -65,12 +67,19 @@ namespace minsky
     // define them as empty operations to prevent double frees if accidentally used
     void operator=(const Ravel&) {}
     Ravel(const Ravel&) {}
+    /// the Ravel library object is not copyable, so its state is
+    /// transferred to the clone as a RavelState
+    Ravel* clone() const override;
 
     /// local override of axis dimensionality
     Dimensions axisDimensions;
 
     /// group of ravels that move syncronously
     std::shared_ptr<RavelLockGroup> lockGroup;
+    /// tensor operations computing the output, kept across resets so
+    /// that a state change only recomputes the operations it
+    /// affects. Used by one expression graph at a time.
+    Exclude<std::shared_ptr<civita::RavelChain>> chain;
     void leaveLockGroup();
     void broadcastStateToLockGroup() const;
     
@@ -71,7 +71,7 @@ void Sheet::draw(cairo_t* cairo) const
           if (value->hypercube().rank()==0)
             {
               cairo_move_to(cairo,x,y);
-              pango.setMarkup(str((*value)[0]));
+              pango.setMarkup(str(value->value(0)));
               pango.show();
             }
           else
@@ -97,7 +97,7 @@ void Sheet::draw(cairo_t* cairo) const
                     if (!value->index().empty())
                       y=y0+value->index()[i]*rowHeight;
                     cairo_move_to(cairo,x,y);
-                    auto v=(*value)[i];
+                    auto v=value->value(i);
                     if (!std::isnan(v))
                       {
                         pango.setMarkup(str(v));
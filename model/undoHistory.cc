@@ -0,0 +1,256 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "undoHistory.h"
+#include "schema3.h"
+#include "minsky_epilogue.h"
+#include <map>
+#include <set>
+#include <string.h>
+
+using namespace std;
+using classdesc::pack_t;
+
+namespace minsky
+{
+  namespace
+  {
+    /// 64 bit FNV-1a hash
+    uint64_t fnv1a(const pack_t& buf)
+    {
+      uint64_t h=14695981039346656037ULL;
+      for (size_t i=0; i<buf.size(); ++i)
+        {
+          h^=static_cast<unsigned char>(buf.data()[i]);
+          h*=1099511628211ULL;
+        }
+      return h;
+    }
+
+    /// copy of \a buf, which is left untouched, so may be in use on
+    /// another thread
+    shared_ptr<pack_t> copy(const pack_t& buf)
+    {
+      auto r=make_shared<pack_t>(buf.size());
+      memcpy(r->data(), buf.data(), buf.size());
+      return r;
+    }
+
+    template <class R, class T>
+    void unpackRecords(const vector<R>& records, vector<T>& xs, bool copyRecords)
+    {
+      xs.resize(records.size());
+      for (size_t i=0; i<records.size(); ++i)
+        if (copyRecords)
+          *copy(records[i]->data)>>xs[i];
+        else
+          records[i]->data.reseto()>>xs[i];
+    }
+
+    /// unpack \a state into \a schema and \a tensors. If \a
+    /// copyRecords is set, records are copied before unpacking, as
+    /// is needed when used by more than one thread.
+    template <class S>
+    void unpackState(const S& state, schema3::Minsky& schema, schema3::TensorPayloads& tensors,
+                     schema3::TensorSources& sources, bool copyRecords)
+    {
+      if (copyRecords)
+        *copy(state.header->data)>>schema;
+      else
+        state.header->data.reseto()>>schema;
+      unpackRecords(state.wires, schema.wires, copyRecords);
+      unpackRecords(state.items, schema.items, copyRecords);
+      unpackRecords(state.groups, schema.groups, copyRecords);
+      for (auto& r: state.tensors)
+        {
+          tensors[r.first]=copyRecords? copy(r.second->data):
+            shared_ptr<pack_t>(r.second, &r.second->data);
+          if (r.second->source)
+            sources[r.first]=r.second->source;
+        }
+    }
+  }
+
+  UndoHistory::Record::Record(const void* object, pack_t& buf,
+                              const shared_ptr<const civita::TensorValLoader>& source,
+                              Timestamp timestamp):
+    object(object), hash(fnv1a(buf)), source(source), timestamp(timestamp)
+  {data.swap(buf);}
+
+  bool UndoHistory::Record::operator==(const Record& x) const
+  {
+    return hash==x.hash && source==x.source && data.size()==x.data.size() &&
+      memcmp(data.data(), x.data.data(), data.size())==0;
+  }
+
+  template <class T>
+  UndoHistory::RecordPtr UndoHistory::record
+  (const void* object, const T& x, const RecordPtr& prev, size_t& newBytes) const
+  {
+    pack_t buf;
+    buf<<x;
+    auto r=make_shared<const Record>(object, buf);
+    if (prev && *r==*prev) return prev;
+    newBytes+=sizeof(Record)+r->data.size();
+    return r;
+  }
+
+  template <class T>
+  void UndoHistory::addRecords(vector<RecordPtr>& records, const vector<T>& xs,
+                               const map<int, const void*>& objects,
+                               const vector<RecordPtr>* prev, size_t& newBytes) const
+  {
+    map<const void*,RecordPtr> prevByObject;
+    if (prev)
+      for (auto& i: *prev)
+        prevByObject.emplace(i->object, i);
+    for (auto& x: xs)
+      {
+        auto o=objects.find(x.id);
+        auto object=o==objects.end()? nullptr: o->second;
+        auto p=object? prevByObject.find(object): prevByObject.end();
+        records.push_back(record(object, x, p==prevByObject.end()? RecordPtr(): p->second, newBytes));
+      }
+  }
+
+  bool UndoHistory::push(const Minsky& m)
+  {
+    // go via a schema object, as serialising minsky::Minsky has
+    // problems due to port management. Tensor data is kept out of
+    // the schema, so that it is not compressed. Tensor data whose
+    // timestamp is unchanged since the previous state is not
+    // serialised again.
+    const State* prev=states.empty()? nullptr: &states.back();
+    State state;
+    map<const void*,RecordPtr> prevByValue;
+    if (prev)
+      for (auto& i: prev->tensors)
+        if (i.second->object)
+          prevByValue.emplace(i.second->object, i.second);
+    map<int,const VariableValue*> values;
+    auto packTensor=[&](int id, const VariableValue& v) {
+      values.emplace(id, &v);
+      auto p=prevByValue.find(&v);
+      auto timestamp=v.tensorInit.timestamp();
+      if (p!=prevByValue.end() && timestamp!=Timestamp() && p->second->timestamp==timestamp)
+        {
+          state.tensors[id]=p->second;
+          return false;
+        }
+      return true;
+    };
+    schema3::TensorPayloads tensors;
+    schema3::TensorSources sources;
+    schema3::SchemaObjects objects;
+    schema3::Minsky schema(m, &tensors, &sources, &objects, packTensor);
+
+    size_t newBytes=0;
+    addRecords(state.wires, schema.wires, objects, prev? &prev->wires: nullptr, newBytes);
+    addRecords(state.items, schema.items, objects, prev? &prev->items: nullptr, newBytes);
+    addRecords(state.groups, schema.groups, objects, prev? &prev->groups: nullptr, newBytes);
+    schema.wires.clear();
+    schema.items.clear();
+    schema.groups.clear();
+    state.header=record(nullptr, schema, prev? prev->header: RecordPtr(), newBytes);
+
+    multimap<uint64_t,RecordPtr> prevTensors;
+    if (prev)
+      for (auto& i: prev->tensors)
+        prevTensors.emplace(i.second->hash, i.second);
+    for (auto& i: tensors)
+      {
+        auto source=sources.find(i.first);
+        auto value=values[i.first];
+        auto r=make_shared<const Record>
+          (value, *i.second, source==sources.end()? nullptr: source->second,
+           value->tensorInit.timestamp());
+        auto& t=state.tensors[i.first];
+        auto range=prevTensors.equal_range(r->hash);
+        for (auto p=range.first; !t && p!=range.second; ++p)
+          if (*p->second==*r)
+            t=p->second;
+        if (!t)
+          {
+            newBytes+=sizeof(Record)+r->data.size();
+            t=r;
+          }
+      }
+
+    if (prev && state==*prev) return false;
+    m_memoryUsage+=newBytes+state.overhead();
+    states.push_back(move(state));
+    return true;
+  }
+
+  void UndoHistory::restore(size_t i, Group& g) const
+  {
+    schema3::Minsky schema;
+    schema3::TensorPayloads tensors;
+    schema3::TensorSources sources;
+    unpackState(states.at(i), schema, tensors, sources, false);
+    schema.populateGroup(g, tensors, sources);
+  }
+
+  UndoHistory::Snapshot UndoHistory::snapshot() const
+  {
+    if (states.empty())
+      throw out_of_range("undo history is empty");
+    Snapshot r;
+    r.state=states.back();
+    return r;
+  }
+
+  void UndoHistory::Snapshot::save(ostream& o) const
+  {
+    schema3::Minsky schema;
+    schema3::TensorPayloads tensors;
+    schema3::TensorSources sources;
+    unpackState(state, schema, tensors, sources, true);
+    schema3::copyTensorSources(tensors, sources);
+    schema3::embedTensorData(schema, tensors);
+    xml_pack_t saveFile(o, schemaURL);
+    saveFile.prettyPrint=true;
+    xml_pack(saveFile, "Minsky", schema);
+  }
+
+  void UndoHistory::prune(size_t budget)
+  {
+    // records are only shared with the previous state, so a record
+    // of the oldest state not in the next state is no longer in the
+    // history, although it may still be held by a snapshot
+    auto records=[](const State& state) {
+      set<const Record*> r{state.header.get()};
+      for (auto v: {&state.wires, &state.items, &state.groups})
+        for (auto& i: *v)
+          r.insert(i.get());
+      for (auto& i: state.tensors)
+        r.insert(i.second.get());
+      return r;
+    };
+    while (states.size()>1 && m_memoryUsage>budget)
+      {
+        auto next=records(states[1]);
+        for (auto r: records(states.front()))
+          if (!next.count(r))
+            m_memoryUsage-=sizeof(Record)+r->data.size();
+        m_memoryUsage-=states.front().overhead();
+        states.pop_front();
+      }
+  }
+}
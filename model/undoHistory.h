@@ -0,0 +1,139 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UNDOHISTORY_H
+#define UNDOHISTORY_H
+
+#include <pack_base.h>
+#include <chrono>
+#include <deque>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+namespace civita
+{
+  struct TensorValLoader;
+}
+
+namespace minsky
+{
+  class Minsky;
+  class Group;
+
+  /// Undo history of a model. Each state is held as the serialised
+  /// wires, items, groups and tensor data of the model's schema,
+  /// keyed by id. Records unchanged from the previous state are
+  /// shared with it, so that a state only costs the memory of what
+  /// changed, yet any state can be restored without replaying
+  /// others. As schema ids are not stable, wires, items and groups
+  /// are matched with their previous records by model object. Tensor
+  /// data is matched by variable value and timestamp, so unchanged
+  /// data is not serialised again, otherwise by content. Tensor data
+  /// not yet loaded, such as read in place from a mapped file or
+  /// still encoded, is referenced rather than loaded.
+  class UndoHistory
+  {
+    typedef std::chrono::time_point<std::chrono::high_resolution_clock> Timestamp;
+    struct Record
+    {
+      /// model object recorded, or null where not applicable. For
+      /// tensor data, the variable value holding it.
+      const void* object;
+      uint64_t hash; ///< hash of data
+      /// read position is reset on each unpack
+      mutable classdesc::pack_t data;
+      /// tensor data not yet loaded, if any, in which case \a data
+      /// holds just the tensor's structure
+      std::shared_ptr<const civita::TensorValLoader> source;
+      /// timestamp of recorded tensor data
+      Timestamp timestamp;
+      Record(const void* object, classdesc::pack_t& buf,
+             const std::shared_ptr<const civita::TensorValLoader>& source=nullptr,
+             Timestamp timestamp=Timestamp());
+      bool operator==(const Record& x) const;
+    };
+    typedef std::shared_ptr<const Record> RecordPtr;
+
+    struct State
+    {
+      RecordPtr header; ///< the schema, less wires, items and groups
+      std::vector<RecordPtr> wires, items, groups;
+      std::map<int,RecordPtr> tensors; ///< keyed by item id
+      bool operator==(const State& x) const {
+        return header==x.header && wires==x.wires && items==x.items &&
+          groups==x.groups && tensors==x.tensors;
+      }
+      /// bytes used, other than by records
+      size_t overhead() const {
+        return sizeof(State)+sizeof(RecordPtr)*
+          (wires.size()+items.size()+groups.size()+tensors.size());
+      }
+    };
+    std::deque<State> states;
+    size_t m_memoryUsage=0;
+
+    /// record of \a x, or \a prev if equivalent. Bytes used by a new
+    /// record are added to \a newBytes.
+    template <class T>
+    RecordPtr record(const void* object, const T& x, const RecordPtr& prev,
+                     size_t& newBytes) const;
+    /// append records of \a xs to \a records, sharing those of \a
+    /// prev for the same model object, as given by \a objects, where
+    /// possible
+    template <class T>
+    void addRecords(std::vector<RecordPtr>& records, const std::vector<T>& xs,
+                    const std::map<int, const void*>& objects,
+                    const std::vector<RecordPtr>* prev, size_t& newBytes) const;
+  public:
+    size_t size() const {return states.size();}
+    bool empty() const {return states.empty();}
+    void clear() {states.clear(); m_memoryUsage=0;}
+    /// bytes used by the history
+    size_t memoryUsage() const {return m_memoryUsage;}
+
+    /// append the state of \a m, if it differs from the most recent state
+    /// @return true if a state was appended
+    bool push(const Minsky& m);
+    /// populate \a g with state \a i
+    void restore(size_t i, Group& g) const;
+    /// discard oldest states until memoryUsage() is no more than \a
+    /// budget, retaining at least the most recent state
+    void prune(size_t budget);
+
+    /// a state of the history, sharing its records. Records are
+    /// immutable, so a snapshot can be saved on another thread
+    /// whilst the history continues to be used.
+    class Snapshot
+    {
+      State state;
+      friend class UndoHistory;
+    public:
+      /// write as a Minsky XML file
+      void save(std::ostream&) const;
+    };
+    /// snapshot of the most recent state
+    /// @throw std::out_of_range if empty
+    Snapshot snapshot() const;
+  };
+}
+
+#endif
@@ -21,6 +21,7 @@
 #include "variable.h"
 #include "cairoItems.h"
 #include "minsky.h"
+#include "csvCache.h"
 //#include "RESTProcess_base.h"
 #include <error.h>
 #include "minsky_epilogue.h"
@@ -373,12 +374,34 @@ void VariableBase::importFromCSV(std::string filename, const DataSpec& spec)
   if (auto v=vValue()) {
     if (filename.find("://")!=std::string::npos)
       filename = v->csvDialog.loadWebFile(filename);
-    std::ifstream is(filename);
-    loadValueFromCSVFile(*v, is, spec);
+    auto& dialog=v->csvDialog;
+    if (CSVCache::restore(*v, filename, spec))
+      dialog.importState=CSVImportState(); // label dictionaries are not cached
+    else
+      {
+        // reuse the dialog's preflight if it sized this file as it
+        // now is, otherwise size the data as it is loaded
+        if (dialog.sizing.sizes(filename, spec))
+          loadValueFromCSVFile(*v, filename, spec, dialog.sizing, &dialog.importState);
+        else
+          loadValueFromCSVFile(*v, filename, spec, &dialog.importState);
+        CSVCache::store(*v, filename, spec);
+      }
     minsky().populateMissingDimensionsFromVariable(*v);
   }
 }
 
+void VariableBase::appendFromCSV(std::string filename, const DataSpec& spec)
+{
+  if (auto v=vValue()) {
+    if (filename.find("://")!=std::string::npos)
+      filename = v->csvDialog.loadWebFile(filename);
+    if (appendValueFromCSVFile(*v, filename, spec, v->csvDialog.importState))
+      minsky().populateMissingDimensionsFromVariable(*v);
+    else
+      importFromCSV(filename, spec);
+  }
+}
 
 void VariableBase::insertControlled(Selection& selection)
 {
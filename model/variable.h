@@ -191,6 +191,9 @@ namespace minsky
     void exportAsCSV(const std::string& filename) const;
     /// import CSV file, using \a spec
     void importFromCSV(std::string filename, const DataSpec& spec);
+    /// import rows appended to \a filename since it was last
+    /// imported, falling back to a full import if that is not possible
+    void appendFromCSV(std::string filename, const DataSpec& spec);
 
     void insertControlled(Selection& selection) override;
   };
@@ -18,10 +18,12 @@
 */
 #include "schema3.h"
 #include "sheet.h"
+#include "mappedTensor.h"
 #include "minsky_epilogue.h"
 
 #include "a85.h"
 #include <zlib.h>
+#include <functional>
 
 using namespace std;
 
@@ -57,21 +59,75 @@ namespace schema3
       }
   }
   
+  namespace
+  {
+    /// pack the index and hypercube, which follow the data
+    void packStructure(classdesc::pack_t& b, const civita::TensorVal& a)
+    {
+      b<<uint64_t(a.index().size());
+      for (auto i: a.index())
+        b<<uint64_t(i);
+
+      b<<uint64_t(a.hypercube().xvectors.size());
+      for (auto& i: a.hypercube().xvectors)
+        pack(b, i);
+    }
+
+    /// the data \a a is saved from: the original of data held in
+    /// single precision, otherwise its deferred data, if any
+    shared_ptr<const civita::TensorValLoader> savedData(const civita::TensorVal& a)
+    {
+      auto inPlace=dynamic_cast<const minsky::InPlaceTensorData*>(a.deferredData().get());
+      if (inPlace && inPlace->singlePrecision() && inPlace->fullPrecision)
+        return inPlace->fullPrecision;
+      return a.deferredData();
+    }
+  }
+  
   void pack(classdesc::pack_t& b, const civita::TensorVal& a)
   {
     b<<uint64_t(a.size());
-    for (auto i: a)
-      b<<i;
-    b<<uint64_t(a.index().size());
-    for (auto i: a.index())
-      b<<uint64_t(i);
-
-    b<<uint64_t(a.hypercube().xvectors.size());
-    for (auto& i: a.hypercube().xvectors)
-      pack(b, i);
+    auto source=savedData(a);
+    if (source && source!=a.deferredData())
+      {
+        // saved in full precision, rather than as held
+        vector<double> data(source->size());
+        source->load(data.data());
+        for (auto x: data)
+          b<<x;
+      }
+    else
+      // const access, so that mapped data is read in place
+      for (size_t i=0; i<a.size(); ++i)
+        b<<a[i];
+    packStructure(b,a);
   }
 
 
+  namespace
+  {
+    /// unpack the index and hypercube, which follow the data
+    void unpackStructure(classdesc::pack_t& b, set<size_t>& index, civita::Hypercube& hc)
+    {
+      uint64_t sz;
+      b>>sz;
+      for (size_t i=0; i<sz; ++i)
+        {
+          uint64_t x;
+          b>>x;
+          index.insert(x);
+        }
+
+      b>>sz;
+      for (size_t i=0; i<sz; ++i)
+        {
+          civita::XVector xv;
+          unpack(b,xv);
+          hc.xvectors.push_back(xv);
+        }
+    }
+  }
+  
   void unpack(classdesc::pack_t& b, civita::TensorVal& a)
   {
     uint64_t sz;
@@ -82,30 +138,87 @@ namespace schema3
         data.emplace_back();
         b>>data.back();
       }
-    b>>sz;
     set<size_t> index;
-    for (size_t i=0; i<sz; ++i)
-      {
-        uint64_t x;
-        b>>x;
-        index.insert(x);
-      }
-
-    b>>sz;
     civita::Hypercube hc;
-
-    for (size_t i=0; i<sz; ++i)
-      {
-        civita::XVector xv;
-        unpack(b,xv);
-        hc.xvectors.push_back(xv);
-      }
+    unpackStructure(b, index, hc);
     a.hypercube(hc); //dimension data
     a.index(index);
     assert(a.size()==data.size());
     memcpy(a.begin(),&data[0],data.size()*sizeof(data[0]));
   }
 
+  namespace
+  {
+    /// reads \a n bytes at \a offset of a packed TensorVal into \a dest
+    typedef function<void(size_t offset, size_t n, char* dest)> TensorDataReader;
+    
+    /// data of a packed TensorVal, read on first access
+    struct DeferredTensorData: public civita::TensorValLoader
+    {
+      TensorDataReader read;
+      size_t n;
+      /// the packed TensorVal's encoding, if read from Item::tensorData
+      shared_ptr<const minsky::EncodedData> encoded;
+      DeferredTensorData(const TensorDataReader& read, size_t n,
+                         const shared_ptr<const minsky::EncodedData>& encoded):
+        read(read), n(n), encoded(encoded) {}
+      size_t size() const override {return n;}
+      void load(double* data) const override
+      {read(sizeof(uint64_t), n*sizeof(double), reinterpret_cast<char*>(data));}
+    };
+
+    /// encoding that \a a's deferred data was read from, if its
+    /// structure is unchanged since, so that it can be packed again
+    /// without decoding the data. Otherwise null.
+    shared_ptr<const minsky::EncodedData> unchangedEncoding(const civita::TensorVal& a)
+    {
+      auto deferred=dynamic_cast<const DeferredTensorData*>(savedData(a).get());
+      if (!deferred || !deferred->encoded) return nullptr;
+      pack_t structure;
+      packStructure(structure,a);
+      size_t structureOffset=sizeof(uint64_t)+deferred->n*sizeof(double);
+      if (deferred->encoded->size()!=structureOffset+structure.size())
+        return nullptr;
+      // only the final blocks, holding the structure, are decoded
+      pack_t encodedStructure(structure.size());
+      deferred->encoded->decode(structureOffset, structure.size(), encodedStructure.data());
+      if (memcmp(structure.data(), encodedStructure.data(), structure.size())!=0)
+        return nullptr;
+      return deferred->encoded;
+    }
+  
+    /// unpack the structure of a packed TensorVal of \a size bytes,
+    /// deferring reading its data until accessed. If the packed
+    /// TensorVal has no data, it is taken from \a source, if given.
+    /// \a encoded is the encoding read from, if any.
+    void unpackDeferred(const TensorDataReader& read, size_t size, civita::TensorVal& a,
+                        shared_ptr<const civita::TensorValLoader> source=nullptr,
+                        const shared_ptr<const minsky::EncodedData>& encoded=nullptr)
+    {
+      uint64_t n;
+      if (size<sizeof(n))
+        throw error("tensor data truncated");
+      read(0, sizeof(n), reinterpret_cast<char*>(&n));
+      if (n>(size-sizeof(n))/sizeof(double))
+        throw error("tensor data truncated");
+      size_t structureOffset=sizeof(n)+n*sizeof(double);
+      classdesc::pack_t structure(size-structureOffset);
+      read(structureOffset, structure.size(), structure.data());
+      set<size_t> index;
+      civita::Hypercube hc;
+      unpackStructure(structure, index, hc);
+      if (n)
+        source=make_shared<DeferredTensorData>(read, n, encoded);
+      if (source)
+        a.deferData(source);
+      // index set first, so that a sparse tensor's data is not allocated
+      a.index(index);
+      a.hypercube(hc);
+      if (source && a.size()!=source->size())
+        throw error("inconsistent tensor data");
+    }
+  }
+
   Optional<classdesc::CDATA> Item::convertTensorDataFromSchema2(const Optional<classdesc::CDATA>& x)
   {
     Optional<classdesc::CDATA> r;
@@ -125,6 +238,10 @@ namespace schema3
   struct IdMap: public map<void*,int>
   {
     int nextId=0;
+    TensorPayloads* tensors=nullptr; ///< if set, tensor data is placed here
+    TensorSources* sources=nullptr; ///< if set, data not yet loaded is referenced here
+    PackTensor packTensor; ///< if set, selects the tensor data placed in tensors
+
     int at(void* o) {
       auto i=find(o);
       if (i==end())
@@ -147,6 +264,26 @@ namespace schema3
       if (j)
         {
           items.emplace_back(at(i), *j, at(j->ports));
+          if (auto v=dynamic_cast<minsky::VariableBase*>(i))
+            {
+              if (!tensors)
+                items.back().packTensorInit(*v);
+              else if (auto val=v->vValue())
+                if (val->tensorInit.rank() && (!packTensor || packTensor(items.back().id, *val)))
+                  {
+                    auto buf=make_shared<pack_t>();
+                    // deferred data is referenced rather than loaded
+                    if (auto source=sources? savedData(val->tensorInit): nullptr)
+                      {
+                        (*sources)[items.back().id]=source;
+                        *buf<<uint64_t(0);
+                        packStructure(*buf,val->tensorInit);
+                      }
+                    else
+                      pack(*buf,val->tensorInit);
+                    (*tensors)[items.back().id]=buf;
+                  }
+            }
           if (auto g=dynamic_cast<minsky::GodleyIcon*>(i))
             {
               // insert port references from flow/stock vars
@@ -260,16 +397,25 @@ namespace schema3
     if (auto val=v.vValue())
       if (val->tensorInit.rank())
         {
-          pack_t buf;
-          pack(buf,val->tensorInit);
-          tensorData=minsky::encode(buf);
+          if (auto encoded=unchangedEncoding(val->tensorInit))
+            tensorData=encoded->encoded();
+          else
+            {
+              pack_t buf;
+              pack(buf,val->tensorInit);
+              tensorData=minsky::encode(buf);
+            }
         }
   }
 
 
-  Minsky::Minsky(const minsky::Group& g)
+  Minsky::Minsky(const minsky::Group& g, TensorPayloads* tensors, TensorSources* sources,
+                 SchemaObjects* objects, const PackTensor& packTensor)
   {
     IdMap itemMap;
+    itemMap.tensors=tensors;
+    itemMap.sources=sources;
+    itemMap.packTensor=packTensor;
 
     g.recursiveDo(&minsky::GroupItems::items,[&](const minsky::Items&,minsky::Items::const_iterator i) {
         itemMap.emplaceIf<minsky::Ravel>(items, i->get()) ||
@@ -333,17 +479,22 @@ namespace schema3
                       }
                     return false;
                   });
+
+    if (objects)
+      for (auto& i: itemMap)
+        (*objects)[i.second]=i.first;
   }
       
-  Minsky::operator minsky::Minsky() const
+  minsky::Minsky Minsky::toMinsky(const TensorPayloads& tensors) const
   {
     minsky::Minsky m;
     minsky::LocalMinsky lm(m);
-    populateGroup(*m.model);
+    populateGroup(*m.model, tensors);
     m.model->setZoom(zoomFactor);
     m.model->bookmarks=bookmarks;
     m.dimensions=dimensions;
     m.conversions=conversions;
+    m.singlePrecisionParameters=singlePrecisionParameters;
     m.fileVersion=minskyVersion;
     
     static_cast<minsky::RungeKutta&>(m)=rungeKutta;
@@ -485,7 +636,8 @@ namespace schema3
     LockGroupFactory(): shared_ptr<minsky::RavelLockGroup>(new minsky::RavelLockGroup) {}
   };
   
-  void Minsky::populateGroup(minsky::Group& g) const {
+  void Minsky::populateGroup(minsky::Group& g, const TensorPayloads& tensors,
+                             const TensorSources& sources) const {
     map<int, minsky::ItemPtr> itemMap;
     map<int, shared_ptr<minsky::Port>> portMap;
     map<int, schema3::Item> schema3VarMap;
@@ -627,13 +779,29 @@ namespace schema3
               v->init(*i.second.init);
             if (i.second.units)
               v->setUnits(*i.second.units);
-            if (i.second.tensorData)
+            auto tensor=tensors.find(i.first);
+            if (i.second.tensorData || tensor!=tensors.end())
               if (auto val=v->vValue())
                 {
-                  auto buf=minsky::decode(*i.second.tensorData);
                   try
                     {
-                      unpack(buf, val->tensorInit);
+                      // data is decoded when first accessed
+                      if (i.second.tensorData)
+                        {
+                          auto encoded=make_shared<minsky::EncodedData>(*i.second.tensorData);
+                          unpackDeferred([encoded](size_t offset, size_t n, char* dest)
+                                         {encoded->decode(offset,n,dest);},
+                                         encoded->size(), val->tensorInit, nullptr, encoded);
+                        }
+                      else
+                        {
+                          shared_ptr<const classdesc::pack_t> payload=tensor->second;
+                          auto source=sources.find(i.first);
+                          unpackDeferred([payload](size_t offset, size_t n, char* dest)
+                                         {memcpy(dest, payload->data()+offset, n);},
+                                         payload->size(), val->tensorInit,
+                                         source==sources.end()? nullptr: source->second);
+                        }
                       val->hypercube(val->tensorInit.hypercube());
                     }
                   catch (const std::exception& ex) {
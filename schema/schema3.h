@@ -37,6 +37,7 @@ but any renamed attributes require bumping the schema number.
 #include "rungeKutta.h"
 
 #include <xsd_generate_base.h>
+#include <functional>
 #include <vector>
 #include <string>
 
@@ -51,6 +52,23 @@ namespace schema3
   using classdesc::shared_ptr;
   using minsky::Optional;
 
+  /// tensor data of variables, in the binary form encoded into
+  /// Item::tensorData, keyed by item id. Used when tensor data is
+  /// stored outside the schema, as in the binary model format.
+  typedef std::map<int, std::shared_ptr<classdesc::pack_t>> TensorPayloads;
+  /// tensor data not yet loaded, such as read in place from a mapped
+  /// file or still encoded, keyed by item id. The corresponding
+  /// TensorPayloads entries hold just the index and hypercube, so the
+  /// data is shared rather than copied or decoded.
+  typedef std::map<int, std::shared_ptr<const civita::TensorValLoader>> TensorSources;
+  /// model object (item, port, wire or group) of each schema id. Ids
+  /// are assigned afresh each time a schema is built, so this
+  /// provides an identity that is stable between schemas of a model.
+  typedef std::map<int, const void*> SchemaObjects;
+  /// returns whether tensor data of the variable value, of the given
+  /// item id, is to be placed in TensorPayloads. Data not placed
+  /// there is assumed to be held elsewhere by the caller.
+  typedef std::function<bool(int, const minsky::VariableValue&)> PackTensor;
  
   struct Note
   {
@@ -134,7 +152,6 @@ namespace schema3
         slider.reset(new Slider(v.sliderStepRel,v.sliderMin,v.sliderMax,v.sliderStep));
       if (auto vv=v.vValue())
         units=vv->units.str();
-      packTensorInit(v);
     }
     Item(int id, const minsky::OperationBase& o, const std::vector<int>& ports):
       ItemBase(id,static_cast<const minsky::Item&>(o),ports),
@@ -224,17 +241,29 @@ namespace schema3
     vector<minsky::Bookmark> bookmarks;
     minsky::Dimensions dimensions;
     minsky::ConversionsMap conversions;
+    bool singlePrecisionParameters=false;
     
     Minsky(): schemaVersion(0) {} // schemaVersion defined on read in
-    Minsky(const minsky::Group& g);
-    Minsky(const minsky::Minsky& m):
-      Minsky(*m.model)  {
+    /// if \a tensors is not null, variables' tensor data is placed
+    /// there, rather than encoded into Item::tensorData. If \a
+    /// sources is also not null, data not yet loaded is referenced
+    /// there rather than loaded. If \a objects is not null, the model
+    /// object of each id is recorded there. If \a packTensor is set,
+    /// only tensor data it selects is placed in \a tensors.
+    Minsky(const minsky::Group& g, TensorPayloads* tensors=nullptr,
+           TensorSources* sources=nullptr, SchemaObjects* objects=nullptr,
+           const PackTensor& packTensor=PackTensor());
+    Minsky(const minsky::Minsky& m, TensorPayloads* tensors=nullptr,
+           TensorSources* sources=nullptr, SchemaObjects* objects=nullptr,
+           const PackTensor& packTensor=PackTensor()):
+      Minsky(*m.model, tensors, sources, objects, packTensor)  {
       minskyVersion=m.minskyVersion;
       rungeKutta=m;
       zoomFactor=m.model->zoomFactor();
       bookmarks=m.model->bookmarks;
       dimensions=m.dimensions;
       conversions=m.conversions;
+      singlePrecisionParameters=m.singlePrecisionParameters;
     }
 
     /// populate schema from XML data
@@ -250,13 +279,54 @@ namespace schema3
       conversions(m.conversions) {}
     
     /// create a Minsky model from this
-    operator minsky::Minsky() const;
+    operator minsky::Minsky() const {return toMinsky(TensorPayloads());}
+    /// create a Minsky model from this, with tensor data of items
+    /// absent from Item::tensorData taken from \a tensors
+    minsky::Minsky toMinsky(const TensorPayloads& tensors) const;
     /// populate a group object from this. This mutates the ids in a
     /// consistent way into the free id space of the global minsky
     /// object
-    void populateGroup(minsky::Group& g) const;
+    void populateGroup(minsky::Group& g) const {populateGroup(g, TensorPayloads());}
+    void populateGroup(minsky::Group& g, const TensorPayloads& tensors,
+                       const TensorSources& sources=TensorSources()) const;
   };
 
+  /// populate \a result from the schema 3 XML in \a input, unpacking
+  /// one wire, item or group at a time rather than building a
+  /// document tree of the whole file.
+  /// @return false if \a input is not of the current schema, in
+  /// which case it needs to be reread via Minsky(xml_unpack_t&)
+  bool streamLoad(std::istream& input, Minsky& result);
+
+  /**
+     @{
+     binary model format. The schema is serialised with pack_t, and
+     variables' tensor data stored separately, either raw or deflated,
+     at 8 byte aligned offsets, so that raw tensor data can be read in
+     place. The file layout is:
+
+     - header: magic, version, flags, directory offset and size
+     - tensor data, one chunk per variable
+     - directory: the packed schema, followed by the location of each chunk
+  */
+  /// write \a schema and \a tensors to \a output, which must be seekable
+  /// @param compress deflate tensor data
+  void writeBinary(std::ostream& output, const Minsky& schema,
+                   const TensorPayloads& tensors, bool compress=false);
+  /// read a file written by writeBinary
+  /// @throw if \a input is not a binary model
+  void readBinary(std::istream& input, Minsky& schema, TensorPayloads& tensors);
+  /// true if \a input is positioned at the start of a binary
+  /// model. \a input is left at its initial position.
+  bool isBinaryModel(std::istream& input);
+  /// move tensor data encoded in \a schema's items into \a tensors
+  void extractTensorData(Minsky& schema, TensorPayloads& tensors);
+  /// encode \a tensors into \a schema's items, for XML output
+  void embedTensorData(Minsky& schema, const TensorPayloads& tensors);
+  /// fill in the data of \a tensors referenced by \a sources, for output
+  void copyTensorSources(TensorPayloads& tensors, const TensorSources& sources);
+  /// @}
+
 
 }
 
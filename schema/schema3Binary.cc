@@ -0,0 +1,202 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+   @file binary model format. Tensor data is kept out of the packed
+   schema, so that it is neither deflated nor a85 encoded by default,
+   and is written and read as single blocks.
+*/
+
+#include "schema3.h"
+#include "zStream.h"
+#include "minsky_epilogue.h"
+#include <string.h>
+#include <stdint.h>
+
+using namespace std;
+
+namespace schema3
+{
+  namespace
+  {
+    const char binaryMagic[8]="MinskyB";
+    /// incremented whenever the packed schema changes, as it is
+    /// read positionally. Version 2 added
+    /// Minsky::singlePrecisionParameters.
+    const uint32_t binaryVersion=2;
+    /// tensor chunks start at multiples of this
+    const uint64_t alignment=8;
+
+    enum BinaryFlags {compressedTensors=1};
+
+    struct BinaryHeader
+    {
+      char magic[sizeof(binaryMagic)];
+      uint32_t version=binaryVersion;
+      uint32_t flags=0;
+      uint64_t directoryOffset=0, directorySize=0;
+      BinaryHeader() {memcpy(magic, binaryMagic, sizeof(magic));}
+    };
+    static_assert(sizeof(BinaryHeader)==32, "binary header must be packed");
+  }
+
+  void writeBinary(ostream& output, const Minsky& schema,
+                   const TensorPayloads& tensors, bool compress)
+  {
+    auto start=output.tellp();
+    BinaryHeader header;
+    if (compress) header.flags|=compressedTensors;
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    pack_t directory;
+    directory<<schema<<uint64_t(tensors.size());
+    uint64_t offset=sizeof(header);
+    static const char padding[alignment]={};
+    for (auto& i: tensors)
+      {
+        const pack_t& data=*i.second;
+        const char* chunk=data.data();
+        uint64_t size=data.size();
+        bool compressed=false;
+        vector<unsigned char> zbuf;
+        if (compress && size>0)
+          {
+            zbuf.resize(compressBound(size));
+            minsky::DeflateZStream zs(data, zbuf);
+            zs.deflate();
+            // store incompressible data raw
+            if (zs.total_out<size)
+              {
+                chunk=reinterpret_cast<const char*>(zbuf.data());
+                size=zs.total_out;
+                compressed=true;
+              }
+          }
+        directory<<i.first<<offset<<size<<uint64_t(data.size())<<compressed;
+        output.write(chunk, size);
+        auto pad=(alignment-size%alignment)%alignment;
+        output.write(padding, pad);
+        offset+=size+pad;
+      }
+
+    header.directoryOffset=offset;
+    header.directorySize=directory.size();
+    output.write(directory.data(), directory.size());
+    output.seekp(start);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.seekp(0, ios::end);
+    if (!output)
+      throw error("failed to write binary model");
+  }
+
+  void readBinary(istream& input, Minsky& schema, TensorPayloads& tensors)
+  {
+    auto start=input.tellg();
+    BinaryHeader header;
+    if (!input.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        memcmp(header.magic, binaryMagic, sizeof(header.magic))!=0)
+      throw error("not a binary Minsky model");
+    if (header.version!=binaryVersion)
+      throw error("binary model version %d not supported", int(header.version));
+
+    pack_t directory(header.directorySize);
+    input.seekg(start+streamoff(header.directoryOffset));
+    if (!input.read(directory.data(), header.directorySize))
+      throw error("binary model truncated");
+    uint64_t numTensors;
+    directory>>schema>>numTensors;
+
+    tensors.clear();
+    for (uint64_t i=0; i<numTensors; ++i)
+      {
+        int id;
+        uint64_t offset, size, rawSize;
+        bool compressed;
+        directory>>id>>offset>>size>>rawSize>>compressed;
+        auto buf=make_shared<pack_t>(size);
+        input.seekg(start+streamoff(offset));
+        if (!input.read(buf->data(), size))
+          throw error("binary model truncated");
+        if (compressed)
+          {
+            minsky::InflateZStream zs(*buf);
+            zs.inflate();
+            if (zs.total_out!=rawSize)
+              throw error("corrupt tensor data for item %d", id);
+            zs.output.resize(rawSize);
+            buf=make_shared<pack_t>(move(zs.output));
+          }
+        tensors[id]=buf;
+      }
+  }
+
+  bool isBinaryModel(istream& input)
+  {
+    auto start=input.tellg();
+    char magic[sizeof(binaryMagic)];
+    bool r=input.read(magic, sizeof(magic)) &&
+      memcmp(magic, binaryMagic, sizeof(magic))==0;
+    input.clear();
+    input.seekg(start);
+    return r;
+  }
+
+  void extractTensorData(Minsky& schema, TensorPayloads& tensors)
+  {
+    for (auto& i: schema.items)
+      if (i.tensorData)
+        {
+          tensors[i.id]=make_shared<pack_t>(minsky::decode(*i.tensorData));
+          i.tensorData.reset();
+        }
+  }
+
+  void embedTensorData(Minsky& schema, const TensorPayloads& tensors)
+  {
+    for (auto& i: schema.items)
+      {
+        auto t=tensors.find(i.id);
+        if (t!=tensors.end())
+          i.tensorData=minsky::encode(*t->second);
+      }
+  }
+
+  void copyTensorSources(TensorPayloads& tensors, const TensorSources& sources)
+  {
+    for (auto& i: sources)
+      {
+        auto t=tensors.find(i.first);
+        if (t==tensors.end() || !i.second) continue;
+        auto& structure=*t->second;
+        uint64_t n=i.second->size();
+        if (structure.size()<sizeof(n))
+          throw error("corrupt tensor data for item %d", i.first);
+        auto buf=make_shared<pack_t>(sizeof(n)+n*sizeof(double));
+        memcpy(buf->data(), &n, sizeof(n));
+        auto data=reinterpret_cast<double*>(buf->data()+sizeof(n));
+        if (auto d=i.second->data())
+          memcpy(data, d, n*sizeof(double));
+        else
+          i.second->load(data);
+        // the structure follows the data, in place of the empty data's count
+        buf->packraw(structure.data()+sizeof(n), structure.size()-sizeof(n));
+        t->second=buf;
+      }
+  }
+}
@@ -0,0 +1,276 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+   @file streaming reader for schema 3 files. The file is tokenised
+   as it is read, and each wire, item and group record is unpacked on
+   its own as soon as it is complete, so a document tree of the whole
+   file is never built. Records are unpacked by the same classdesc
+   generated xml_unpack used for whole files, so the resulting schema
+   is identical to that obtained by the document loader.
+*/
+
+#include "schema3.h"
+#include "minsky_epilogue.h"
+#include <sstream>
+#include <string.h>
+
+using namespace std;
+
+namespace schema3
+{
+  namespace
+  {
+    /// pull tokeniser over an XML stream, sufficient for the files
+    /// written by xml_pack. Each token retains its raw text, so that
+    /// records can be passed on to xml_unpack unchanged.
+    class XMLTokeniser
+    {
+      streambuf& buf;
+
+      char get() {
+        auto c=buf.sbumpc();
+        if (c==char_traits<char>::eof())
+          throw error("unexpected end of file");
+        return c;
+      }
+      /// append characters to raw up to and including \a terminator
+      void readUntil(const char* terminator) {
+        size_t n=strlen(terminator);
+        do raw+=get();
+        while (raw.size()<n || raw.compare(raw.size()-n, n, terminator)!=0);
+      }
+      /// element name of a start or end tag, following \a skip characters
+      void tagName(size_t skip) {
+        auto end=raw.find_first_of(" \t\r\n/>", skip);
+        name=raw.substr(skip, end-skip);
+      }
+    public:
+      enum Type {text, start, end, empty, cdata, other, eof};
+      Type type=other;
+      string name, raw;
+
+      explicit XMLTokeniser(istream& i): buf(*i.rdbuf()) {}
+
+      Type next() {
+        raw.clear();
+        name.clear();
+        auto c=buf.sgetc();
+        if (c==char_traits<char>::eof())
+          return type=eof;
+        if (c!='<')
+          {
+            for (; c!=char_traits<char>::eof() && c!='<'; c=buf.sgetc())
+              raw+=char(buf.sbumpc());
+            return type=text;
+          }
+        raw+=get();
+        raw+=get();
+        switch (raw[1])
+          {
+          case '?':
+            readUntil("?>");
+            return type=other;
+          case '!':
+            raw+=get();
+            if (raw[2]=='[')
+              {
+                readUntil("]]>");
+                return type=cdata;
+              }
+            readUntil(raw[2]=='-'? "-->": ">");
+            return type=other;
+          case '/':
+            readUntil(">");
+            tagName(2);
+            return type=end;
+          default:
+            // attribute values may contain '>'
+            for (char quote=0; raw.back()!='>' || quote; )
+              {
+                auto c=raw.back();
+                if (quote && c==quote) quote=0;
+                else if (!quote && (c=='"' || c=='\'')) quote=c;
+                raw+=get();
+              }
+            tagName(1);
+            return type=raw[raw.size()-2]=='/'? empty: start;
+          }
+      }
+
+      /// append the remainder of the element just started to \a content
+      void readElement(string& content) {
+        for (int depth=1; depth>0; )
+          {
+            switch (next())
+              {
+              case start: depth++; break;
+              case end: depth--; break;
+              case eof: throw error("unexpected end of file");
+              default: break;
+              }
+            content+=raw;
+          }
+      }
+    };
+
+    template <class T> T unpackRecord(const string& record, const string& name)
+    {
+      istringstream is(record);
+      xml_unpack_t unpacker(is);
+      T r;
+      xml_unpack(unpacker, name, r);
+      return r;
+    }
+
+    void setTensorData(Wire&, string&) {}
+    void setTensorData(Item& item, string& data)
+    {
+      // swapped in to avoid copying what may be a large buffer
+      string& tensorData=*item.tensorData;
+      tensorData.swap(data);
+    }
+
+    /// read a tensorData element's content, up to its end tag. Only
+    /// the CDATA payload is kept, as that is all that is decoded.
+    void readTensorData(XMLTokeniser& xml, string& data)
+    {
+      for (int depth=1; depth>0; )
+        switch (xml.next())
+          {
+          case XMLTokeniser::start: depth++; break;
+          case XMLTokeniser::end: depth--; break;
+          case XMLTokeniser::eof: throw error("unexpected end of file");
+          case XMLTokeniser::cdata:
+            data.append(xml.raw, 9, xml.raw.size()-12); // strip <![CDATA[ ]]>
+            break;
+          default: break;
+          }
+    }
+
+    /// read records of a container element such as <items>, up to its end tag
+    template <class T>
+    void readRecords(XMLTokeniser& xml, vector<T>& records)
+    {
+      for (;;)
+        switch (xml.next())
+          {
+          case XMLTokeniser::end: return;
+          case XMLTokeniser::eof: throw error("unexpected end of file");
+          case XMLTokeniser::empty:
+            records.push_back(unpackRecord<T>(xml.raw, xml.name));
+            break;
+          case XMLTokeniser::start:
+            {
+              string name=xml.name, record=xml.raw, tensorData;
+              bool hasTensorData=false;
+              for (int depth=1; depth>0; )
+                {
+                  switch (xml.next())
+                    {
+                    case XMLTokeniser::start:
+                      if (depth==1 && xml.name=="tensorData")
+                        {
+                          // kept out of the record, to be swapped in afterwards
+                          hasTensorData=true;
+                          readTensorData(xml, tensorData);
+                          continue;
+                        }
+                      depth++;
+                      break;
+                    case XMLTokeniser::end: depth--; break;
+                    case XMLTokeniser::eof: throw error("unexpected end of file");
+                    default: break;
+                    }
+                  record+=xml.raw;
+                }
+              records.push_back(unpackRecord<T>(record, name));
+              if (hasTensorData)
+                setTensorData(records.back(), tensorData);
+              break;
+            }
+          default: break;
+          }
+    }
+  }
+
+  bool streamLoad(istream& input, Minsky& result)
+  {
+    XMLTokeniser xml(input);
+    while (xml.next()!=XMLTokeniser::start)
+      if (xml.type==XMLTokeniser::eof || xml.type==XMLTokeniser::empty)
+        return false;
+    if (xml.name!="Minsky") return false;
+
+    result=Minsky();
+    // elements other than records are collected, and unpacked together at the end
+    string header="<Minsky>";
+    bool currentVersion=false;
+    for (;;)
+      switch (xml.next())
+        {
+        case XMLTokeniser::end:
+          {
+            if (!currentVersion) return false;
+            header+="</Minsky>";
+            auto h=unpackRecord<Minsky>(header, "Minsky");
+            result.schemaVersion=h.schemaVersion;
+            result.minskyVersion=h.minskyVersion;
+            result.rungeKutta=h.rungeKutta;
+            result.zoomFactor=h.zoomFactor;
+            result.bookmarks=h.bookmarks;
+            result.dimensions=h.dimensions;
+            result.conversions=h.conversions;
+            result.singlePrecisionParameters=h.singlePrecisionParameters;
+            return true;
+          }
+        case XMLTokeniser::eof: throw error("unexpected end of file");
+        case XMLTokeniser::empty:
+          header+=xml.raw;
+          break;
+        case XMLTokeniser::start:
+          if (xml.name=="wires" || xml.name=="items" || xml.name=="groups")
+            {
+              // older schemas are converted via the document loader
+              if (!currentVersion) return false;
+              if (xml.name=="wires")
+                readRecords(xml, result.wires);
+              else if (xml.name=="items")
+                readRecords(xml, result.items);
+              else
+                readRecords(xml, result.groups);
+            }
+          else
+            {
+              bool version=xml.name=="schemaVersion";
+              header+=xml.raw;
+              string content;
+              xml.readElement(content);
+              if (version)
+                {
+                  currentVersion=atoi(content.c_str())==Minsky::version;
+                  if (!currentVersion) return false;
+                }
+              header+=content;
+            }
+          break;
+        default: break;
+        }
+  }
+}
@@ -23,37 +23,234 @@
 #include "a85.h"
 #include "zStream.h"
 #include <zlib.h>
+#include <boost/thread.hpp>
+#include <atomic>
+#include <exception>
 using namespace std;
 
 namespace minsky
 {
-  classdesc::pack_t decode(const classdesc::CDATA& data)
+  EncodeSettings encodeSettings;
+
+  namespace
   {
-    string trimmed; //trim whitespace
-    for (auto c: data)
-      if (!isspace(c)) trimmed+=c;
+    /**
+       Data larger than EncodeSettings::blockSize is deflated as
+       independent blocks, preceded by a header of:
+
+       - magic, which is not a valid zlib stream header
+       - uncompressed size
+       - block size
+       - number of blocks
+       - compressed size of each block
+
+       so that it can be inflated in parallel, directly into a buffer
+       of the right size. Data in a single zlib stream is still read.
+    */
+    const char blockMagic[]={'M','Z','B','1'};
+
+    /// contiguous range of bytes, as input to DeflateZStream
+    struct Bytes
+    {
+      const char* begin;
+      size_t n;
+      const char* data() const {return begin;}
+      size_t size() const {return n;}
+    };
+
+    /// call f(i) for i in [0,n), over a pool of threads
+    template <class F> void parallelFor(size_t n, F f)
+    {
+      size_t numThreads=min<size_t>(n, boost::thread::hardware_concurrency());
+      if (numThreads<=1)
+        {
+          for (size_t i=0; i<n; ++i) f(i);
+          return;
+        }
+      atomic<size_t> next{0};
+      exception_ptr err;
+      boost::mutex errMutex;
+      boost::thread_group threads;
+      for (size_t t=0; t<numThreads; ++t)
+        threads.create_thread([&]() {
+            try
+              {
+                for (size_t i; (i=next++)<n; ) f(i);
+              }
+            catch (...)
+              {
+                boost::lock_guard<boost::mutex> lock(errMutex);
+                if (!err) err=current_exception();
+              }
+          });
+      threads.join_all();
+      if (err) rethrow_exception(err);
+    }
+
+    void putUint64(vector<unsigned char>& buf, size_t offset, uint64_t x)
+    {memcpy(&buf[offset],&x,sizeof(x));}
+    uint64_t getUint64(const vector<unsigned char>& buf, size_t offset)
+    {
+      if (offset+sizeof(uint64_t)>buf.size())
+        throw runtime_error("compressed data truncated");
+      uint64_t x;
+      memcpy(&x,&buf[offset],sizeof(x));
+      return x;
+    }
+
+    void deflateBlocks(const classdesc::pack_t& buf, vector<unsigned char>& zbuf)
+    {
+      size_t blockSize=encodeSettings.blockSize;
+      size_t numBlocks=(buf.size()+blockSize-1)/blockSize;
+      vector<vector<unsigned char>> blocks(numBlocks);
+      parallelFor(numBlocks, [&](size_t i) {
+          Bytes input{buf.data()+i*blockSize, min(blockSize, buf.size()-i*blockSize)};
+          blocks[i].resize(compressBound(input.size()));
+          DeflateZStream zs(input, blocks[i], encodeSettings.level);
+          zs.deflate();
+          blocks[i].resize(zs.total_out);
+        });
+
+      size_t headerSize=sizeof(blockMagic)+(3+numBlocks)*sizeof(uint64_t), size=headerSize;
+      for (auto& i: blocks) size+=i.size();
+      zbuf.resize(size);
+      memcpy(&zbuf[0],blockMagic,sizeof(blockMagic));
+      size_t offset=sizeof(blockMagic);
+      for (uint64_t x: {uint64_t(buf.size()), uint64_t(blockSize), uint64_t(numBlocks)})
+        {
+          putUint64(zbuf,offset,x);
+          offset+=sizeof(x);
+        }
+      for (auto& i: blocks)
+        {
+          putUint64(zbuf,offset,i.size());
+          offset+=sizeof(uint64_t);
+        }
+      for (auto& i: blocks)
+        {
+          memcpy(&zbuf[offset],i.data(),i.size());
+          offset+=i.size();
+        }
+    }
+
+    vector<unsigned char> fromA85(const classdesc::CDATA& data)
+    {
+      string trimmed; //trim whitespace
+      trimmed.reserve(data.size());
+      for (auto c: data)
+        if (!isspace(c)) trimmed+=c;
     
-    vector<unsigned char> zbuf(a85::size_for_bin(trimmed.size()));
-    // reverse transformation required to avoid the escape sequence ']]>'
-    replace(trimmed.begin(),trimmed.end(),'~',']'); 
-    a85::from_a85(trimmed.data(), trimmed.size(),zbuf.data());
-
-    InflateZStream zs(zbuf);
-    zs.inflate();
-    return move(zs.output);
+      vector<unsigned char> zbuf(a85::size_for_bin(trimmed.size()));
+      // reverse transformation required to avoid the escape sequence ']]>'
+      replace(trimmed.begin(),trimmed.end(),'~',']'); 
+      a85::from_a85(trimmed.data(), trimmed.size(),zbuf.data());
+      return zbuf;
+    }
+
+    classdesc::CDATA toA85(const vector<unsigned char>& zbuf, size_t zsize)
+    {
+      vector<char> cbuf(a85::size_for_a85(zsize,false));
+      a85::to_a85(&zbuf[0],zsize, &cbuf[0], false);
+      // this ensures that the escape sequence ']]>' never appears in the data
+      replace(cbuf.begin(),cbuf.end(),']','~');
+      return classdesc::CDATA(cbuf.begin(),cbuf.end());
+    }
+  }
+
+  EncodedData::EncodedData(const classdesc::CDATA& data): zbuf(fromA85(data))
+  {
+    if (zbuf.size()<sizeof(blockMagic) || memcmp(zbuf.data(),blockMagic,sizeof(blockMagic))!=0)
+      {
+        InflateZStream zs(zbuf);
+        zs.inflate();
+        zs.output.resize(zs.total_out); // drop unused capacity
+        decoded.swap(zs.output);
+        m_size=decoded.size();
+        zbuf.clear();
+        zbuf.shrink_to_fit();
+        return;
+      }
+
+    size_t offset=sizeof(blockMagic);
+    m_size=getUint64(zbuf,offset);
+    blockSize=getUint64(zbuf,offset+8);
+    auto numBlocks=getUint64(zbuf,offset+16);
+    offset+=24;
+    if (blockSize==0 || numBlocks!=(m_size+blockSize-1)/blockSize)
+      throw runtime_error("corrupt compressed data");
+    blockStart.resize(numBlocks+1, offset+numBlocks*sizeof(uint64_t));
+    for (size_t i=0; i<numBlocks; ++i)
+      blockStart[i+1]=blockStart[i]+getUint64(zbuf,offset+i*sizeof(uint64_t));
+    if (blockStart.back()>zbuf.size())
+      throw runtime_error("compressed data truncated");
+  }
+
+  void EncodedData::decode(size_t offset, size_t n, char* dest) const
+  {
+    if (offset+n>m_size || offset+n<offset)
+      throw runtime_error("decoded data range out of bounds");
+    if (n==0) return;
+    if (blockStart.empty())
+      {
+        memcpy(dest, decoded.data()+offset, n);
+        return;
+      }
+
+    size_t first=offset/blockSize, last=(offset+n-1)/blockSize;
+    parallelFor(last-first+1, [&](size_t j) {
+        size_t i=first+j, begin=i*blockSize, size=min<size_t>(blockSize, m_size-begin);
+        auto inflate=[&](char* out) {
+          InflateBlockZStream zs(&zbuf[blockStart[i]], blockStart[i+1]-blockStart[i], out, size);
+          zs.inflate();
+        };
+        if (begin>=offset && begin+size<=offset+n)
+          inflate(dest+(begin-offset));
+        else
+          {
+            // block straddles the range, so only part of it is copied
+            vector<char> block(size);
+            inflate(block.data());
+            size_t from=max(begin,offset), to=min(begin+size,offset+n);
+            memcpy(dest+(from-offset), block.data()+(from-begin), to-from);
+          }
+      });
+  }
+
+  classdesc::CDATA EncodedData::encoded() const
+  {
+    if (blockStart.empty())
+      return encode(decoded);
+    return toA85(zbuf, zbuf.size());
+  }
+
+  classdesc::pack_t decode(const classdesc::CDATA& data)
+  {
+    EncodedData encoded(data);
+    if (encoded.blockStart.empty())
+      return move(encoded.decoded);
+    classdesc::pack_t r(encoded.size());
+    encoded.decode(0, r.size(), r.data());
+    return r;
   }
 
 
   classdesc::CDATA encode(const classdesc::pack_t& buf)
   {
-    vector<unsigned char> zbuf(buf.size());
-    DeflateZStream zs(buf, zbuf);
-    zs.deflate();
-    
-    vector<char> cbuf(a85::size_for_a85(zs.total_out,false));
-    a85::to_a85(&zbuf[0],zs.total_out, &cbuf[0], false);
-    // this ensures that the escape sequence ']]>' never appears in the data
-    replace(cbuf.begin(),cbuf.end(),']','~');
-    return CDATA(cbuf.begin(),cbuf.end());
+    vector<unsigned char> zbuf;
+    size_t zsize;
+    if (buf.size()>encodeSettings.blockSize)
+      {
+        deflateBlocks(buf, zbuf);
+        zsize=zbuf.size();
+      }
+    else
+      {
+        // small data is written as a single zlib stream, as by earlier versions
+        zbuf.resize(compressBound(buf.size()));
+        DeflateZStream zs(buf, zbuf, encodeSettings.level);
+        zs.deflate();
+        zsize=zs.total_out;
+      }
+    return toA85(zbuf, zsize);
   }
 }
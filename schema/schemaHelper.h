@@ -105,11 +105,43 @@ namespace minsky
       throw error("Minsky schema version %d not supported",currentSchema.schemaVersion);
   }
 
+  /// compression settings used by encode()
+  struct EncodeSettings
+  {
+    int level=9; ///< zlib compression level, 0-9
+    /// data larger than this is split into blocks of this size,
+    /// deflated concurrently
+    size_t blockSize=1<<22;
+  };
+  extern EncodeSettings encodeSettings;
+
   /// decode ascii-encoded representation to binary data
   classdesc::pack_t decode(const classdesc::CDATA&);
   /// encode binary data to ascii-encoded 
   classdesc::CDATA encode(const classdesc::pack_t&);
 
+  /// data encoded by encode(), decoded on demand. Where it was
+  /// encoded as blocks, a range of it is decoded without decoding
+  /// the rest; otherwise it is decoded on construction.
+  class EncodedData
+  {
+    std::vector<unsigned char> zbuf;
+    classdesc::pack_t decoded; ///< data not encoded as blocks
+    size_t m_size=0, blockSize=0;
+    /// offset of each block in zbuf, and of the end of the last
+    std::vector<size_t> blockStart;
+    friend classdesc::pack_t decode(const classdesc::CDATA&);
+  public:
+    explicit EncodedData(const classdesc::CDATA&);
+    /// size of the decoded data
+    size_t size() const {return m_size;}
+    /// decode \a n bytes starting at \a offset into \a dest
+    void decode(size_t offset, size_t n, char* dest) const;
+    /// the data encoded as by encode(). Block encoded data is
+    /// returned without being decoded.
+    classdesc::CDATA encoded() const;
+  };
+
   
 }
 
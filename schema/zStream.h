@@ -45,11 +45,11 @@ namespace minsky
   struct DeflateZStream: public ZStream
   {
     template <class I, class O>
-    DeflateZStream(const I& input, O& output):
+    DeflateZStream(const I& input, O& output, int level=9):
       ZStream((Bytef*)input.data(), input.size(),
               (Bytef*)output.data(), output.size())
     {
-      if (deflateInit(this,9)!=Z_OK) throwError();
+      if (deflateInit(this,level)!=Z_OK) throwError();
     }
     ~DeflateZStream() {deflateEnd(this);}
     void deflate() {
@@ -92,6 +92,20 @@ namespace minsky
     }
   };
   
+  /// inflate into a preallocated buffer of the known uncompressed size
+  struct InflateBlockZStream: public ZStream
+  {
+    InflateBlockZStream(const void* input, size_t inputSize, void* output, size_t outputSize):
+      ZStream((Bytef*)input, inputSize, (Bytef*)output, outputSize)
+    {
+      if (inflateInit(this)!=Z_OK) throwError();
+    }
+    ~InflateBlockZStream() {inflateEnd(this);}
+    void inflate() {
+      if (::inflate(this,Z_FINISH)!=Z_STREAM_END || avail_out) throwError();
+    }
+  };
+
   struct InflateFileZStream: public ZStream
   {
     std::string output;
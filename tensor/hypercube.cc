@@ -20,16 +20,32 @@
 #include "hypercube.h"
 #include <error.h>
 #include <set>
+#include <unordered_set>
 
 using namespace std;
 
 namespace civita
 {
-  std::vector<unsigned> Hypercube::dims() const
+  vector<unsigned> Hypercube::dims() const
   {
-    std::vector<unsigned> d;
-    for (auto& i: xvectors) d.push_back(i.size());
-    return d;
+    vector<unsigned> r;
+    r.reserve(xvectors.size());
+    for (auto& i: xvectors)
+      r.push_back(i.size());
+    return r;
+  }
+
+  vector<size_t> Hypercube::strides() const
+  {
+    vector<size_t> r;
+    r.reserve(xvectors.size());
+    size_t stride=1;
+    for (auto& i: xvectors)
+      {
+        r.push_back(stride);
+        stride*=i.size();
+      }
+    return r;
   }
 
   const std::vector<unsigned>& Hypercube::dims(const std::vector<unsigned>& d) {
@@ -39,7 +55,7 @@ namespace civita
         xvectors.emplace_back(std::to_string(i));
         xvectors.back().dimension.type=Dimension::value;
         for (size_t j=0; j<d[i]; ++j)
-          xvectors.back().emplace_back(double(j));
+          xvectors.back().push_back(double(j));
       }
     return d;
   }
@@ -59,29 +75,40 @@ namespace civita
         for (j=0; j<xvectors.size(); ++j)
           if (xvectors[j].name==i.name)
             {
-              if (xvectors[j].dimension.type!=i.dimension.type)
+              auto& alabels=i.labels();
+              auto& labels=xvectors[j].labels();
+              if (xvectors[j].dimension.type!=i.dimension.type ||
+                  (!labels.empty() && !alabels.empty() && labels.type()!=alabels.type()))
                 throw ecolab::error("dimension %s has inconsistent type",i.name.c_str());
               // only match labels for string dimensions. Other types are interpolated.
               XVector newLabels;
-              switch (i.dimension.type)
+              switch (labels.type())
                 {
                 case Dimension::string:
                   {
-                    set<string> alabels;
-                    for (auto& k: i)
-                      alabels.insert(str(k));
-                    for (auto k: xvectors[j])
-                      if (alabels.count(str(k)))
-                        newLabels.push_back(k);
+                    // string ids are local to each column's table, so
+                    // labels are matched by value
+                    unordered_set<string> astrings;
+                    for (size_t k=0; k<alabels.size(); ++k)
+                      astrings.insert(alabels.stringLabel(k));
+                    for (size_t k=0; k<labels.size(); ++k)
+                      if (astrings.count(labels.stringLabel(k)))
+                        newLabels.push_back(xvectors[j][k]);
                     break;
                   }
                 default:
                   {
                     // set overlapping value ranges
-                    set<boost::any, AnyLess> vals(i.begin(), i.end());
-                    for (auto k: xvectors[j])
-                      if (diff(k, *vals.begin())>=0 && diff(k, *vals.rbegin())<=0)
-                        newLabels.push_back(k);
+                    if (alabels.empty()) break;
+                    size_t lo=0, hi=0;
+                    for (size_t k=1; k<alabels.size(); ++k)
+                      {
+                        if (alabels.compare(k,lo)<0) lo=k;
+                        if (alabels.compare(k,hi)>0) hi=k;
+                      }
+                    for (size_t k=0; k<labels.size(); ++k)
+                      if (labels.compare(k,alabels,lo)>=0 && labels.compare(k,alabels,hi)<=0)
+                        newLabels.push_back(xvectors[j][k]);
                     break;
                   }
                 }
@@ -113,32 +140,90 @@ namespace civita
       }
   }
 
-    /// split lineal index into components along each dimension
-    vector<size_t> Hypercube::splitIndex(size_t i) const
-    {
-      std::vector<size_t> splitIndex;
-      for (auto& d: dims())
-        {
-          auto res=div(ssize_t(i),ssize_t(d));
-          splitIndex.push_back(res.rem);
-          i=res.quot;
-        }
-      return splitIndex;
-    }
+  vector<size_t> Hypercube::splitIndex(size_t i) const
+  {
+    vector<size_t> r;
+    splitIndex(i,r);
+    return r;
+  }
+
+  void Hypercube::splitIndex(size_t i, vector<size_t>& splitIndex) const
+  {
+    splitIndex.resize(xvectors.size());
+    for (size_t j=0; j<xvectors.size(); ++j)
+      {
+        size_t d=xvectors[j].size();
+        auto quot=i/d;
+        splitIndex[j]=i-quot*d;
+        i=quot;
+      }
+  }
   
-    /// combine a split index into a lineal hypercube index
   size_t Hypercube::linealIndex(const std::vector<size_t>& splitIndex) const
+  {
+    assert(xvectors.size()==splitIndex.size());
+    size_t index=0, stride=1;
+    for (size_t i=0; i<xvectors.size(); ++i)
+      {
+        index+=splitIndex[i]*stride;
+        stride*=xvectors[i].size();
+      }
+    return index;
+  }
+
+  namespace
+  {
+    vector<size_t> sizes(const Hypercube& hc)
     {
-      assert(dims().size()==splitIndex.size());
-      size_t index=0, stride=1;
-      auto dd=dims();
-      for (size_t i=0; i<dd.size(); ++i)
-        {
-          index+=splitIndex[i]*stride;
-          stride*=dd[i];
-        }
-      return index;
+      vector<size_t> r;
+      for (auto& i: hc.xvectors)
+        r.push_back(i.size());
+      return r;
     }
+  }
 
-}
+  Odometer::Odometer(const Hypercube& hc, const vector<size_t>& targetStrides):
+    Odometer(sizes(hc), targetStrides) {}
+
+  Odometer::Odometer(const vector<size_t>& dims, const vector<size_t>& targetStrides):
+    m_dims(dims), m_strides(targetStrides), m_index(m_dims.size())
+  {
+    assert(m_strides.size()==m_dims.size());
+  }
+
+  void Odometer::mapAxis(size_t axis, const vector<size_t>& map)
+  {
+    m_target-=targetOffset(axis,m_index[axis]);
+    m_mappedAxis=axis;
+    m_axisMap=map;
+    m_target+=targetOffset(axis,m_index[axis]);
+  }
+  
+  void Odometer::seek(size_t position)
+  {
+    m_position=position;
+    m_target=0;
+    for (size_t axis=0; axis<m_dims.size(); ++axis)
+      {
+        if (!m_dims[axis]) {m_index[axis]=0; continue;} // empty hypercube
+        auto quot=position/m_dims[axis];
+        m_index[axis]=position-quot*m_dims[axis];
+        m_target+=targetOffset(axis,m_index[axis]);
+        position=quot;
+      }
+  }
+
+  size_t Odometer::targetOf(size_t position) const
+  {
+    size_t target=0;
+    for (size_t axis=0; axis<m_dims.size(); ++axis)
+      {
+        if (!m_dims[axis]) continue; // empty hypercube
+        auto quot=position/m_dims[axis];
+        target+=targetOffset(axis,position-quot*m_dims[axis]);
+        position=quot;
+      }
+    return target;
+  }
 
+}
@@ -21,6 +21,7 @@
 #define CIVITA_HYPERCUBE_H
 
 #include "xvector.h"
+#include <limits>
 
 namespace civita
 {
@@ -41,6 +42,9 @@ namespace civita
     /// dimensions of this variable value. dims.size() is the rank, a
     ///scalar variable has dims[0]=1, etc.
     std::vector<unsigned> dims() const;
+    /// lineal index increment corresponding to a unit step along each
+    /// dimension
+    std::vector<size_t> strides() const;
     
     /// number of elements in the hypercube, equaly to the product of
     /// dimensions
@@ -60,9 +64,81 @@ namespace civita
 
     /// split lineal index into components along each dimension
     std::vector<size_t> splitIndex(size_t) const;
+    /// split lineal index into \a splitIndex, reusing its storage
+    void splitIndex(size_t, std::vector<size_t>& splitIndex) const;
     /// combine a split index into a lineal hypercube index
     size_t linealIndex(const std::vector<size_t>&) const;
   };
+
+  /// Walks the index space of a hypercube in lineal order, maintaining
+  /// the split index incrementally, like an odometer. Alongside the
+  /// position, it tracks a target lineal index, given by target strides
+  /// per axis. This maps the walk onto a view of another hypercube:
+  /// permuted axes have permuted strides, axes that are dropped have
+  /// stride 0. One axis may additionally have its labels remapped
+  /// through a lookup table.
+  class Odometer
+  {
+    std::vector<size_t> m_dims, m_strides, m_index;
+    size_t m_position=0, m_target=0;
+    size_t m_mappedAxis=std::numeric_limits<size_t>::max();
+    std::vector<size_t> m_axisMap;
+  public:
+    Odometer() {}
+    /// walk \a hc, with the target index computed using \a targetStrides
+    Odometer(const Hypercube& hc, const std::vector<size_t>& targetStrides);
+    /// walk a hypercube of dimensions \a dims
+    Odometer(const std::vector<size_t>& dims, const std::vector<size_t>& targetStrides);
+    /// remap labels along \a axis via \a map before applying the
+    /// target stride
+    void mapAxis(size_t axis, const std::vector<size_t>& map);
+
+    /// current position in the walked hypercube
+    size_t position() const {return m_position;}
+    /// target lineal index corresponding to position()
+    size_t target() const {return m_target;}
+    /// split index of position()
+    const std::vector<size_t>& index() const {return m_index;}
+    /// dimensions of the walked hypercube
+    const std::vector<size_t>& dims() const {return m_dims;}
+    /// target strides
+    const std::vector<size_t>& strides() const {return m_strides;}
+    /// contribution to target() of label \a i along \a axis
+    size_t targetOffset(size_t axis, size_t i) const
+    {return (axis==m_mappedAxis? m_axisMap[i]: i)*m_strides[axis];}
+
+    /// advance one position
+    Odometer& operator++() {
+      ++m_position;
+      for (size_t axis=0; axis<m_index.size(); ++axis)
+        {
+          auto& i=m_index[axis];
+          m_target-=targetOffset(axis,i);
+          if (++i<m_dims[axis])
+            {
+              m_target+=targetOffset(axis,i);
+              return *this;
+            }
+          i=0;
+          m_target+=targetOffset(axis,0);
+        }
+      return *this;
+    }
+    /// move to an arbitrary position
+    void seek(size_t position);
+    /// target index of \a position, leaving the odometer unchanged, so
+    /// that a shared odometer can be read concurrently
+    size_t targetOf(size_t position) const;
+    /// move to \a position, incrementally if it is the next one, and
+    /// return the target index
+    size_t operator()(size_t position) {
+      if (position==m_position+1)
+        operator++();
+      else if (position!=m_position)
+        seek(position);
+      return m_target;
+    }
+  };
   
 }
 
@@ -53,6 +53,11 @@ namespace civita
         return *this;
       }
 
+      /// assign from a sequence of hypercube indices already sorted
+      /// and free of duplicates
+      template <class I>
+      void assignSorted(I begin, I end) {index.assign(begin, end);}
+
       /// return hypercube index corresponding to lineal index i 
       size_t operator[](size_t i) const {return index.empty()? i: index[i];}
       // invariant, should always be true
@@ -65,6 +70,8 @@ namespace civita
       size_t linealOffset(size_t h) const;
       /// insert value into v at hc index h, maintaining sorted order
       void insert(size_t h, std::vector<double>& v, double x);
+      bool operator==(const Index& x) const {return index==x.index;}
+      bool operator!=(const Index& x) const {return index!=x.index;}
       std::vector<size_t>::const_iterator begin() const {return index.begin();}
       std::vector<size_t>::const_iterator end() const {return index.end();}
     };
@@ -0,0 +1,295 @@
+/*
+  @copyright Russell Standish 2019
+  @author Russell Standish
+  This file is part of Civita.
+
+  Civita is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Civita is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Civita.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "labelColumn.h"
+#include <error.h>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <functional>
+#include "minsky_epilogue.h"
+using ecolab::error;
+
+using namespace std;
+using namespace boost;
+using namespace boost::posix_time;
+using namespace boost::gregorian;
+
+namespace civita
+{
+  StringTable::StringTable(const StringTable& x)
+  {
+    ids.reserve(x.size());
+    strings.reserve(x.size());
+    for (auto i: x.strings)
+      intern(*i);
+  }
+
+  uint32_t StringTable::intern(const string& s)
+  {
+    auto i=ids.find(s);
+    if (i!=ids.end()) return i->second;
+    if (strings.size()>=numeric_limits<uint32_t>::max())
+      throw error("string table exhausted");
+    auto id=uint32_t(strings.size());
+    // unordered_map nodes are stable, so the key can be referenced directly
+    strings.push_back(&ids.emplace(s,id).first->first);
+    return id;
+  }
+
+  namespace
+  {
+    const ptime epoch(date(1970,Jan,1));
+    const int64_t notATime=numeric_limits<int64_t>::min();
+    const int64_t negInfTime=notATime+1;
+    const int64_t posInfTime=numeric_limits<int64_t>::max();
+
+    template <class T> int cmp(const T& x, const T& y)
+    {return x<y? -1: y<x? 1: 0;}
+
+    template <class T> void eraseRange(vector<T>& v, size_t first, size_t last)
+    {v.erase(v.begin()+first, v.begin()+last);}
+
+    // ids ordered by their string value. Ranks are ordered as the
+    // strings are, so sorting can compare integers.
+    unordered_map<uint32_t,size_t> stringRanks(const vector<uint32_t>& ids, const StringTable& table)
+    {
+      vector<uint32_t> unique(ids);
+      sort(unique.begin(), unique.end());
+      unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+      sort(unique.begin(), unique.end(),
+           [&](uint32_t x, uint32_t y) {return table[x]<table[y];});
+      unordered_map<uint32_t,size_t> ranks;
+      for (size_t i=0; i<unique.size(); ++i)
+        ranks.emplace(unique[i], i);
+      return ranks;
+    }
+  }
+
+  int64_t timeToInt64(const ptime& t)
+  {
+    if (t.is_not_a_date_time()) return notATime;
+    if (t.is_neg_infinity()) return negInfTime;
+    if (t.is_pos_infinity()) return posInfTime;
+    return (t-epoch).total_microseconds();
+  }
+
+  ptime int64ToTime(int64_t t)
+  {
+    switch (t)
+      {
+      case notATime: return ptime(not_a_date_time);
+      case negInfTime: return ptime(neg_infin);
+      case posInfTime: return ptime(pos_infin);
+      default: return epoch+microseconds(t);
+      }
+  }
+
+  StringTable& LabelColumn::table()
+  {
+    if (!m_table)
+      m_table=make_shared<StringTable>();
+    else if (m_table.use_count()>1)
+      m_table=make_shared<StringTable>(*m_table);
+    return *m_table;
+  }
+
+  size_t LabelColumn::size() const
+  {
+    switch (m_type)
+      {
+      case Dimension::string: return m_strings.size();
+      case Dimension::time: return m_times.size();
+      case Dimension::value: return m_values.size();
+      }
+    return 0;
+  }
+
+  void LabelColumn::reserve(size_t n)
+  {
+    switch (m_type)
+      {
+      case Dimension::string: m_strings.reserve(n); break;
+      case Dimension::time: m_times.reserve(n); break;
+      case Dimension::value: m_values.reserve(n); break;
+      }
+  }
+
+  void LabelColumn::clear()
+  {
+    m_strings.clear();
+    m_times.clear();
+    m_values.clear();
+    m_table.reset();
+  }
+
+  void LabelColumn::erase(size_t first, size_t last)
+  {
+    switch (m_type)
+      {
+      case Dimension::string: eraseRange(m_strings, first, last); break;
+      case Dimension::time: eraseRange(m_times, first, last); break;
+      case Dimension::value: eraseRange(m_values, first, last); break;
+      }
+  }
+
+  void LabelColumn::pushString(const string& x)
+  {
+    if (m_type!=Dimension::string) throw error("string label in non-string column");
+    m_strings.push_back(table().intern(x));
+  }
+
+  void LabelColumn::pushTime(const ptime& x)
+  {
+    if (m_type!=Dimension::time) throw error("time label in non-time column");
+    m_times.push_back(timeToInt64(x));
+  }
+
+  void LabelColumn::pushValue(double x)
+  {
+    if (m_type!=Dimension::value) throw error("value label in non-value column");
+    m_values.push_back(x);
+  }
+
+  void LabelColumn::push_back(const any& x)
+  {
+    if (auto s=any_cast<string>(&x))
+      pushString(*s);
+    else if (auto s=any_cast<const char*>(&x))
+      pushString(*s);
+    else if (auto t=any_cast<ptime>(&x))
+      pushTime(*t);
+    else if (auto v=any_cast<double>(&x))
+      pushValue(*v);
+    else
+      throw error("unsupported label type");
+  }
+
+  any LabelColumn::operator[](size_t i) const
+  {
+    switch (m_type)
+      {
+      case Dimension::string: return stringLabel(i);
+      case Dimension::time: return int64ToTime(m_times[i]);
+      case Dimension::value: return m_values[i];
+      }
+    return any();
+  }
+
+  int LabelColumn::compare(size_t i, const LabelColumn& x, size_t j) const
+  {
+    if (m_type!=x.m_type)
+      throw error("incompatible types in compare");
+    switch (m_type)
+      {
+      case Dimension::string:
+        if (m_table==x.m_table && m_strings[i]==x.m_strings[j]) return 0;
+        return stringLabel(i).compare(x.stringLabel(j));
+      case Dimension::time: return cmp(m_times[i], x.m_times[j]);
+      case Dimension::value: return cmp(m_values[i], x.m_values[j]);
+      }
+    return 0;
+  }
+
+  double LabelColumn::diff(size_t i, size_t j) const
+  {
+    switch (m_type)
+      {
+      case Dimension::string:
+        {
+          if (m_strings[i]==m_strings[j]) return 0;
+          // Hamming distance, signed by lexicographic order
+          auto& x=stringLabel(i);
+          auto& y=stringLabel(j);
+          double r=abs(double(x.length())-double(y.length()));
+          for (size_t k=0; k<x.length() && k<y.length(); ++k)
+            r += x[k]!=y[k];
+          return x<y? -r: r;
+        }
+      case Dimension::time: return 1e-6*(m_times[i]-m_times[j]);
+      case Dimension::value: return m_values[i]-m_values[j];
+      }
+    return 0;
+  }
+
+  bool LabelColumn::equal(size_t i, const LabelColumn& x, size_t j) const
+  {
+    if (m_type!=x.m_type) return false;
+    switch (m_type)
+      {
+      case Dimension::string:
+        return m_table==x.m_table? m_strings[i]==x.m_strings[j]:
+          stringLabel(i)==x.stringLabel(j);
+      case Dimension::time: return m_times[i]==x.m_times[j];
+      case Dimension::value: return m_values[i]==x.m_values[j];
+      }
+    return false;
+  }
+
+  bool LabelColumn::operator==(const LabelColumn& x) const
+  {
+    if (size()!=x.size()) return false;
+    if (empty()) return true;
+    if (m_type!=x.m_type) return false;
+    switch (m_type)
+      {
+      case Dimension::string:
+        if (m_table==x.m_table) return m_strings==x.m_strings;
+        for (size_t i=0; i<m_strings.size(); ++i)
+          if (stringLabel(i)!=x.stringLabel(i))
+            return false;
+        return true;
+      case Dimension::time: return m_times==x.m_times;
+      case Dimension::value: return m_values==x.m_values;
+      }
+    return false;
+  }
+
+  vector<size_t> LabelColumn::sortedOrder(bool reverse) const
+  {
+    vector<size_t> perm(size());
+    for (size_t i=0; i<perm.size(); ++i) perm[i]=i;
+    auto sortBy=[&](const std::function<int(size_t,size_t)>& c) {
+      if (reverse)
+        stable_sort(perm.begin(), perm.end(), [&](size_t i, size_t j){return c(i,j)>0;});
+      else
+        stable_sort(perm.begin(), perm.end(), [&](size_t i, size_t j){return c(i,j)<0;});
+    };
+    switch (m_type)
+      {
+      case Dimension::string:
+        {
+          if (m_strings.empty()) break;
+          auto ranks=stringRanks(m_strings, *m_table);
+          vector<size_t> rank(m_strings.size());
+          for (size_t i=0; i<rank.size(); ++i)
+            rank[i]=ranks[m_strings[i]];
+          sortBy([&](size_t i, size_t j){return cmp(rank[i],rank[j]);});
+          break;
+        }
+      case Dimension::time:
+        sortBy([&](size_t i, size_t j){return cmp(m_times[i],m_times[j]);});
+        break;
+      case Dimension::value:
+        sortBy([&](size_t i, size_t j){return cmp(m_values[i],m_values[j]);});
+        break;
+      }
+    return perm;
+  }
+}
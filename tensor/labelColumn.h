@@ -0,0 +1,116 @@
+/*
+  @copyright Russell Standish 2019
+  @author Russell Standish
+  This file is part of Civita.
+
+  Civita is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Civita is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Civita.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIVITA_LABELCOLUMN_H
+#define CIVITA_LABELCOLUMN_H
+#include "dimension.h"
+#include <boost/any.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace civita
+{
+  /// table of the distinct strings of a label column. Each distinct
+  /// string is stored once, and is referred to by a 32 bit id. Equal
+  /// strings have equal ids.
+  class StringTable
+  {
+    std::unordered_map<std::string, std::uint32_t> ids;
+    std::vector<const std::string*> strings;
+  public:
+    StringTable() {}
+    StringTable(const StringTable&);
+    void operator=(const StringTable&)=delete;
+    /// @return id of \a s, adding it to the table if not already present
+    std::uint32_t intern(const std::string& s);
+    const std::string& operator[](std::uint32_t id) const {return *strings[id];}
+    size_t size() const {return strings.size();}
+  };
+
+  /// labels along a dimension, stored in a typed column according to
+  /// the dimension type: interned string ids, times as int64
+  /// microseconds since the Unix epoch, or raw doubles. Comparisons
+  /// work directly on the column, without any_cast type tests.
+  ///
+  /// The string table is shared by copies of a column, and copied
+  /// before being added to if shared, so it is freed along with the
+  /// last column referring to it. Const access needs no locking.
+  class LabelColumn
+  {
+    Dimension::Type m_type;
+    std::vector<std::uint32_t> m_strings;
+    std::vector<std::int64_t> m_times;
+    std::vector<double> m_values;
+    std::shared_ptr<StringTable> m_table;
+    /// string table, unshared so that it can be added to
+    StringTable& table();
+  public:
+    explicit LabelColumn(Dimension::Type t=Dimension::string): m_type(t) {}
+
+    Dimension::Type type() const {return m_type;}
+    size_t size() const;
+    bool empty() const {return size()==0;}
+    void reserve(size_t n);
+    void clear();
+    /// remove labels [\a first, \a last)
+    void erase(size_t first, size_t last);
+
+    void pushString(const std::string&);
+    void pushTime(const boost::posix_time::ptime&);
+    void pushValue(double);
+    /// @throw if \a x is not compatible with type()
+    void push_back(const boost::any& x);
+
+    /// typed column accessors. Only the one matching type() is populated
+    const std::vector<std::uint32_t>& stringIds() const {return m_strings;}
+    const std::vector<std::int64_t>& times() const {return m_times;}
+    const std::vector<double>& values() const {return m_values;}
+    /// string label \a i. type() must be Dimension::string
+    const std::string& stringLabel(size_t i) const {return (*m_table)[m_strings[i]];}
+
+    /// label \a i as an any
+    boost::any operator[](size_t i) const;
+
+    /// three way comparison of label \a i of this with label \a j of
+    /// \a x: <0, 0, >0
+    /// @throw if the columns are of different types
+    int compare(size_t i, const LabelColumn& x, size_t j) const;
+    int compare(size_t i, size_t j) const {return compare(i,*this,j);}
+    /// as per civita::diff, applied to labels \a i and \a j
+    double diff(size_t i, size_t j) const;
+    /// true if label \a i of this equals label \a j of \a x
+    bool equal(size_t i, const LabelColumn& x, size_t j) const;
+    bool operator==(const LabelColumn& x) const;
+    bool operator!=(const LabelColumn& x) const {return !operator==(x);}
+
+    /// permutation of label positions that sorts labels ascending
+    /// (descending if \a reverse). The sort is stable.
+    std::vector<size_t> sortedOrder(bool reverse=false) const;
+  };
+
+  /// conversions between ptime and the int64 time column representation
+  std::int64_t timeToInt64(const boost::posix_time::ptime&);
+  boost::posix_time::ptime int64ToTime(std::int64_t);
+}
+
+#endif
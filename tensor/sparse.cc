@@ -0,0 +1,83 @@
+/*
+  @copyright Russell Standish 2020
+  @author Russell Standish
+  This file is part of Civita.
+
+  Civita is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Civita is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Civita.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sparse.h"
+#include <algorithm>
+#include <iterator>
+#include <assert.h>
+using namespace std;
+
+namespace civita
+{
+  HashedIndex::HashedIndex(const Index& index): m_size(index.size())
+  {
+    offsets.reserve(index.size());
+    for (size_t i=0; i<index.size(); ++i)
+      offsets.emplace(index[i], i);
+  }
+
+  AxisCompressedIndex::AxisCompressedIndex(const Hypercube& hc, const Index& index, size_t axis)
+  {
+    assert(axis<hc.rank());
+    auto stride=hc.strides()[axis];
+    auto dim=hc.dims()[axis];
+    // fibre containing each entry, as a hypercube index with axis removed
+    vector<size_t> fibre(index.size());
+    m_axisIndex.resize(index.size());
+    for (size_t i=0; i<index.size(); ++i)
+      {
+        auto h=index[i];
+        auto outer=h/stride;
+        m_axisIndex[i]=outer%dim;
+        fibre[i]=(outer/dim)*stride + h%stride;
+      }
+
+    // index is sorted, so within a fibre entries are already ordered
+    // along the axis, and a stable sort by fibre suffices
+    m_entries.resize(index.size());
+    for (size_t i=0; i<m_entries.size(); ++i) m_entries[i]=i;
+    stable_sort(m_entries.begin(), m_entries.end(),
+                [&](size_t i, size_t j){return fibre[i]<fibre[j];});
+
+    vector<size_t> fibres, axisIndex(m_entries.size());
+    for (size_t j=0; j<m_entries.size(); ++j)
+      {
+        auto f=fibre[m_entries[j]];
+        if (fibres.empty() || fibres.back()!=f)
+          {
+            if (!fibres.empty()) m_offsets.push_back(j);
+            fibres.push_back(f);
+          }
+        axisIndex[j]=m_axisIndex[m_entries[j]];
+      }
+    if (!fibres.empty()) m_offsets.push_back(m_entries.size());
+    m_axisIndex.swap(axisIndex);
+    m_fibres.assignSorted(fibres.begin(), fibres.end());
+  }
+
+  Index indexUnion(const Index& x, const Index& y)
+  {
+    vector<size_t> r;
+    r.reserve(max(x.size(), y.size()));
+    set_union(x.begin(), x.end(), y.begin(), y.end(), back_inserter(r));
+    Index result;
+    result.assignSorted(r.begin(), r.end());
+    return result;
+  }
+}
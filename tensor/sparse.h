@@ -0,0 +1,85 @@
+/*
+  @copyright Russell Standish 2020
+  @author Russell Standish
+  This file is part of Civita.
+
+  Civita is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Civita is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Civita.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIVITA_SPARSE_H
+#define CIVITA_SPARSE_H
+#include "hypercube.h"
+#include "index.h"
+#include <unordered_map>
+#include <vector>
+
+/**
+   Auxiliary layouts of a sparse tensor's Index. Index itself remains
+   the canonical (sorted coordinate) representation, and these are
+   built from it by operations needing a different access pattern.
+*/
+
+namespace civita
+{
+  /// hashed coordinate lookup: constant time mapping of hypercube
+  /// indices to lineal offsets into the data
+  class HashedIndex
+  {
+    std::unordered_map<size_t,size_t> offsets;
+    size_t m_size=0;
+  public:
+    HashedIndex() {}
+    explicit HashedIndex(const Index& index);
+    /// return the lineal index of hypercube index h, or size if not
+    /// present. As per Index::linealOffset.
+    size_t linealOffset(size_t h) const {
+      auto i=offsets.find(h);
+      return i==offsets.end()? m_size: i->second;
+    }
+    size_t size() const {return m_size;}
+    bool empty() const {return m_size==0;}
+  };
+
+  /// sparse entries grouped into fibres along a single axis, in the
+  /// manner of compressed sparse row storage. Each fibre consists of
+  /// the entries sharing all coordinates but the compressed axis, in
+  /// increasing order along that axis.
+  class AxisCompressedIndex
+  {
+    Index m_fibres;
+    std::vector<size_t> m_offsets{0}, m_entries, m_axisIndex;
+  public:
+    AxisCompressedIndex() {}
+    /// compress \a index, of a tensor with hypercube \a hc, along \a axis
+    AxisCompressedIndex(const Hypercube& hc, const Index& index, size_t axis);
+
+    /// hypercube indices of each fibre in the hypercube with \a
+    /// axis removed. Sorted.
+    const Index& fibres() const {return m_fibres;}
+    size_t numFibres() const {return m_fibres.size();}
+    /// range [fibreBegin(i),fibreEnd(i)) of entries making up fibre i
+    size_t fibreBegin(size_t i) const {return m_offsets[i];}
+    size_t fibreEnd(size_t i) const {return m_offsets[i+1];}
+    /// lineal offset of entry \a j into the tensor's data
+    size_t entry(size_t j) const {return m_entries[j];}
+    /// coordinate of entry \a j along the compressed axis
+    size_t axisIndex(size_t j) const {return m_axisIndex[j];}
+    size_t size() const {return m_entries.size();}
+  };
+
+  /// union of two sparse indices, in linear time
+  Index indexUnion(const Index& x, const Index& y);
+}
+
+#endif
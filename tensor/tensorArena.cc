@@ -0,0 +1,211 @@
+/*
+  @copyright Russell Standish 2020
+  @author Russell Standish
+  This file is part of Civita.
+
+  Civita is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Civita is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Civita.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tensorArena.h"
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <map>
+#include <new>
+#include <set>
+#include <vector>
+
+using namespace std;
+
+namespace civita
+{
+  const size_t TensorArena::defaultSlabSize;
+  const size_t TensorArena::alignment;
+
+  struct TensorArena::State
+  {
+    boost::mutex mutex;
+    vector<char*> slabs;
+    char* next=nullptr;
+    size_t remaining=0, capacity=0, inUse=0, slabInUse=0, highWater=0;
+    /// freed blocks, keyed by block size
+    map<size_t, vector<void*>> freeBlocks;
+    /// blocks too large for a slab, returned to the heap when freed
+    set<void*> largeBlocks;
+    char* newSlab(size_t bytes)
+    {
+      slabs.reserve(slabs.size()+1);
+      auto s=static_cast<char*>(::operator new(bytes));
+      slabs.push_back(s);
+      capacity+=bytes;
+      return s;
+    }
+    /// the smallest free block of at least \a bytes, or null. The
+    /// remainder of a larger block is freed, so that blocks freed
+    /// by a result reallocated at a different size are still reused.
+    void* reuse(size_t bytes)
+    {
+      auto f=freeBlocks.lower_bound(bytes);
+      if (f==freeBlocks.end()) return nullptr;
+      auto size=f->first;
+      auto r=static_cast<char*>(f->second.back());
+      f->second.pop_back();
+      if (f->second.empty())
+        freeBlocks.erase(f);
+      if (size>bytes)
+        freeBlocks[size-bytes].push_back(r+bytes);
+      return r;
+    }
+  };
+
+  namespace
+  {
+    thread_local TensorArena* currentArena=nullptr;
+
+    /// size of block used for \a bytes. Small blocks are rounded up to
+    /// a power of two, and larger ones to a whole number of pages, so
+    /// that freed blocks are likely to be reused.
+    size_t blockSize(size_t bytes)
+    {
+      const size_t page=4096;
+      if (bytes>page)
+        return (bytes+page-1)/page*page;
+      size_t r=TensorArena::alignment;
+      while (r<bytes) r*=2;
+      return r;
+    }
+  }
+
+  TensorArena::TensorArena(size_t slabSize): state(new State)
+  {
+    state->remaining=max(blockSize(slabSize), defaultSlabSize);
+    state->next=state->newSlab(state->remaining);
+  }
+
+  TensorArena::~TensorArena()
+  {
+    for (auto s: state->slabs)
+      ::operator delete(s);
+    for (auto s: state->largeBlocks)
+      ::operator delete(s);
+  }
+
+  void* TensorArena::allocate(size_t bytes)
+  {
+    auto b=blockSize(bytes);
+    void* r;
+    {
+      auto& s=*state;
+      boost::mutex::scoped_lock lock(s.mutex);
+      if (b>defaultSlabSize/4)
+        {
+          // large blocks are allocated individually, leaving the
+          // slabs for smaller ones
+          r=::operator new(b);
+          s.largeBlocks.insert(r);
+          s.capacity+=b;
+        }
+      else
+        {
+          if (!(r=s.reuse(b)))
+            {
+              if (b>s.remaining)
+                {
+                  // the rest of the current slab is kept for reuse
+                  if (s.remaining)
+                    s.freeBlocks[s.remaining].push_back(s.next);
+                  s.next=s.newSlab(defaultSlabSize);
+                  s.remaining=defaultSlabSize;
+                }
+              r=s.next;
+              s.next+=b;
+              s.remaining-=b;
+            }
+          s.slabInUse+=b;
+          s.highWater=max(s.highWater, s.slabInUse);
+        }
+      s.inUse+=b;
+    }
+    intrusive_ptr_add_ref(this);
+    return r;
+  }
+
+  void TensorArena::deallocate(void* p, size_t bytes)
+  {
+    if (!p) return;
+    auto b=blockSize(bytes);
+    {
+      auto& s=*state;
+      boost::mutex::scoped_lock lock(s.mutex);
+      s.inUse-=b;
+      if (s.largeBlocks.erase(p))
+        {
+          ::operator delete(p);
+          s.capacity-=b;
+        }
+      else
+        {
+          s.slabInUse-=b;
+          s.freeBlocks[b].push_back(p);
+        }
+    }
+    // may delete this, so must follow the lock's release
+    intrusive_ptr_release(this);
+  }
+
+  size_t TensorArena::capacity() const
+  {
+    boost::mutex::scoped_lock lock(state->mutex);
+    return state->capacity;
+  }
+
+  size_t TensorArena::inUse() const
+  {
+    boost::mutex::scoped_lock lock(state->mutex);
+    return state->inUse;
+  }
+
+  size_t TensorArena::highWater() const
+  {
+    boost::mutex::scoped_lock lock(state->mutex);
+    return state->highWater;
+  }
+
+  TensorArena* TensorArena::current() {return currentArena;}
+
+  TensorArena::Scope::Scope(TensorArena* a): prev(currentArena)
+  {currentArena=a;}
+
+  TensorArena::Scope::~Scope() {currentArena=prev;}
+
+  void* TensorArena::allocateObject(size_t bytes)
+  {
+    // the arena allocated from is stored ahead of the object, so
+    // that it can be returned there
+    auto arena=currentArena;
+    bytes+=alignment;
+    auto p=static_cast<char*>(arena? arena->allocate(bytes): ::operator new(bytes));
+    *reinterpret_cast<TensorArena**>(p)=arena;
+    return p+alignment;
+  }
+
+  void TensorArena::deallocateObject(void* p, size_t bytes)
+  {
+    if (!p) return;
+    auto block=static_cast<char*>(p)-alignment;
+    if (auto arena=*reinterpret_cast<TensorArena**>(block))
+      arena->deallocate(block, bytes+alignment);
+    else
+      ::operator delete(block);
+  }
+}
@@ -0,0 +1,146 @@
+/*
+  @copyright Russell Standish 2020
+  @author Russell Standish
+  This file is part of Civita.
+
+  Civita is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Civita is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Civita.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIVITA_TENSORARENA_H
+#define CIVITA_TENSORARENA_H
+
+#include <boost/intrusive_ptr.hpp>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+
+namespace civita
+{
+  /// Memory pool for the operations of a tensor expression graph, and
+  /// their intermediate results. Blocks are carved from slabs, and
+  /// freed blocks are kept for reuse by blocks of the same size or
+  /// smaller, so the many small allocations of building a graph, or
+  /// recomputing its cached results, do not fragment the heap. The
+  /// slabs are released together, once the arena and every block
+  /// allocated from it have been released.
+  class TensorArena
+  {
+  public:
+    static const size_t defaultSlabSize=1<<20;
+    /// alignment of allocated blocks
+    static const size_t alignment=16;
+
+    /// @param slabSize size of the first slab. Pass the highWater()
+    /// of a graph's previous arena, so that a rebuilt graph fits in
+    /// a single slab. Subsequent slabs are defaultSlabSize, and
+    /// blocks too large for those are allocated individually.
+    explicit TensorArena(size_t slabSize=defaultSlabSize);
+    ~TensorArena();
+    TensorArena(const TensorArena&)=delete;
+    void operator=(const TensorArena&)=delete;
+
+    void* allocate(size_t bytes);
+    void deallocate(void* p, size_t bytes);
+
+    /// bytes of slabs and individually allocated blocks held
+    size_t capacity() const;
+    /// bytes of blocks currently allocated
+    size_t inUse() const;
+    /// largest number of bytes allocated from slabs at once. Blocks
+    /// allocated individually are excluded, as they would not fit
+    /// in a slab sized by it.
+    size_t highWater() const;
+
+    /// arena that graph owned tensor operations constructed on this
+    /// thread are allocated from, or null for the heap
+    static TensorArena* current();
+    /// sets current() for its lifetime
+    class Scope
+    {
+      TensorArena* prev;
+    public:
+      explicit Scope(TensorArena*);
+      ~Scope();
+      Scope(const Scope&)=delete;
+      void operator=(const Scope&)=delete;
+    };
+
+    /// storage for an object of \a bytes, from current(), if any,
+    /// otherwise the heap. Used by ArenaAllocated's operator new.
+    static void* allocateObject(size_t bytes);
+    static void deallocateObject(void* p, size_t bytes);
+
+  private:
+    /// slabs, free lists and usage counts, guarded by a mutex
+    struct State;
+    std::unique_ptr<State> state;
+    /// references held by TensorArenaPtrs and allocated blocks
+    std::atomic<size_t> refs{0};
+    friend void intrusive_ptr_add_ref(TensorArena* a) {++a->refs;}
+    friend void intrusive_ptr_release(TensorArena* a) {if (--a->refs==0) delete a;}
+  };
+
+  typedef boost::intrusive_ptr<TensorArena> TensorArenaPtr;
+
+  /// \a T, allocated from TensorArena::current(), if any, when
+  /// created with new. For the operations of an expression graph,
+  /// which are owned by the graph, as opposed to tensors, such as
+  /// variable values, that outlive it.
+  template <class T>
+  struct ArenaAllocated: public T
+  {
+    static void* operator new(size_t bytes) {return TensorArena::allocateObject(bytes);}
+    static void operator delete(void* p, size_t bytes) {TensorArena::deallocateObject(p,bytes);}
+  };
+
+  /// allocates from \a arena, if given, otherwise the heap. Copies of
+  /// a container are allocated from the heap, and a container move
+  /// assigned keeps its own allocator, so that data escaping a graph
+  /// does not keep its arena alive.
+  template <class T>
+  struct ArenaAllocator
+  {
+    typedef T value_type;
+    typedef std::false_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    TensorArenaPtr arena;
+    ArenaAllocator() {}
+    explicit ArenaAllocator(TensorArena* arena): arena(arena) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& x): arena(x.arena) {}
+    T* allocate(size_t n) {
+      return static_cast<T*>(arena? arena->allocate(n*sizeof(T)): ::operator new(n*sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) {
+      if (arena) arena->deallocate(p, n*sizeof(T));
+      else ::operator delete(p);
+    }
+    ArenaAllocator select_on_container_copy_construction() const {return ArenaAllocator();}
+    template <class U>
+    bool operator==(const ArenaAllocator<U>& x) const {return arena==x.arena;}
+    template <class U>
+    bool operator!=(const ArenaAllocator<U>& x) const {return arena!=x.arena;}
+  };
+
+  /// as std::make_shared, allocating the object and its reference
+  /// count from TensorArena::current(), if any
+  template <class T, class... Args>
+  std::shared_ptr<T> makeArenaShared(Args&&... args)
+  {
+    return std::allocate_shared<T>(ArenaAllocator<T>(TensorArena::current()),
+                                   std::forward<Args>(args)...);
+  }
+}
+
+#endif
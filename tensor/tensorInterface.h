@@ -110,6 +110,10 @@ namespace civita
     virtual void setArguments(const std::vector<TensorPtr>& a1,
                               const std::vector<TensorPtr>& a2)
     {setArguments(a1.empty()? TensorPtr(): a1[0], a2.empty()? TensorPtr(): a2[0]);}
+    /// replace the argument by one with identical hypercube and index,
+    /// without recomputing anything derived from them
+    /// @return false if not supported, and setArgument must be used instead
+    virtual bool replaceArgument(const TensorPtr&) {return false;}
    
   protected:
     Hypercube m_hypercube;
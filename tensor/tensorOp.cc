@@ -20,11 +20,22 @@
 #include "tensorOp.h"
 #include <exception>
 #include <set>
+#include <boost/thread.hpp>
 #include <ecolab_epilogue.h>
 using namespace std;
 
 namespace civita
 {
+  void ElementLookup::set(const TensorPtr& arg, const Index& result)
+  {
+    hashed=HashedIndex();
+    scalar=arg && arg->rank()==0;
+    aligned=!arg || arg->index()==result;
+    dense=!arg || arg->index().empty();
+    if (!scalar && !aligned && !dense)
+      hashed=HashedIndex(arg->index());
+  }
+
   void BinOp::setArguments(const TensorPtr& a1, const TensorPtr& a2)
   {
     arg1=a1; arg2=a2;
@@ -37,31 +48,36 @@ namespace civita
       }
     else if (arg2)
       hypercube(arg2->hypercube());
-    set<size_t> indices;
-    if (arg1) indices.insert(arg1->index().begin(), arg1->index().end());
-    if (arg2) indices.insert(arg2->index().begin(), arg2->index().end());
-    m_index=indices;
+    m_index=indexUnion(arg1? arg1->index(): Index(), arg2? arg2->index(): Index());
+    lookup1.set(arg1, m_index);
+    lookup2.set(arg2, m_index);
   }
 
+  double BinOp::operator[](size_t i) const
+  {
+    auto hcIndex=index()[i];
+    return f(lookup1(*arg1,i,hcIndex), lookup2(*arg2,i,hcIndex));
+  }
 
   void ReduceArguments::setArguments(const vector<TensorPtr>& a,const std::string&,double)
   {
     hypercube({});
+    m_index.clear();
     if (!a.empty())
       {
         auto hc=a[0]->hypercube();
         hypercube(hc);
-        size_t cnt=0;
-        set<size_t> idx;
         for (auto& i: a)
           {
             if (i->rank()>0 && i->hypercube()!=hc)
               throw runtime_error("arguments not conformal");
-            idx.insert(i->index().begin(), i->index().end());
+            m_index=indexUnion(m_index, i->index());
           }
-        m_index=idx;
       }
     args=a;
+    lookups.resize(args.size());
+    for (size_t i=0; i<args.size(); ++i)
+      lookups[i].set(args[i], m_index);
   }
 
   double ReduceArguments::operator[](size_t i) const
@@ -69,9 +85,10 @@ namespace civita
     if (args.empty()) return init;
     assert(i<size());
     double r=init; 
-    for (auto j: args)
+    auto hcIndex=index()[i];
+    for (size_t j=0; j<args.size(); ++j)
       {
-        auto x=j->rank()==0? (*j)[0]: (*j)[i];
+        auto x=lookups[j](*args[j], i, hcIndex);
         if (!isnan(x)) f(r, x);
       }
     return r;
@@ -99,6 +116,9 @@ namespace civita
   void ReductionOp::setArgument(const TensorPtr& a, const std::string& dimName,double)
   {
     arg=a;
+    cachedValues.clear();
+    fibres=AxisCompressedIndex();
+    m_index.clear();
     dimension=std::numeric_limits<size_t>::max();
     if (arg)
       {
@@ -111,18 +131,10 @@ namespace civita
         if (dimension<arg->rank())
           {
             xv.erase(xv.begin()+dimension);
-            // compute index - enter index elements that have any in the argument
-            set<size_t> indices;
-            for (size_t i=0; i<arg->size(); ++i)
-              {
-                auto splitIdx=ahc.splitIndex(arg->index()[i]);
-                SOI soi{i,splitIdx[dimension]};
-                splitIdx.erase(splitIdx.begin()+dimension);
-                auto idx=m_hypercube.linealIndex(splitIdx);
-                sumOverIndices[idx].emplace_back(soi);
-                indices.insert(idx);
-              }
-            m_index=indices;
+            if (arg->index().empty()) return; // dense result
+            // output elements are those with any entry in the argument
+            fibres=AxisCompressedIndex(ahc, arg->index(), dimension);
+            m_index=fibres.fibres();
           }
         else
           m_hypercube.xvectors.clear(); //reduce all, return scalar
@@ -133,6 +145,25 @@ namespace civita
 
   
   double ReductionOp::operator[](size_t i) const
+  {
+    if (!m_cache) return reduce(i);
+    assert(i<size());
+    // compare for inequality, as a swapped in argument may be older
+    if (cachedValues.empty() || cacheTimestamp!=arg->timestamp())
+      {
+        cachedValues.assign(size(),0);
+        cached.assign(size(),false);
+        cacheTimestamp=arg->timestamp();
+      }
+    if (!cached[i])
+      {
+        cachedValues[i]=reduce(i);
+        cached[i]=true;
+      }
+    return cachedValues[i];
+  }
+  
+  double ReductionOp::reduce(size_t i) const
   {
     assert(i<size());
     if (dimension>arg->rank())
@@ -142,14 +173,16 @@ namespace civita
         double r=init;
         if (index().empty())
           {
-            auto argDims=arg->shape();
+            // stride and size of dimension, without copying the shape
+            auto& xv=arg->hypercube().xvectors;
             size_t stride=1;
             for (size_t j=0; j<dimension; ++j)
-              stride*=argDims[j];
-            auto quotRem=ldiv(i, stride); // quotient and remainder calc in one hit
-            auto start=quotRem.quot*stride*argDims[dimension] + quotRem.rem;
-            assert(stride*argDims[dimension]>0);
-            for (size_t j=0; j<argDims[dimension]; ++j)
+              stride*=xv[j].size();
+            size_t dimSize=xv[dimension].size();
+            auto quot=i/stride;
+            auto start=quot*stride*dimSize + i-quot*stride;
+            assert(stride*dimSize>0);
+            for (size_t j=0; j<dimSize; ++j)
               {
                 double x=arg->atHCIndex(j*stride+start);
                 if (!isnan(x)) f(r,x,j);
@@ -157,14 +190,12 @@ namespace civita
           }
         else
           {
-            auto soi=sumOverIndices.find(index()[i]);
-            assert(soi!=sumOverIndices.end());
-            if (soi!=sumOverIndices.end())
-              for (auto j: soi->second)
-                {
-                  double x=(*arg)[j.index];
-                  if (!isnan(x)) f(r,x,j.dimIndex);
-                }
+            // element i reduces fibre i
+            for (size_t j=fibres.fibreBegin(i); j<fibres.fibreEnd(i); ++j)
+              {
+                double x=(*arg)[fibres.entry(j)];
+                if (!isnan(x)) f(r,x,fibres.axisIndex(j));
+              }
           }
         return r;
       }
@@ -197,6 +228,11 @@ namespace civita
   
   void Scan::computeTensor() const
   {
+    if (!index().empty())
+      {
+        computeSparse();
+        return;
+      }
     if (dimension<rank())
       {
         auto argDims=arg->hypercube().dims();
@@ -239,6 +275,52 @@ namespace civita
       }
   }
 
+  void Scan::computeSparse() const
+  {
+    // missing entries take no part in the scan, and the result has
+    // the same sparsity as the argument
+    auto& idx=arg->index();
+    if (dimension<rank())
+      {
+        bool windowed=argVal>=1 && argVal<arg->hypercube().dims()[dimension];
+        for (size_t fibre=0; fibre<fibres.numFibres(); ++fibre)
+          {
+            auto begin=fibres.fibreBegin(fibre), end=fibres.fibreEnd(fibre);
+            for (size_t j=begin; j<end; ++j)
+              {
+                auto i=fibres.entry(j);
+                auto& r=cachedResult[i];
+                if (windowed)
+                  {
+                    // argVal is interpreted as the binning window
+                    r=(*arg)[i];
+                    auto windowStart=fibres.axisIndex(j)-min(fibres.axisIndex(j), size_t(argVal-1));
+                    auto k=j;
+                    while (k>begin && fibres.axisIndex(k-1)>=windowStart) --k;
+                    for (; k<j; ++k)
+                      f(r, (*arg)[fibres.entry(k)], idx[fibres.entry(k)]);
+                  }
+                else if (j==begin)
+                  r=(*arg)[i];
+                else
+                  {
+                    r=cachedResult[fibres.entry(j-1)];
+                    f(r, (*arg)[i], idx[i]);
+                  }
+              }
+          }
+      }
+    else if (!idx.empty())
+      {
+        cachedResult[0]=(*arg)[0];
+        for (size_t i=1; i<idx.size(); ++i)
+          {
+            cachedResult[i]=cachedResult[i-1];
+            f(cachedResult[i], (*arg)[i], idx[i]);
+          }
+      }
+  }
+
   void Slice::setArgument(const TensorPtr& a,const string& axis, double index)
   {
     arg=a;
@@ -275,15 +357,16 @@ namespace civita
         // set up index vector
         auto& ahc=arg->hypercube();
         map<size_t, size_t> ai;
+        // walk argument, dropping the slice axis
+        auto targetStrides=hc.strides();
+        if (splitAxis<ahc.rank())
+          targetStrides.insert(targetStrides.begin()+splitAxis, 0);
+        Odometer odometer(ahc, targetStrides);
         for (size_t i=0; i<arg->index().size(); ++i)
           {
-            auto splitIdx=ahc.splitIndex(arg->index()[i]);
-            if (splitIdx[splitAxis]==sliceIndex)
-              {
-                splitIdx.erase(splitIdx.begin()+splitAxis);
-                auto l=hc.linealIndex(splitIdx);
-                ai[l]=i;
-              }
+            auto l=odometer(arg->index()[i]);
+            if (splitAxis>=ahc.rank() || odometer.index()[splitAxis]==sliceIndex)
+              ai[l]=i;
           }
         m_index=ai;
         arg_index.resize(ai.size());
@@ -305,6 +388,113 @@ namespace civita
       return (*arg)[arg_index[i]];
   }
   
+  namespace
+  {
+    // tile edge: a tile of doubles read and written fits in L1 cache
+    const size_t transposeBlock=32;
+    // only split transposes of at least this many elements across threads
+    const size_t parallelTransposeSize=1<<20;
+
+    /// write \a arg, as viewed through \a view, into \a result in view
+    /// order. The view's contiguous axis is tiled against the axis along
+    /// which \a arg is contiguous, so both reads and writes stay in cache.
+    void blockedTranspose(const ITensor& arg, const Odometer& view, vector<double>& result)
+    {
+      auto& dims=view.dims();
+      auto& strides=view.strides();
+      size_t rank=dims.size();
+      vector<size_t> viewStrides(rank);
+      size_t n=1;
+      for (size_t k=0; k<rank; ++k)
+        {
+          viewStrides[k]=n;
+          n*=dims[k];
+        }
+      result.resize(n);
+      if (n==0) return;
+
+      // tile axes: a along the output, b along the argument (rank if none)
+      size_t a=0, b=rank;
+      if (rank && strides[0]!=1)
+        for (size_t k=1; k<rank; ++k)
+          if (strides[k]==1 && dims[k]>1)
+            b=k;
+      size_t na=rank? dims[a]: 1, nb=b<rank? dims[b]: 1;
+      size_t outB=b<rank? viewStrides[b]: 0;
+      vector<size_t> offA(na), offB(nb);
+      for (size_t x=0; x<na; ++x) offA[x]=rank? view.targetOffset(a,x): 0;
+      for (size_t y=0; y<nb; ++y) offB[y]=b<rank? view.targetOffset(b,y): 0;
+
+      // remaining axes, walked by tile origin
+      vector<size_t> outerDims, outerStrides;
+      for (size_t k=1; k<rank; ++k)
+        if (k!=b)
+          {
+            outerDims.push_back(dims[k]);
+            outerStrides.push_back(viewStrides[k]);
+          }
+      size_t numOuter=n/(na*nb);
+      size_t numYTiles=(nb+transposeBlock-1)/transposeBlock;
+
+      // contiguous arguments are read directly. Single precision or
+      // deferred data is read element by element, rather than loaded.
+      const double* src=nullptr;
+      if (auto tv=dynamic_cast<const ITensorVal*>(&arg))
+        if (tv->index().empty())
+          src=tv->inPlaceData();
+
+      auto process=[&](size_t begin, size_t end) {
+        Odometer outer(outerDims, outerStrides), argView(view);
+        for (size_t w=begin; w<end; ++w)
+          {
+            auto origin=outer(w/numYTiles);
+            argView.seek(origin);
+            auto base=argView.target()-offA[0]-offB[0];
+            auto y0=(w%numYTiles)*transposeBlock, y1=min(y0+transposeBlock, nb);
+            for (size_t x0=0; x0<na; x0+=transposeBlock)
+              {
+                auto x1=min(x0+transposeBlock, na);
+                for (size_t y=y0; y<y1; ++y)
+                  {
+                    auto out=&result[origin+y*outB];
+                    auto in=base+offB[y];
+                    if (src)
+                      for (size_t x=x0; x<x1; ++x)
+                        out[x]=src[in+offA[x]];
+                    else
+                      for (size_t x=x0; x<x1; ++x)
+                        out[x]=arg[in+offA[x]];
+                  }
+              }
+          }
+      };
+
+      size_t numWork=numOuter*numYTiles;
+      size_t numThreads=max<size_t>(1,boost::thread::hardware_concurrency());
+      // other tensor types may compute their elements lazily, which
+      // is not thread safe
+      if (!src || n<parallelTransposeSize || numThreads==1 || numWork<numThreads)
+        process(0, numWork);
+      else
+        {
+          boost::thread_group threads;
+          for (size_t t=0; t<numThreads; ++t)
+            threads.create_thread([=,&process]{process(t*numWork/numThreads, (t+1)*numWork/numThreads);});
+          threads.join_all();
+        }
+    }
+  }
+
+  double MaterialisedView::operator()(size_t i, const ITensor& arg, const Odometer& view) const
+  {
+    if (data.empty() || m_timestamp!=arg.timestamp())
+      {
+        blockedTranspose(arg, view, data);
+        m_timestamp=arg.timestamp();
+      }
+    return data[i];
+  }
+  
   void Pivot::setArgument(const TensorPtr& a,const std::string&,double)
   {
     arg=a;
@@ -343,6 +533,7 @@ namespace civita
     for (size_t i=0; i<ahc.xvectors.size(); ++i)
       if (!axisSet.count(ahc.xvectors[i].name))
         {
+          invPermutation[i]=permutation.size();
           permutation.push_back(i);
           hc.xvectors.push_back(ahc.xvectors[i]);
         }
@@ -351,37 +542,48 @@ namespace civita
     hypercube(move(hc));
     // permute the index vector
     map<size_t, size_t> pi;
-    for (size_t i=0; i<arg->index().size(); ++i)
-      {
-        auto idx=arg->hypercube().splitIndex(arg->index()[i]);
-        auto pidx=idx;
-        for (size_t j=0; j<idx.size(); ++j)
-          pidx[invPermutation[j]]=idx[j];
-        auto l=hypercube().linealIndex(pidx);
-        assert(pi.count(l)==0);
-        pi[l]=i;
-      }
+    {
+      // walk the argument, with each axis mapped to its pivoted position
+      vector<size_t> targetStrides(arg->rank());
+      auto strides=hypercube().strides();
+      for (size_t j=0; j<targetStrides.size(); ++j)
+        targetStrides[j]=strides[invPermutation[j]];
+      Odometer odometer(arg->hypercube(), targetStrides);
+      for (size_t i=0; i<arg->index().size(); ++i)
+        {
+          auto l=odometer(arg->index()[i]);
+          assert(pi.count(l)==0);
+          pi[l]=i;
+        }
+    }
     m_index=pi;
     // convert to lineal indexing
     permutedIndex.clear();
     for (auto& i: pi) permutedIndex.push_back(i.second);
-    if (permutedIndex.size()) permutation.clear(); // not used in sparse case
+    materialised.clear();
+    if (permutedIndex.size())
+      permutation.clear(); // not used in sparse case
+    else
+      {
+        // walk this, mapping each axis onto the argument's
+        vector<size_t> targetStrides(permutation.size());
+        auto argStrides=arg->hypercube().strides();
+        for (size_t j=0; j<permutation.size(); ++j)
+          targetStrides[j]=argStrides[permutation[j]];
+        odometer=Odometer(hypercube(), targetStrides);
+      }
   }
 
   size_t Pivot::pivotIndex(size_t i) const
   {
-    auto idx=hypercube().splitIndex(i);
-    auto pidx=idx;
-    for (size_t i=0; i<idx.size(); ++i)
-      pidx[permutation[i]]=idx[i];
-    return arg->hypercube().linealIndex(pidx);
+    return odometer.targetOf(i);
   }
 
   double Pivot::operator[](size_t i) const
   {
     assert(i<size());
     if (index().empty())
-      return arg->atHCIndex(pivotIndex(i));
+      return materialised.enabled? materialised(i,*arg,odometer): arg->atHCIndex(pivotIndex(i));
     else
       return (*arg)[permutedIndex[i]];
   }
@@ -390,7 +592,7 @@ namespace civita
   namespace
   {
     /// factory method for creating reduction operations
-    TensorPtr createReductionOp(minsky::RavelState::HandleState::ReductionOp op)
+    shared_ptr<ReductionOp> createReductionOp(minsky::RavelState::HandleState::ReductionOp op)
     {
       switch (op)
         {
@@ -408,6 +610,7 @@ namespace civita
   void PermuteAxis::setArgument(const TensorPtr& a,const std::string& axisName,double)
   {
     arg=a;
+    m_permutation.clear();
     hypercube(arg->hypercube());
     m_index=arg->index();
     for (m_axis=0; m_axis<m_hypercube.xvectors.size(); ++m_axis)
@@ -417,6 +620,9 @@ namespace civita
       throw runtime_error("axis "+axisName+" not found");
     for (size_t i=0; i<m_hypercube.xvectors[m_axis].size(); ++i)
       m_permutation.push_back(i);
+    odometer=Odometer(hypercube(), arg->hypercube().strides());
+    odometer.mapAxis(m_axis, m_permutation);
+    materialised.clear();
   }
 
   void PermuteAxis::setPermutation(vector<size_t>&& p)
@@ -427,30 +633,33 @@ namespace civita
     auto& axv=arg->hypercube().xvectors[m_axis];
     for (auto i: m_permutation)
       xv.push_back(axv[i]);
-    vector<unsigned> reverseIndex(axv.size(),axv.size());
+    vector<size_t> reverseIndex(axv.size(),axv.size());
     for (size_t i=0; i<m_permutation.size(); ++i)
       reverseIndex[m_permutation[i]]=i;
     map<size_t,size_t> indices;
-    for (size_t i=0; i<arg->index().size(); ++i)
-      {
-        auto splitted=arg->hypercube().splitIndex(arg->index()[i]);
-        if ((splitted[m_axis]=reverseIndex[splitted[m_axis]])<axv.size())
-          indices[hypercube().linealIndex(splitted)]=i;
-      }
+    {
+      Odometer odometer(arg->hypercube(), hypercube().strides());
+      odometer.mapAxis(m_axis, reverseIndex);
+      for (size_t i=0; i<arg->index().size(); ++i)
+        {
+          auto l=odometer(arg->index()[i]);
+          if (reverseIndex[odometer.index()[m_axis]]<axv.size())
+            indices[l]=i;
+        }
+    }
     m_index=indices;
     permutedIndex.clear();
     for (auto& i: indices) permutedIndex.push_back(i.second);
+    odometer=Odometer(hypercube(), arg->hypercube().strides());
+    odometer.mapAxis(m_axis, m_permutation);
+    materialised.clear();
   }
   
   double PermuteAxis::operator[](size_t i) const
   {
     assert(i<size());
     if (index().empty())
-      {
-        auto splitted=hypercube().splitIndex(i);
-        splitted[m_axis]=m_permutation[splitted[m_axis]];
-        return arg->atHCIndex(arg->hypercube().linealIndex(splitted));
-      }
+      return materialised.enabled? materialised(i,*arg,odometer): arg->atHCIndex(odometer.targetOf(i));
     return (*arg)[permutedIndex[i]];
   }
 
@@ -478,9 +687,9 @@ namespace civita
       }
     // reorder labels
     auto hc=arg->hypercube();
-    XVector xv(hc.xvectors[0]);
+    XVector xv(hc.xvectors[0].name);
     for (size_t i=0; i<idx.size(); ++i)
-      xv[i]=hc.xvectors[0][idx[i]];
+      xv.push_back(hc.xvectors[0][idx[i]]);
     hc.xvectors[0].swap(xv);
     cachedResult.hypercube(move(hc));
     for (size_t i=0; i<idx.size(); ++i)
@@ -488,101 +697,222 @@ namespace civita
   }
 
   
-  vector<TensorPtr> createRavelChain(const minsky::RavelState& state, const TensorPtr& arg)
+  namespace
   {
-    set<string> outputHandles(state.outputHandles.begin(), state.outputHandles.end());
-    vector<TensorPtr> chain{arg};
-    // TODO sorts and calipers
-    for (auto& i: state.handleStates)
-      if (!outputHandles.count(i.first))
+    using HandleState=minsky::RavelState::HandleState;
+    
+    /// index along \a axis of \a arg of the slice labelled \a label
+    size_t sliceIndex(const ITensor& arg, const string& axis, const string& label)
+    {
+      auto& xv=arg.hypercube().xvectors;
+      auto axisIt=find_if(xv.begin(), xv.end(),
+                          [&](const XVector& j){return j.name==axis;});
+      if (axisIt==xv.end()) throw runtime_error("axis "+axis+" not found");
+      auto sliceIt=find_if(axisIt->begin(), axisIt->end(),
+                           [&](const boost::any& j){return str(j,axisIt->dimension.units)==label;});
+      // determine slice index
+      size_t sliceIdx=0;
+      if (sliceIt!=axisIt->end())
+        sliceIdx=sliceIt-axisIt->begin();
+      return sliceIdx;
+    }
+
+    /// permutation of labels of \a xv implementing \a state's sort order and calipers
+    vector<size_t> permutation(const XVector& xv, const HandleState& state)
+    {
+      vector<size_t> perm;
+      for (size_t i=0; i<xv.size(); ++i)
+        perm.push_back(i);
+      switch (state.order)
         {
-          auto arg=chain.back();
-          if (i.second.collapsed)
+        case HandleState::none: break;
+        case HandleState::forward:
+          perm=xv.labels().sortedOrder();
+          break;
+        case HandleState::reverse:
+          perm=xv.labels().sortedOrder(true);
+          break;
+        case HandleState::custom:
+          {
+            map<string, size_t> offsets;
+            for (size_t i=0; i<xv.size(); ++i)
+              offsets[str(xv[i], xv.dimension.units)]=i;
+            perm.clear();
+            for (auto& j: state.customOrder)
+              if (offsets.count(j))
+                perm.push_back(offsets[j]);
+            break;
+          }
+        }
+      // remove any permutation items outside calipers
+      if (!state.minLabel.empty())
+        for (auto j=perm.begin(); j!=perm.end(); ++j)
+          if (str(xv[*j],xv.dimension.units) == state.minLabel)
             {
-              chain.emplace_back(createReductionOp(i.second.reductionOp));
-              chain.back()->setArgument(arg, i.first);
+              perm.erase(perm.begin(), j);
+              break;
             }
-          else
+      if (!state.maxLabel.empty())
+        for (auto j=perm.begin(); j!=perm.end(); ++j)
+          if (str(xv[*j],xv.dimension.units) == state.maxLabel)
             {
-              chain.emplace_back(new Slice);
-              auto& xv=arg->hypercube().xvectors;
-              auto axisIt=find_if(xv.begin(), xv.end(),
-                                  [&](const XVector& j){return j.name==i.first;});
-              if (axisIt==xv.end()) throw runtime_error("axis "+i.first+" not found");
-              auto sliceIt=find_if(axisIt->begin(), axisIt->end(),
-                                   [&](const boost::any& j){return str(j,axisIt->dimension.units)==i.second.sliceLabel;});
-              // determine slice index
-              size_t sliceIdx=0;
-              if (sliceIt!=axisIt->end())
-                sliceIdx=sliceIt-axisIt->begin();
-              chain.back()->setArgument(arg, i.first, sliceIdx);
+              perm.erase(j+1, perm.end());
+              break;
             }
+      return perm;
+    }
+  }
+
+  bool RavelChain::Link::sameParameters(const Link& x) const
+  {
+    switch (type)
+      {
+      case reduction: return state.reductionOp==x.state.reductionOp;
+      case slice: return state.sliceLabel==x.state.sliceLabel;
+      case permute:
+        return state.order==x.state.order && state.customOrder==x.state.customOrder &&
+          state.displayFilterCaliper==x.state.displayFilterCaliper &&
+          state.minLabel==x.state.minLabel && state.maxLabel==x.state.maxLabel;
+      case pivot: return outputHandles==x.outputHandles;
+      case sortByValue: return state.order==x.state.order;
+      }
+    return false;
+  }
+
+  void RavelChain::Link::build(const TensorPtr& arg, bool argChanged)
+  {
+    switch (type)
+      {
+      case reduction:
+        if (!op)
+          {
+            auto r=createReductionOp(state.reductionOp);
+            r->cache(true);
+            op=r;
+          }
+        op->setArgument(arg, axis);
+        break;
+      case slice:
+        if (!op) op=make_shared<Slice>();
+        op->setArgument(arg, axis, sliceIndex(*arg, axis, state.sliceLabel));
+        break;
+      case permute:
+        {
+          auto permuteAxis=dynamic_pointer_cast<PermuteAxis>(op);
+          if (!permuteAxis) permuteAxis=make_shared<PermuteAxis>();
+          if (argChanged || !op)
+            permuteAxis->setArgument(arg, axis);
+          permuteAxis->setPermutation
+            (permutation(arg->hypercube().xvectors[permuteAxis->axis()], state));
+          op=permuteAxis;
+          break;
         }
-      else if (i.second.order!=minsky::RavelState::HandleState::none || i.second.displayFilterCaliper)
+      case pivot:
         {
-          //apply sorting/calipers
-          auto permuteAxis=make_shared<PermuteAxis>();
-          permuteAxis->setArgument(chain.back(), i.first);
-          auto& xv=chain.back()->hypercube().xvectors[permuteAxis->axis()];
-          vector<size_t> perm;
-          for (size_t i=0; i<xv.size(); ++i)
-            perm.push_back(i);
-          switch (i.second.order)
+          auto pivot=dynamic_pointer_cast<Pivot>(op);
+          if (!pivot) pivot=make_shared<Pivot>();
+          if (argChanged || !op)
+            pivot->setArgument(arg);
+          pivot->setOrientation(outputHandles);
+          op=pivot;
+          break;
+        }
+      case sortByValue:
+        op=make_shared<SortByValue>(state.order);
+        op->setArgument(arg);
+        break;
+      }
+  }
+
+  void RavelChain::update(const minsky::RavelState& state, const TensorPtr& a)
+  {
+    // an argument identical in shape and sparsity to the previous one
+    // can be swapped in without recomputing the chain
+    bool argChanged=a!=arg;
+    if (argChanged && arg && !links.empty() &&
+        a->hypercube()==argHypercube && a->index()==argIndex)
+      argChanged=!links.front().op->replaceArgument(a);
+    if (a!=arg)
+      {
+        arg=a;
+        argHypercube=a->hypercube();
+        argIndex=a->index();
+      }
+
+    // Links are matched against the existing chain in order. Matching
+    // links are reused. The first link whose parameters differ is
+    // updated in place, and every link after it has its argument
+    // refreshed. Once the structure differs, the remaining links are
+    // rebuilt.
+    TensorPtr input=arg;
+    size_t k=0;
+    auto apply=[&](Link&& desired) {
+      if (k<links.size() && links[k].type==desired.type && links[k].axis==desired.axis)
+        {
+          auto& link=links[k];
+          bool sameParameters=link.sameParameters(desired);
+          if (!sameParameters || argChanged)
             {
-            case minsky::RavelState::HandleState::none: break;
-            case minsky::RavelState::HandleState::forward:
-              sort(perm.begin(), perm.end(),
-                   [&](size_t i, size_t j) {return diff(xv[i],xv[j])<0;});
-              break;
-            case minsky::RavelState::HandleState::reverse:
-              sort(perm.begin(), perm.end(),
-                   [&](size_t i, size_t j) {return diff(xv[i],xv[j])>0;});
-              break;
-            case minsky::RavelState::HandleState::custom:
-              {
-                map<string, size_t> offsets;
-                for (size_t i=0; i<xv.size(); ++i)
-                  offsets[str(xv[i], xv.dimension.units)]=i;
-                perm.clear();
-                for (auto& j: i.second.customOrder)
-                  if (offsets.count(j))
-                    perm.push_back(offsets[j]);
-                break;
-              }
+              if (!sameParameters && link.type==Link::reduction)
+                link.op.reset(); // different reduction operation
+              link.state=desired.state;
+              link.outputHandles=desired.outputHandles;
+              link.build(input, argChanged);
+              argChanged=true;
             }
-          // remove any permutation items outside calipers
-          if (!i.second.minLabel.empty())
-            for (auto j=perm.begin(); j!=perm.end(); ++j)
-              if (str(xv[*j],xv.dimension.units) == i.second.minLabel)
-                {
-                  perm.erase(perm.begin(), j);
-                  break;
-                }
-          if (!i.second.maxLabel.empty())
-            for (auto j=perm.begin(); j!=perm.end(); ++j)
-              if (str(xv[*j],xv.dimension.units) == i.second.maxLabel)
-                {
-                  perm.erase(j+1, perm.end());
-                  break;
-                }
-          permuteAxis->setPermutation(move(perm));
-          chain.push_back(permuteAxis);
         }
+      else
+        {
+          links.erase(links.begin()+k, links.end());
+          links.push_back(move(desired));
+          links.back().build(input, true);
+          argChanged=true;
+        }
+      input=links[k++].op;
+    };
 
-    if (chain.back()->rank()>1)
+    set<string> outputHandles(state.outputHandles.begin(), state.outputHandles.end());
+    for (auto& i: state.handleStates)
+      if (!outputHandles.count(i.first))
+        apply(Link(i.second.collapsed? Link::reduction: Link::slice, i.first, i.second));
+      else if (i.second.order!=HandleState::none || i.second.displayFilterCaliper)
+        apply(Link(Link::permute, i.first, i.second));
+    if (input->rank()>1)
+      {
+        Link pivot(Link::pivot, "", HandleState());
+        pivot.outputHandles=state.outputHandles;
+        apply(move(pivot));
+      }
+    if (state.sortByValue!=HandleState::none && input->rank()==1)
       {
-        auto finalPivot=make_shared<Pivot>();
-        finalPivot->setArgument(chain.back());
-        finalPivot->setOrientation(state.outputHandles);
-        chain.push_back(finalPivot);
+        HandleState sortState;
+        sortState.order=state.sortByValue;
+        apply(Link(Link::sortByValue, "", sortState));
       }
-    if (state.sortByValue!=minsky::RavelState::HandleState::none && chain.back()->rank()==1)
+    links.erase(links.begin()+k, links.end());
+
+    m_chain.clear();
+    m_chain.push_back(arg);
+    for (auto& i: links) m_chain.push_back(i.op);
+    // the ravel's output is consumed in full
+    for (size_t i=0; i<links.size(); ++i)
       {
-        auto sortByValue=make_shared<SortByValue>(state.sortByValue);
-        sortByValue->setArgument(chain.back());
-        chain.push_back(sortByValue);
+        bool last=i+1==links.size();
+        if (auto pivot=dynamic_cast<Pivot*>(links[i].op.get()))
+          {
+            if (pivot->materialising()!=last) pivot->materialise(last);
+          }
+        else if (auto permuteAxis=dynamic_cast<PermuteAxis*>(links[i].op.get()))
+          if (permuteAxis->materialising()!=last) permuteAxis->materialise(last);
       }
-    return chain;
   }
+
+  vector<TensorPtr> createRavelChain(const minsky::RavelState& state, const TensorPtr& arg)
+  {
+    RavelChain chain;
+    chain.update(state, arg);
+    return chain.chain();
+  }
+
   
 }
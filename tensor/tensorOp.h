@@ -20,6 +20,7 @@
 #ifndef CIVITA_TENSOROP_H
 #define CIVITA_TENSOROP_H
 #include "tensorVal.h"
+#include "sparse.h"
 #include "ravelState.h"
 
 #include <functional>
@@ -29,6 +30,26 @@
 namespace civita
 {
 
+  /// access to an argument of an elementwise operation at the
+  /// result's hypercube indices. Arguments sharing the result's
+  /// sparsity are read directly, other sparse arguments via a hashed
+  /// lookup, and scalars are broadcast.
+  class ElementLookup
+  {
+    HashedIndex hashed;
+    bool scalar=false, aligned=true, dense=true;
+  public:
+    void set(const TensorPtr& arg, const Index& result);
+    /// element \a i of the result, with hypercube index \a hcIndex
+    double operator()(const ITensor& arg, size_t i, size_t hcIndex) const {
+      if (scalar) return arg[0];
+      if (aligned) return arg[i];
+      if (dense) return arg[hcIndex];
+      auto j=hashed.linealOffset(hcIndex);
+      return j<hashed.size()? arg[j]: nan("");
+    }
+  };
+
   /// perform an operation elementwise over a tensor valued argument
   struct ElementWiseOp: public ITensor
   {
@@ -51,6 +72,7 @@ namespace civita
   protected:
     std::function<double(double,double)> f;
     TensorPtr arg1, arg2;
+    ElementLookup lookup1, lookup2;
   public:
     template <class F>
     BinOp(F f, const TensorPtr& arg1={},const TensorPtr& arg2={}):
@@ -58,14 +80,11 @@ namespace civita
     
     void setArguments(const TensorPtr& a1, const TensorPtr& a2) override;
 
-    // TODO merge indices
-    double operator[](size_t i) const override {
-      auto hcIndex=index()[i];
-      // scalars are broadcast
-      return f(arg1->rank()? arg1->atHCIndex(hcIndex): (*arg1)[0],
-               arg2->rank()? arg2->atHCIndex(hcIndex): (*arg2)[0]);
+    double operator[](size_t i) const override;
+    size_t size() const override {
+      if (!m_index.empty()) return m_index.size();
+      return arg1 && arg1->size()>1? arg1->size(): (arg2? arg2->size(): 0);
     }
-    size_t size() const override {return arg1 && arg1->size()>1? arg1->size(): (arg2? arg2->size(): 0);}
     Timestamp timestamp() const override
     {return max(arg1->timestamp(), arg2->timestamp());}
   };
@@ -74,6 +93,7 @@ namespace civita
   class ReduceArguments: public ITensor
   {
     std::vector<TensorPtr> args;
+    std::vector<ElementLookup> lookups;
     std::function<void(double&,double)> f;
     double init;
   public:
@@ -91,6 +111,7 @@ namespace civita
     double init;
     std::shared_ptr<ITensor> arg;
     void setArgument(const TensorPtr& a,const std::string&,double) override {arg=a;}
+    bool replaceArgument(const TensorPtr& a) override {arg=a; return true;}
 
     template <class F>
     ReduceAllOp(F f, double init, const std::shared_ptr<ITensor>& arg={}):
@@ -105,8 +126,15 @@ namespace civita
   class ReductionOp: public ReduceAllOp
   {
     size_t dimension;
-    struct SOI {size_t index, dimIndex;};
-    std::map<size_t, std::vector<SOI>> sumOverIndices;
+    /// sparse argument entries, grouped by the output element they reduce into
+    AxisCompressedIndex fibres;
+    bool m_cache=false;
+    mutable std::vector<double> cachedValues;
+    mutable std::vector<bool> cached;
+    mutable Timestamp cacheTimestamp;
+  protected:
+    /// compute element \a i of the reduction
+    virtual double reduce(size_t i) const;
   public:
    
     template <class F>
@@ -114,19 +142,25 @@ namespace civita
       ReduceAllOp(f,init) {ReduceAllOp::setArgument(arg,dimName,0);}
 
     void setArgument(const TensorPtr& a, const std::string&,double) override;
+    bool replaceArgument(const TensorPtr& a) override
+    {arg=a; cachedValues.clear(); return true;}
     double operator[](size_t i) const override;
+    /// if set, computed elements are kept until the argument changes
+    void cache(bool c) {m_cache=c; cachedValues.clear();}
   };
 
   // general tensor expression - all elements calculated and cached
   class CachedTensorOp: public ITensor
   {
   protected:
+    /// allocated from the arena current when constructed, if any
     mutable TensorVal cachedResult;
     mutable Timestamp m_timestamp;
     /// computeTensor updates the above two mutable fields, but is
     /// logically const
     virtual void computeTensor() const=0;
   public:
+    CachedTensorOp(): cachedResult(TensorArena::current()) {}
     const Index& index() const override {return cachedResult.index();}
     size_t size() const override {return cachedResult.size();}
     double operator[](size_t i) const override;
@@ -168,8 +202,9 @@ namespace civita
     mutable size_t count;
   public:
     Average(): ReductionOp([this](double& x, double y,size_t){x+=y; ++count;},0) {}
-    double operator[](size_t i) const override
-    {count=0; return ReductionOp::operator[](i)/count;}
+  protected:
+    double reduce(size_t i) const override
+    {count=0; return ReductionOp::reduce(i)/count;}
   };
 
   /// calculates the standard deviation along an axis or whole tensor
@@ -179,9 +214,10 @@ namespace civita
     mutable double sqr;
   public:
     StdDeviation(): ReductionOp([this](double& x, double y,size_t){x+=y; sqr+=y*y; ++count;},0) {}
-    double operator[](size_t i) const override {
+  protected:
+    double reduce(size_t i) const override {
       count=0; sqr=0;
-      double av=ReductionOp::operator[](i)/count;
+      double av=ReductionOp::reduce(i)/count;
       return sqrt(std::max(0.0, sqr/count-av*av));
     }
   };
@@ -207,10 +243,20 @@ namespace civita
     void setArgument(const TensorPtr& arg, const std::string& dimName,double argVal) override {
       DimensionedArgCachedOp::setArgument(arg,dimName,argVal);
       if (arg)
-        cachedResult.hypercube(arg->hypercube());
-      // TODO - can we handle sparse data?
+        {
+          cachedResult.index(Index(arg->index()));
+          cachedResult.hypercube(arg->hypercube());
+          fibres=AxisCompressedIndex();
+          if (!arg->index().empty() && dimension<arg->rank())
+            fibres=AxisCompressedIndex(arg->hypercube(), arg->index(), dimension);
+        }
     }      
     void computeTensor() const override;
+  private:
+    /// sparse arguments are scanned along these fibres of the
+    /// argument's entries
+    AxisCompressedIndex fibres;
+    void computeSparse() const;
   };
 
   /// corresponds to OLAP slice operation
@@ -221,16 +267,37 @@ namespace civita
     std::vector<size_t> arg_index;
   public:
     void setArgument(const TensorPtr& a,const std::string&,double) override;
+    bool replaceArgument(const TensorPtr& a) override {arg=a; return true;}
     double operator[](size_t i) const override;
     Timestamp timestamp() const override {return arg->timestamp();}
   };
 
+  /// dense view of an argument, materialised in full by a cache
+  /// blocked transpose, and cached until the argument changes
+  class MaterialisedView
+  {
+    mutable std::vector<double> data;
+    mutable ITensor::Timestamp m_timestamp;
+  public:
+    bool enabled=false;
+    /// element \a i of \a arg, as viewed through \a view, which maps
+    /// view positions to \a arg's hypercube indices. The whole view is
+    /// computed on first access, and again on any access after \a arg
+    /// has changed.
+    double operator()(size_t i, const ITensor& arg, const Odometer& view) const;
+    void clear() {data.clear();}
+  };
+  
   /// corresponds to the OLAP pivot operation
   class Pivot: public ITensor
   {
     std::vector<size_t> permutation;   /// permutation of axes
     std::vector<size_t> permutedIndex; /// argument indices corresponding to this indices, when sparse
     TensorPtr arg;
+    /// maps this's hypercube index to arg's when dense. Only read by
+    /// const methods, so concurrent reads are safe.
+    Odometer odometer;
+    MaterialisedView materialised;
     // returns hypercube index of arg given hypercube index of this
     size_t pivotIndex(size_t i) const;
   public:
@@ -238,6 +305,13 @@ namespace civita
     /// set's the pivots orientation
     /// @param axes - list of axes that are the output
     void setOrientation(const std::vector<std::string>& axes);
+    /// if set, the dense output is transposed in full into a buffer
+    /// when first read, rather than computed per element. Use when the
+    /// output is consumed in full.
+    void materialise(bool m) {materialised.enabled=m; materialised.clear();}
+    bool materialising() const {return materialised.enabled;}
+    bool replaceArgument(const TensorPtr& a) override
+    {arg=a; materialised.clear(); return true;}
     double operator[](size_t i) const override;
     Timestamp timestamp() const override {return arg->timestamp();}
   };
@@ -248,9 +322,17 @@ namespace civita
     size_t m_axis;
     std::vector<size_t> m_permutation;
     std::vector<size_t> permutedIndex; /// argument indices corresponding to this indices, when sparse
+    /// maps this's hypercube index to arg's when dense
+    Odometer odometer;
+    MaterialisedView materialised;
   public:
     void setArgument(const TensorPtr& a,const std::string& axis="",double arg=0) override;
     void setPermutation(std::vector<size_t>&&);
+    /// as for Pivot::materialise
+    void materialise(bool m) {materialised.enabled=m; materialised.clear();}
+    bool materialising() const {return materialised.enabled;}
+    bool replaceArgument(const TensorPtr& a) override
+    {arg=a; materialised.clear(); return true;}
     size_t axis() const {return m_axis;}
     const std::vector<size_t>& permutation() const {return m_permutation;}
     double operator[](size_t i) const override;
@@ -271,6 +353,7 @@ namespace civita
         arg=a;
       cachedResult.hypercube(a->hypercube()); // no data, unsorted
     }
+    bool replaceArgument(const TensorPtr& a) override {arg=a; return true;}
     void computeTensor() const override;
     Timestamp timestamp() const override {return arg->timestamp();}
     const Hypercube& hypercube() const override {
@@ -288,6 +371,41 @@ namespace civita
   /// state \a state, operating on \a arg
   std::vector<TensorPtr> createRavelChain(const minsky::RavelState&, const TensorPtr& arg);
 
+  /// A ravel's chain of operations, kept across changes to the ravel
+  /// state. An update recomputes only the operations affected by the
+  /// change: moving a slicer updates its Slice, rotating output
+  /// handles updates the Pivot, and collapsed axis reductions cache
+  /// their values.
+  class RavelChain
+  {
+    struct Link
+    {
+      enum Type {reduction, slice, permute, pivot, sortByValue};
+      Type type;
+      std::string axis;
+      minsky::RavelState::HandleState state; ///< state this link implements
+      std::vector<std::string> outputHandles; ///< used by pivot
+      TensorPtr op;
+      Link(Type type, const std::string& axis, const minsky::RavelState::HandleState& state):
+        type(type), axis(axis), state(state) {}
+      /// true if \a x's parameters for this link type are the same
+      bool sameParameters(const Link& x) const;
+      /// (re)initialise op from \a arg. If \a argChanged is false,
+      /// only the parameters have changed
+      void build(const TensorPtr& arg, bool argChanged);
+    };
+    std::vector<Link> links;
+    TensorPtr arg;
+    Hypercube argHypercube;
+    Index argIndex;
+    std::vector<TensorPtr> m_chain;
+  public:
+    /// bring the chain up to date with \a state applied to \a arg
+    void update(const minsky::RavelState& state, const TensorPtr& arg);
+    /// the argument, followed by the chain's operations. back() is the result
+    const std::vector<TensorPtr>& chain() const {return m_chain;}
+  };
+
 }
 
 #endif
@@ -21,8 +21,10 @@
 #define CIVITA_TENSORVAL_H
 
 #include "tensorInterface.h"
+#include "tensorArena.h"
 #include <vector>
 #include <chrono>
+#include <memory>
 
 namespace civita
 {
@@ -63,53 +65,126 @@ namespace civita
     typedef double* iterator;
     typedef const double* const_iterator;
 
-    const_iterator begin() const {return const_cast<ITensorVal*>(this)->begin();}
+    /// contiguous elements that can be read in place, without
+    /// loading or converting them, or null
+    virtual const double* inPlaceData() const {return nullptr;}
+    /// elements are read in place where inPlaceData() is available,
+    /// otherwise loaded, as for non-const access
+    const_iterator begin() const {
+      if (auto d=inPlaceData()) return d;
+      return const_cast<ITensorVal*>(this)->begin();
+    }
     const_iterator end() const {return begin()+size();}
     iterator begin() {return &((*this)[0]);}
     iterator end() {return begin()+size();}
   };
   
+  /// source of a TensorVal's data, loaded when first accessed
+  struct TensorValLoader
+  {
+    virtual ~TensorValLoader() {}
+    /// number of elements
+    virtual size_t size() const=0;
+    /// write size() elements to \a data
+    virtual void load(double* data) const=0;
+    /// size() elements that can be read in place, such as from a
+    /// mapped file, or null if they must be loaded
+    virtual const double* data() const {return nullptr;}
+    /// as data(), for elements stored in single precision
+    virtual const float* floatData() const {return nullptr;}
+  };
+
   /// represent a tensor in initialisation expressions
   class TensorVal: public ITensorVal
   {
-    std::vector<double> data;
+    /// drawn from the heap, unless constructed with an arena
+    typedef std::vector<double, ArenaAllocator<double>> Data;
+    mutable Data data;
     Timestamp m_timestamp;
+    /// source of data yet to be loaded, if any
+    mutable std::shared_ptr<const TensorValLoader> m_loader;
+    /// m_loader's data, if read in place
+    mutable const double* m_inPlace=nullptr;
+    mutable const float* m_inPlaceFloat=nullptr;
     CLASSDESC_ACCESS(TensorVal);
   public:
     TensorVal(): data(1) {}
     TensorVal(double x): data(1,x) {}
+    /// data is allocated from \a arena, if not null
+    explicit TensorVal(TensorArena* arena): data(1, 0.0, ArenaAllocator<double>(arena)) {}
     TensorVal(const Hypercube& hc): ITensorVal(hc) {}
     TensorVal(Hypercube&& hc): ITensorVal(std::move(hc)) {}
     TensorVal(const std::vector<unsigned>& dims): ITensorVal(dims) {}
 
     using ITensorVal::index;
     const Index& index(Index&& idx) override {
+      updateTimestamp();
       m_index=idx;
-      if (!m_index.empty()) {
+      if (!m_index.empty() && !deferred(m_index.size())) {
+        loadData();
         data.resize(idx.size());
       }
       return m_index;
     }
     const Hypercube& hypercube(const Hypercube& hc) override
-    {m_hypercube=hc; allocVal(); return m_hypercube;}
+    {m_hypercube=hc; allocVal(); updateTimestamp(); return m_hypercube;}
     const Hypercube& hypercube(Hypercube&& hc) override 
-    {m_hypercube=std::move(hc);allocVal();return m_hypercube;}
+    {m_hypercube=std::move(hc);allocVal();updateTimestamp();return m_hypercube;}
     using ITensor::hypercube;
 
-    void allocVal() {if (m_index.empty()) data.resize(hypercube().numElements());}
+    void allocVal() {
+      if (m_index.empty() && !deferred(hypercube().numElements()))
+        {
+          loadData();
+          data.resize(hypercube().numElements());
+        }
+    }
+
+    /// defer loading data from \a loader until first accessed. The
+    /// index and hypercube set afterwards should be consistent with
+    /// loader->size(), otherwise the data is loaded immediately.
+    void deferData(const std::shared_ptr<const TensorValLoader>& loader)
+    {data.clear(); data.shrink_to_fit(); setLoader(loader); updateTimestamp();}
+    /// source of data yet to be loaded, or null if loaded
+    const std::shared_ptr<const TensorValLoader>& deferredData() const {return m_loader;}
+    /// true if data is read in place from the loader, rather than
+    /// held in memory or yet to be loaded. Const access reads in
+    /// place; non-const access loads a copy.
+    bool readInPlace() const {return m_inPlace || m_inPlaceFloat;}
+    const double* inPlaceData() const override
+    {return m_inPlace? m_inPlace: m_loader || data.empty()? nullptr: data.data();}
+    /// load any deferred data. Not thread safe, so should be called
+    /// before the tensor is shared between threads.
+    void loadData() const {
+      if (m_loader)
+        {
+          Data tmp(m_loader->size(), 0.0, data.get_allocator());
+          m_loader->load(tmp.data());
+          data.swap(tmp);
+          setLoader(nullptr);
+        }
+    }
 
     // assign a sparse data set
     TensorVal& operator=(const std::map<size_t,double>& x) {
+      setLoader(nullptr);
       m_index=x;
       data.clear(); data.reserve(x.size());
       for (auto& j: x) data.push_back(j.second);
+      updateTimestamp();
       return *this;
     }
     
-    double operator[](size_t i) const override {return data.empty()? 0: data[i];}
-    double& operator[](size_t i) override {return data[i];}
-    size_t size() const override {return std::max(data.size(),size_t(1));}
+    double operator[](size_t i) const override {
+      if (m_inPlace) return m_inPlace[i];
+      if (m_inPlaceFloat) return m_inPlaceFloat[i];
+      loadData(); return data.empty()? 0: data[i];
+    }
+    double& operator[](size_t i) override {loadData(); return data[i];}
+    size_t size() const override
+    {return std::max(m_loader? m_loader->size(): data.size(),size_t(1));}
     const TensorVal& operator=(const ITensor& x) override {
+      if (&x!=this) setLoader(nullptr); // overwritten, so need not be loaded
       hypercube(x.hypercube());
       m_index=index();
       data.resize(x.size());
@@ -120,8 +195,18 @@ namespace civita
 
     Timestamp timestamp() const override {return m_timestamp;}
     // timestamp should be updated every time the data r index vectors
-    // is updated, if using the CachedTensorOp functionality
+    // is updated, if using the CachedTensorOp functionality. It is
+    // updated when the index, hypercube or deferred data are set, but
+    // not by writes through operator[].
     void updateTimestamp() {m_timestamp=std::chrono::high_resolution_clock::now();}
+  private:
+    /// true if data is deferred, and will load \a n elements
+    bool deferred(size_t n) const {return m_loader && m_loader->size()==n;}
+    void setLoader(const std::shared_ptr<const TensorValLoader>& loader) const {
+      m_loader=loader;
+      m_inPlace=loader? loader->data(): nullptr;
+      m_inPlaceFloat=loader? loader->floatData(): nullptr;
+    }
   };
 
   /// for use in Minsky init expressions
@@ -53,41 +53,38 @@ namespace civita
 
   bool XVector::operator==(const XVector& x) const
   {
-    if (dimension.type!=x.dimension.type || name!=x.name ||
-        size()!=x.size())
-      return false;
-    for (auto i=begin(), j=x.begin(); i!=end(); ++i, ++j)
-      switch (dimension.type)
-        {
-        case Dimension::string:
-          try
-            {
-              if (any_cast<string>(*i)!=any_cast<string>(*j))
-                return false;
-            }
-          catch (const bad_any_cast&)
-            {
-              if (strcmp(any_cast<const char*>(*i), any_cast<const char*>(*j))!=0)
-                return false;
-            }
-          break;
-        case Dimension::value:
-          if (any_cast<double>(*i)!=any_cast<double>(*j))
-            return false;
-          break;
-        case Dimension::time:
-          if (any_cast<ptime>(*i)!=any_cast<ptime>(*j))
-            return false;
-          break;
-        default:
-          throw error("unknown dimension type");
-        }
-    return true;
+    return dimension.type==x.dimension.type && name==x.name && m_labels==x.m_labels;
   }
   
   void XVector::push_back(const std::string& s)
   {
-    V::push_back(anyVal(dimension, s));
+    push_back(anyVal(dimension, s));
+  }
+
+  namespace
+  {
+    Dimension::Type labelType(const boost::any& x)
+    {
+      if (any_cast<string>(&x) || any_cast<const char*>(&x))
+        return Dimension::string;
+      if (any_cast<ptime>(&x))
+        return Dimension::time;
+      if (any_cast<double>(&x))
+        return Dimension::value;
+      throw error("unsupported label type");
+    }
+  }
+
+  void XVector::push_back(const boost::any& x)
+  {
+    auto type=labelType(x);
+    // the first label determines the column type
+    if (m_labels.empty() && m_labels.type()!=type)
+      m_labels=LabelColumn(type);
+    if (type==m_labels.type())
+      m_labels.push_back(x);
+    else
+      m_labels.push_back(anyVal(Dimension(m_labels.type(), dimension.units), str(x)));
   }
 
   boost::any anyVal(const Dimension& dim, const std::string& s)
@@ -255,11 +252,11 @@ namespace civita
 
   string XVector::timeFormat() const
   {
-    if (dimension.type!=Dimension::time || empty()) return "";
+    if (dimension.type!=Dimension::time || m_labels.type()!=Dimension::time || empty()) return "";
     static const auto day=hours(24);
     static const auto month=day*30;
     static const auto year=day*365;
-    auto f=any_cast<ptime>(front()), b=any_cast<ptime>(back());
+    auto f=int64ToTime(m_labels.times().front()), b=int64ToTime(m_labels.times().back());
     if (f>b) std::swap(f,b);
     auto dt=b-f;
     if (dt > year*5)
@@ -282,22 +279,12 @@ namespace civita
   
   void XVector::imposeDimension()
   {
-    // check if anything to be done
-    switch (dimension.type)
-      {
-      case Dimension::string:
-        if (checkType<string>()) return;
-        break;
-      case Dimension::value:
-        if (checkType<double>()) return;
-        break;
-      case Dimension::time:
-        if (checkType<ptime>()) return;
-        break;
-      }
-
-    for (auto& i: *this)
-      i=anyVal(dimension, str(i));
+    if (m_labels.type()==dimension.type) return;
+    LabelColumn labels(dimension.type);
+    labels.reserve(size());
+    for (auto i: *this)
+      labels.push_back(anyVal(dimension, str(i)));
+    m_labels=std::move(labels);
   }
 
 }
@@ -20,10 +20,12 @@
 #ifndef CIVITA_XVECTOR_H
 #define CIVITA_XVECTOR_H
 #include "dimension.h"
+#include "labelColumn.h"
 #include <boost/any.hpp>
 #include <boost/date_time.hpp>
 #include <vector>
 #include <initializer_list>
+#include <iterator>
 
 namespace civita
 {
@@ -49,32 +51,81 @@ namespace civita
   boost::posix_time::ptime sToPtime(const std::string& s);
 
   /// labels describing the points along dimensions. These can be strings (text type), time values (boost::posix_time type) or numerical values (double)
-  struct XVector: public std::vector<boost::any>
+  /// Labels are held in a typed LabelColumn, and presented as anys by
+  /// value, so they cannot be modified in place.
+  struct XVector
   {
     typedef std::vector<boost::any> V;
     std::string name;
     Dimension dimension;
     XVector() {}
-    XVector(const std::string& name, const V& v=V()): V(v), name(name) {}
+    XVector(const std::string& name, const V& v=V()): name(name)
+    {for (auto& i: v) push_back(i);}
     XVector(const std::string& name, const std::initializer_list<const char*>& v): name(name)
     {for (auto i: v) push_back(i);}
+
+    /// iterates over the labels as anys
+    class const_iterator
+    {
+      const LabelColumn* labels=nullptr;
+      std::ptrdiff_t i=0;
+    public:
+      typedef std::random_access_iterator_tag iterator_category;
+      typedef boost::any value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef const boost::any* pointer;
+      typedef const boost::any reference;
+      const_iterator() {}
+      const_iterator(const LabelColumn& labels, size_t i): labels(&labels), i(i) {}
+      const boost::any operator*() const {return (*labels)[i];}
+      const boost::any operator[](difference_type n) const {return (*labels)[i+n];}
+      size_t index() const {return i;}
+      const_iterator& operator++() {++i; return *this;}
+      const_iterator operator++(int) {auto r=*this; ++i; return r;}
+      const_iterator& operator--() {--i; return *this;}
+      const_iterator operator--(int) {auto r=*this; --i; return r;}
+      const_iterator& operator+=(difference_type n) {i+=n; return *this;}
+      const_iterator& operator-=(difference_type n) {i-=n; return *this;}
+      const_iterator operator+(difference_type n) const {return const_iterator(*this)+=n;}
+      const_iterator operator-(difference_type n) const {return const_iterator(*this)-=n;}
+      difference_type operator-(const const_iterator& x) const {return i-x.i;}
+      bool operator==(const const_iterator& x) const {return i==x.i;}
+      bool operator!=(const const_iterator& x) const {return i!=x.i;}
+      bool operator<(const const_iterator& x) const {return i<x.i;}
+    };
+    typedef const_iterator iterator;
+
+    size_t size() const {return m_labels.size();}
+    bool empty() const {return m_labels.empty();}
+    void clear() {m_labels.clear();}
+    void reserve(size_t n) {m_labels.reserve(n);}
+    const_iterator begin() const {return const_iterator(m_labels,0);}
+    const_iterator end() const {return const_iterator(m_labels,size());}
+    const boost::any operator[](size_t i) const {return m_labels[i];}
+    const boost::any front() const {return m_labels[0];}
+    const boost::any back() const {return m_labels[size()-1];}
+    /// the labels, in their typed representation
+    const LabelColumn& labels() const {return m_labels;}
+    
     bool operator==(const XVector& x) const;
+    bool operator!=(const XVector& x) const {return !operator==(x);}
+    /// append a label. The first label sets the type of the labels,
+    /// subsequent ones of a different type are converted to it.
+    void push_back(const boost::any&);
+    /// append a label parsed according to dimension
     void push_back(const std::string&);
     void push_back(const char* x) {push_back(std::string(x));}
-    using V::push_back;
+    /// remove labels [\a first, \a last)
+    void erase(const_iterator first, const_iterator last)
+    {m_labels.erase(first.index(), last.index());}
+    /// exchange labels with \a x. Names and dimensions are not exchanged.
+    void swap(XVector& x) {std::swap(m_labels, x.m_labels);}
     /// best time format given range of data for plot xticks and spreadsheet labels
     std::string timeFormat() const;
     /// rewrites the labels according to dimension
     void imposeDimension();
-    /// @return true if all elements of this are of type T
-    template <class T>
-    bool checkType() {
-      for (auto& i:*this)
-        if (!boost::any_cast<T>(&i))
-          return false;
-      return true;
-    }
-
+  private:
+    LabelColumn m_labels;
   };
 
 }
@@ -17,10 +17,13 @@
   along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "CSVParser.h"
+#include "csvCache.h"
 #include "group.h"
+#include "minsky.h"
 #include "selection.h"
 #include "minsky_epilogue.h"
 #include <UnitTest++/UnitTest++.h>
+#include <boost/filesystem.hpp>
 using namespace minsky;
 using namespace std;
 
@@ -79,6 +82,23 @@ SUITE(CSVParser)
       CHECK((set<unsigned>{0,1}==dimensionCols));
     }
 
+  TEST_FIXTURE(DataSpec,guessMissingTokenLabels)
+    {
+      // missing value tokens are labels here, such as NA for Namibia
+      string input="code;A;B\n"
+        "NA;1;2\n"
+        "-;3;4\n";
+
+      istringstream is(input);
+      guessFromStream(is);
+
+      CHECK_EQUAL(';',separator);
+      CHECK_EQUAL(1,nRowAxes());
+      CHECK_EQUAL(1,nColAxes());
+      CHECK_EQUAL(0,headerRow);
+      CHECK((set<unsigned>{0}==dimensionCols));
+    }
+
   TEST_FIXTURE(DataSpec,guessColumnar)
     {
       string input="Country,Time_Period,value$\n"
@@ -308,4 +328,259 @@ SUITE(CSVParser)
       }
     }
   
+
+  TEST_FIXTURE(DataSpec, loadVarFromFile)
+    {
+      string filename="loadVarFromFile.csv";
+      {
+        ofstream f(filename);
+        f<<"A comment\n"
+          ";;foobar\n"
+          "foo;bar;A;B;C\n";
+        // sufficiently large to be split across multiple threads
+        for (int i=0; i<100000; ++i)
+          f<<"\"a;"<<i%100<<"\";B"<<i%37<<";"<<i<<";1,"<<i%1000<<".5;\n";
+      }
+      separator=';';
+      setDataArea(3,2);
+      headerRow=2;
+      dimensionNames={"foo","bar"};
+      dimensionCols={0,1};
+      horizontalDimName="foobar";
+
+      for (auto action: {sum, av, min, max})
+        {
+          duplicateKeyAction=action;
+          VariableValue fromStream, fromFile;
+          ifstream is(filename);
+          loadValueFromCSVFile(fromStream,is,*this);
+          loadValueFromCSVFile(fromFile,filename,*this);
+
+          CHECK(fromStream.hypercube()==fromFile.hypercube());
+          CHECK_EQUAL(fromStream.tensorInit.size(), fromFile.tensorInit.size());
+          auto& streamIndex=fromStream.tensorInit.index();
+          auto& fileIndex=fromFile.tensorInit.index();
+          CHECK(vector<size_t>(streamIndex.begin(),streamIndex.end())==vector<size_t>(fileIndex.begin(),fileIndex.end()));
+          for (size_t i=0; i<fromStream.tensorInit.size(); ++i)
+            CHECK_CLOSE(fromStream.tensorInit[i], fromFile.tensorInit[i], 1e-6*abs(fromStream.tensorInit[i]));
+        }
+
+      duplicateKeyAction=throwException;
+      VariableValue v;
+      CHECK_THROW(loadValueFromCSVFile(v,filename,*this), std::exception);
+      remove(filename.c_str());
+    }
+
+  TEST_FIXTURE(DataSpec, preflight)
+    {
+      string filename="preflight.csv";
+      {
+        ofstream f(filename);
+        f<<"A comment\n"
+          ";;foobar\n"
+          "foo;bar;A;B;C\n"
+          "A;A;1.2;1.3;1.4\n"
+          "A;B;1;;3\n"
+          "B;A;3;2;1\n";
+      }
+      separator=';';
+      setDataArea(3,2);
+      headerRow=2;
+      dimensionCols={0,1};
+
+      auto sizing=preflightCSVFile(filename,*this);
+      CHECK_ARRAY_EQUAL(vector<size_t>({2,2,3}), sizing.dims, 3);
+      CHECK_EQUAL(8, sizing.numCells);
+      CHECK_EQUAL(12*sizeof(double), sizing.denseBytes());
+      CHECK(sizing.dense());
+      CHECK_EQUAL(sizing.denseBytes(), sizing.bytes());
+
+      VariableValue v;
+      loadValueFromCSVFile(v,filename,*this,sizing);
+      CHECK_EQUAL(12, v.tensorInit.size());
+      CHECK(v.tensorInit.index().empty());
+
+      // a sizing is only reused for the same file, spec and file content
+      CHECK(sizing.sizes(filename,*this));
+      DataSpec spec=*this;
+      spec.dimensionCols={0};
+      CHECK(!sizing.sizes(filename,spec));
+      boost::filesystem::last_write_time(filename, sizing.mtime+10);
+      CHECK(!sizing.sizes(filename,*this));
+      remove(filename.c_str());
+    }
+
+  TEST(parseNumber)
+    {
+      double v;
+      CHECK_EQUAL(numberField, parseNumber(" -1,234.5 ",'.',v));
+      CHECK_EQUAL(-1234.5, v);
+      CHECK_EQUAL(numberField, parseNumber("1.234,5",',',v));
+      CHECK_EQUAL(1234.5, v);
+      CHECK_EQUAL(numberField, parseNumber("12.5%",'.',v));
+      CHECK_CLOSE(0.125, v, 1e-15);
+      CHECK_EQUAL(numberField, parseNumber("\"1.5e-3\"",'.',v));
+      CHECK_EQUAL(0.0015, v);
+      CHECK_EQUAL(numberField, parseNumber("0.1",'.',v));
+      CHECK_EQUAL(0.1, v);
+      CHECK_EQUAL(numberField, parseNumber("3.14159265358979323846",'.',v));
+      CHECK_EQUAL(3.14159265358979323846, v);
+      CHECK_EQUAL(missingField, parseNumber("",'.',v));
+      CHECK_EQUAL(missingField, parseNumber("N/A",'.',v));
+      CHECK_EQUAL(invalidField, parseNumber("12abc",'.',v));
+      CHECK_EQUAL(invalidField, parseNumber("foo",'.',v));
+      // a leading separator is a decimal point
+      CHECK_EQUAL(numberField, parseNumber(".5",',',v));
+      CHECK_EQUAL(0.5, v);
+      CHECK_EQUAL(numberField, parseNumber("-,5",'.',v));
+      CHECK_EQUAL(-0.5, v);
+    }
+
+  TEST_FIXTURE(DataSpec, doubledQuotes)
+    {
+      string filename="doubledQuotes.csv";
+      {
+        ofstream f(filename);
+        f<<"x,y\n"
+          "\"a\"\"b\",1\n"
+          "\"c,\"\"\nd\",2\n";
+      }
+      escape='"';
+      setDataArea(1,1);
+      dimensionCols={0};
+      VariableValue v;
+      loadValueFromCSVFile(v,filename,*this);
+      auto& xv=v.hypercube().xvectors[0];
+      CHECK_EQUAL(2, xv.size());
+      CHECK_EQUAL("a\"b", str(xv[0]));
+      CHECK_EQUAL("c,\"\nd", str(xv[1]));
+      CHECK_EQUAL(1, v.tensorInit[0]);
+      CHECK_EQUAL(2, v.tensorInit[1]);
+      remove(filename.c_str());
+    }
+
+  TEST_FIXTURE(DataSpec, csvCache)
+    {
+      string filename="csvCache.csv";
+      {
+        ofstream f(filename);
+        f<<"foo;bar;A;B\n";
+        for (int i=0; i<100000; ++i)
+          f<<"a"<<i%1000<<";b"<<i/1000<<";"<<i<<";"<<i%7<<"\n";
+      }
+      separator=';';
+      setDataArea(1,2);
+      headerRow=0;
+      dimensionNames={"foo","bar"};
+      dimensionCols={0,1};
+      horizontalDimName="foobar";
+
+      VariableValue v;
+      loadValueFromCSVFile(v,filename,*this);
+      CHECK(CSVCache::store(v,filename,*this));
+
+      // values are read in place from the sidecar
+      {
+        VariableValue cached(VariableType::parameter);
+        CHECK(CSVCache::restore(cached,filename,*this));
+        CHECK(cached.tensorInit.readInPlace());
+        // const iteration reads in place, rather than loading
+        const civita::TensorVal& tensorInit=cached.tensorInit;
+        CHECK(tensorInit.begin() && tensorInit.begin()==tensorInit.inPlaceData());
+        CHECK(cached.tensorInit.readInPlace());
+        CHECK(v.hypercube()==cached.hypercube());
+        CHECK_EQUAL(v.tensorInit.size(), cached.size());
+        for (size_t i=0; i<v.tensorInit.size(); i+=997)
+          CHECK_EQUAL(v.tensorInit[i], cached.value(i));
+      }
+
+      // a different spec invalidates the sidecar
+      duplicateKeyAction=sum;
+      VariableValue notCached;
+      CHECK(!CSVCache::restore(notCached,filename,*this));
+      CHECK_EQUAL(0, notCached.rank());
+      duplicateKeyAction=throwException;
+
+      // a touched file is validated by its content
+      auto mtime=boost::filesystem::last_write_time(filename);
+      boost::filesystem::last_write_time(filename, mtime+10);
+      {
+        VariableValue cached;
+        CHECK(CSVCache::restore(cached,filename,*this));
+      }
+      {
+        fstream f(filename, ios::in|ios::out);
+        f.seekp(4);
+        f<<'c'; // same size, different content
+      }
+      boost::filesystem::last_write_time(filename, mtime+20);
+      {
+        VariableValue cached;
+        CHECK(!CSVCache::restore(cached,filename,*this));
+      }
+
+      remove(CSVCache::fileName(filename).c_str());
+      remove(filename.c_str());
+    }
+
+  TEST_FIXTURE(DataSpec, appendImport)
+    {
+      string filename="appendImport.csv";
+      separator=',';
+      setDataArea(1,2);
+      headerRow=0;
+      dimensionNames={"region","date"};
+      dimensionCols={0,1};
+      duplicateKeyAction=sum;
+
+      for (bool sparse: {false, true})
+        {
+          {
+            ofstream f(filename);
+            f<<"region,date,value\n";
+            for (int d=0; d<10; ++d)
+              for (int r=0; r<3; ++r)
+                if (!sparse || r==d%3)
+                  f<<"R"<<r<<",D"<<d<<","<<10*d+r<<"\n";
+          }
+          VariableValue v;
+          CSVImportState state;
+          loadValueFromCSVFile(v,filename,*this,preflightCSVFile(filename,*this),&state);
+          CHECK_EQUAL(sparse, !v.tensorInit.index().empty());
+          auto timestamp=v.tensorInit.timestamp();
+          
+          {
+            ofstream f(filename, ios::app);
+            for (int d=10; d<12; ++d)
+              for (int r=0; r<4; ++r)
+                if (!sparse || r==d%3)
+                  f<<"R"<<r<<",D"<<d<<","<<10*d+r<<"\n";
+            f<<"R0,D0,1000\n"; // combined with existing data
+          }
+          CHECK(appendValueFromCSVFile(v,filename,*this,state));
+          CHECK(v.tensorInit.timestamp()>timestamp);
+
+          VariableValue full;
+          loadValueFromCSVFile(full,filename,*this);
+          CHECK(full.hypercube()==v.hypercube());
+          CHECK_EQUAL(full.tensorInit.size(), v.tensorInit.size());
+          auto& fullIndex=full.tensorInit.index();
+          auto& appendIndex=v.tensorInit.index();
+          CHECK(vector<size_t>(fullIndex.begin(),fullIndex.end())==
+                vector<size_t>(appendIndex.begin(),appendIndex.end()));
+          for (size_t i=0; i<full.tensorInit.size(); ++i)
+            if (!isnan(full.tensorInit[i]))
+              CHECK_EQUAL(full.tensorInit[i], v.tensorInit[i]);
+          
+          // nothing more to append
+          CHECK(appendValueFromCSVFile(v,filename,*this,state));
+          // file rewritten
+          {
+            ofstream f(filename);
+            f<<"region,date,value\n";
+          }
+          CHECK(!appendValueFromCSVFile(v,filename,*this,state));
+        }
+      remove(filename.c_str());
+    }
 }
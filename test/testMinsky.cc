@@ -17,9 +17,14 @@
   along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "minsky.h"
+#include "equationCache.h"
+#include "autoSaver.h"
+#include "mappedTensor.h"
+#include "schema3.h"
 #include "minsky_epilogue.h"
 #include <UnitTest++/UnitTest++.h>
 #include <gsl/gsl_integration.h>
+#include <boost/filesystem.hpp>
 using namespace minsky;
 
 namespace
@@ -35,6 +40,20 @@ namespace
     string getClipboard() const override {return clipboard;}
     void putClipboard(const string& x) const override {clipboard=x;}
     void message(const string& x) override {savedMessage=x;}
+
+    /// add a constant of 10 wired into an integral named "output",
+    /// stepped once per time unit, so that output=10t
+    IntOp& integrateConstant()
+    {
+      auto constant=model->addItem(new VarConstant);
+      auto integral=model->addItem(OperationPtr(OperationBase::integrate));
+      model->addWire(*constant,*integral,1,vector<float>());
+      constant->variableCast()->init("10");
+      auto& intOp=dynamic_cast<IntOp&>(*integral);
+      intOp.description("output");
+      nSteps=1;
+      return intOp;
+    }
   };
 }
 
@@ -1175,4 +1194,729 @@ SUITE(Minsky)
         CHECK_EQUAL(clonedIntVar->name(), model->items[1]->variableCast()->name());
       }
     
+    TEST_FIXTURE(TestFixture, pasteCopiesDirectly)
+      {
+        auto g=model->addGroup(new Group);
+        auto param=g->addItem(VariablePtr(VariableType::parameter,"p"));
+        auto paramValue=param->variableCast()->vValue();
+        paramValue->tensorInit.hypercube(civita::Hypercube(vector<unsigned>{10}));
+        for (size_t i=0; i<paramValue->tensorInit.size(); ++i) paramValue->tensorInit[i]=i;
+        auto op=g->addItem(OperationBase::create(OperationType::exp));
+        g->addWire(*param, *op, 1);
+        canvas.selection.ensureGroupInserted(g);
+        copy();
+        CHECK(clipboardCopy);
+
+        // pasted from the clipboard copy, then from the clipboard's XML
+        for (bool direct: {true, false})
+          {
+            if (!direct) clipboardCopy.reset();
+            paste();
+            CHECK_EQUAL(direct? 2: 3, model->groups.size());
+            auto pasted=model->groups.back();
+            CHECK(pasted!=g);
+            CHECK_EQUAL(2, pasted->items.size());
+            CHECK_EQUAL(1, pasted->wires.size());
+            for (auto& i: pasted->items)
+              if (auto v=i->variableCast())
+                {
+                  CHECK(v->vValue()!=paramValue);
+                  CHECK_EQUAL(10, v->vValue()->tensorInit.size());
+                  CHECK_EQUAL(9, v->vValue()->tensorInit[9]);
+                }
+          }
+      }
+
+    TEST_FIXTURE(TestFixture, pasteGodley)
+      {
+        auto g=model->addGroup(new Group);
+        auto godley=new GodleyIcon;
+        g->addItem(godley);
+        godley->table.resize(3,3);
+        godley->table.cell(0,1)="c";
+        godley->table.cell(0,2)="d";
+        godley->table.cell(2,1)="a";
+        godley->table.cell(2,2)="b";
+        godley->update();
+        auto numItems=g->items.size();
+        CHECK_EQUAL(5, numItems);
+
+        canvas.selection.ensureGroupInserted(g);
+        copy();
+        for (bool direct: {true, false})
+          {
+            if (!direct) clipboardCopy.reset();
+            paste();
+            // cloning the table does not add variables to the source group
+            CHECK_EQUAL(numItems, g->items.size());
+            auto pasted=model->groups.back();
+            CHECK(pasted!=g);
+            CHECK_EQUAL(numItems, pasted->items.size());
+            for (auto& i: pasted->items)
+              if (auto v=i->variableCast())
+                CHECK(v->controller.lock() && v->controller.lock()->group.lock()==pasted);
+          }
+      }
+
+    TEST_FIXTURE(TestFixture, cutVariableValues)
+      {
+        auto g=model->addGroup(new Group);
+        g->addItem(VariablePtr(VariableType::parameter,"p"))->variableCast()->init("2");
+        auto q=model->addItem(VariablePtr(VariableType::parameter,"q"));
+        q->variableCast()->init("3");
+        auto qValueId=q->variableCast()->valueId();
+        canvas.selection.ensureGroupInserted(g);
+        canvas.selection.ensureItemInserted(q);
+        auto numValues=variableValues.size();
+        copy();
+        // the clipboard copy's values are kept out of variableValues
+        CHECK_EQUAL(numValues, variableValues.size());
+
+        cut();
+        CHECK_EQUAL(0, variableValues.count(qValueId));
+        CHECK_EQUAL(numValues-2, variableValues.size());
+
+        paste();
+        CHECK_EQUAL(1, variableValues.count(qValueId));
+        CHECK_EQUAL("3", variableValues[qValueId]->init);
+        CHECK_EQUAL(1, model->groups.size());
+        CHECK_EQUAL("2", model->groups[0]->items[0]->variableCast()->init());
+      }
+
+    TEST_FIXTURE(TestFixture, checkpointRestore)
+      {
+        auto& integral=integrateConstant();
+        reset();
+        step();
+        step();
+        double tc=t;
+        auto stocks=stockVars;
+        checkpoint("checkpoint.dat");
+        waitForCheckpoint();
+
+        step();
+        CHECK(t>tc);
+        restoreCheckpoint("checkpoint.dat");
+        CHECK_EQUAL(tc, t);
+        CHECK_ARRAY_EQUAL(stocks, stockVars, stocks.size());
+        CHECK(!reset_flag());
+
+        // layout changes do not change the model's identity
+        auto hash=modelHash();
+        integral.moveTo(integral.x()+100, integral.y());
+        markEdited();
+        CHECK_EQUAL(hash, modelHash());
+        restoreCheckpoint("checkpoint.dat");
+        CHECK_EQUAL(tc, t);
+
+        // a checkpoint from a different model is rejected
+        model->addItem(new VarConstant);
+        markEdited();
+        CHECK_THROW(restoreCheckpoint("checkpoint.dat"), std::exception);
+        boost::filesystem::remove("checkpoint.dat");
+      }
+    
+    TEST_FIXTURE(TestFixture, streamLoad)
+      {
+        auto param=model->addItem(VariablePtr(VariableType::parameter,"p"));
+        auto& tensorInit=dynamic_cast<VariableBase&>(*param).vValue()->tensorInit;
+        tensorInit.hypercube(civita::Hypercube(vector<unsigned>{3,2}));
+        for (size_t i=0; i<tensorInit.size(); ++i) tensorInit[i]=i;
+        auto op=model->addItem(OperationBase::create(OperationType::exp));
+        model->addWire(*param, *op, 1);
+        auto group=model->addGroup(new Group);
+        group->addItem(VariablePtr(VariableType::flow,"x"));
+        save("streamLoad.mky");
+
+        // streaming and document loaders give the same schema
+        schema3::Minsky streamed;
+        ifstream f1("streamLoad.mky");
+        CHECK(schema3::streamLoad(f1, streamed));
+        ifstream f2("streamLoad.mky");
+        xml_unpack_t unpacker(f2);
+        schema3::Minsky document(unpacker);
+        CHECK_EQUAL(1, streamed.groups.size());
+        CHECK_EQUAL(document.items.size(), streamed.items.size());
+        // whitespace surrounding the tensorData payload is not significant
+        for (auto m: {&streamed, &document})
+          for (auto& i: m->items)
+            if (i.tensorData)
+              i.tensorData=encode(decode(*i.tensorData));
+        ostringstream s1, s2;
+        xml_pack_t p1(s1), p2(s2);
+        xml_pack(p1, "Minsky", streamed);
+        xml_pack(p2, "Minsky", document);
+        CHECK_EQUAL(s2.str(), s1.str());
+
+        load("streamLoad.mky");
+        bool found=false;
+        model->recursiveDo(&GroupItems::items, [&](Items&, Items::iterator i) {
+            if (auto v=(*i)->variableCast())
+              if (v->name()=="p")
+                {
+                  found=true;
+                  CHECK_EQUAL(6, v->vValue()->tensorInit.size());
+                  CHECK_EQUAL(5, v->vValue()->tensorInit[5]);
+                }
+            return false;
+          });
+        CHECK(found);
+      }
+
+    TEST_FIXTURE(TestFixture, binaryModel)
+      {
+        auto param=model->addItem(VariablePtr(VariableType::parameter,"p"));
+        auto& tensorInit=dynamic_cast<VariableBase&>(*param).vValue()->tensorInit;
+        tensorInit.hypercube(civita::Hypercube(vector<unsigned>{30,20}));
+        for (size_t i=0; i<tensorInit.size(); ++i) tensorInit[i]=i%7;
+        auto op=model->addItem(OperationBase::create(OperationType::exp));
+        model->addWire(*param, *op, 1);
+        save("binaryModel.mky");
+
+        auto checkTensor=[&]() {
+          bool found=false;
+          model->recursiveDo(&GroupItems::items, [&](Items&, Items::iterator i) {
+              if (auto v=(*i)->variableCast())
+                if (v->name()=="p")
+                  {
+                    found=true;
+                    CHECK_EQUAL(600, v->vValue()->tensorInit.size());
+                    CHECK_EQUAL(599%7, v->vValue()->tensorInit[599]);
+                  }
+              return false;
+            });
+          CHECK(found);
+          CHECK_EQUAL(2, model->items.size());
+          CHECK_EQUAL(1, model->wires.size());
+        };
+
+        for (bool compress: {false, true})
+          {
+            saveBinary("binaryModel.mkb", compress);
+            ifstream f("binaryModel.mkb", ios::binary);
+            CHECK(schema3::isBinaryModel(f));
+            clearAllMaps();
+            load("binaryModel.mkb");
+            checkTensor();
+          }
+
+        // XML -> binary -> XML conversion is lossless
+        auto readXML=[](const string& file) {
+          ifstream f(file);
+          xml_unpack_t unpacker(f);
+          schema3::Minsky m(unpacker);
+          for (auto& i: m.items)
+            if (i.tensorData)
+              i.tensorData=encode(decode(*i.tensorData));
+          ostringstream s;
+          xml_pack_t p(s);
+          xml_pack(p, "Minsky", m);
+          return s.str();
+        };
+        convertModelFile("binaryModel.mky", "binaryModel.mkb");
+        convertModelFile("binaryModel.mkb", "binaryModel2.mky");
+        CHECK_EQUAL(readXML("binaryModel.mky"), readXML("binaryModel2.mky"));
+        clearAllMaps();
+        load("binaryModel.mkb");
+        checkTensor();
+      }
+
+    TEST_FIXTURE(TestFixture, undoHistory)
+      {
+        auto param=model->addItem(VariablePtr(VariableType::parameter,"p"));
+        auto& tensorInit=dynamic_cast<VariableBase&>(*param).vValue()->tensorInit;
+        tensorInit.hypercube(civita::Hypercube(vector<unsigned>{1000,100}));
+        for (size_t i=0; i<tensorInit.size(); ++i) tensorInit[i]=i;
+        size_t tensorBytes=tensorInit.size()*sizeof(double);
+
+        CHECK(pushHistory());
+        CHECK(!pushHistory());
+        auto memory=history.memoryUsage();
+        CHECK(memory>tensorBytes);
+
+        // unchanged tensor data is shared with the previous state
+        auto op=model->addItem(OperationBase::create(OperationType::exp));
+        model->addWire(*param, *op, 1);
+        CHECK(pushHistory());
+        CHECK_EQUAL(2, history.size());
+        CHECK(history.memoryUsage()-memory < tensorBytes);
+
+        undo(1);
+        CHECK_EQUAL(1, model->items.size());
+        CHECK_EQUAL(0, model->wires.size());
+        auto v=model->items[0]->variableCast();
+        CHECK(v);
+        if (v)
+          {
+            CHECK_EQUAL(100000, v->vValue()->tensorInit.size());
+            CHECK_EQUAL(99999, v->vValue()->tensorInit[99999]);
+          }
+        undo(-1);
+        CHECK_EQUAL(2, model->items.size());
+        CHECK_EQUAL(1, model->wires.size());
+
+        // oldest states are discarded to keep within the memory budget
+        historyMemoryBudget=memory/2;
+        model->addItem(VariablePtr(VariableType::flow,"x"));
+        CHECK(pushHistory());
+        CHECK_EQUAL(1, history.size());
+        CHECK(history.memoryUsage()<2*memory);
+        clearHistory();
+        CHECK_EQUAL(0, history.memoryUsage());
+      }
+
+    TEST_FIXTURE(TestFixture, undoHistoryTensorTimestamp)
+      {
+        auto param=model->addItem(VariablePtr(VariableType::parameter,"p"));
+        auto valueId=param->variableCast()->valueId();
+        auto value=variableValues[valueId];
+        value->tensorInit.hypercube(civita::Hypercube(vector<unsigned>{10}));
+        for (size_t i=0; i<value->tensorInit.size(); ++i) value->tensorInit[i]=i;
+        CHECK(pushHistory());
+        CHECK(!pushHistory());
+
+        // setting the hypercube updates the timestamp, so the new data is recorded
+        value->tensorInit.hypercube(civita::Hypercube(vector<unsigned>{10}));
+        for (size_t i=0; i<value->tensorInit.size(); ++i) value->tensorInit[i]=2*i;
+        CHECK(pushHistory());
+        CHECK_EQUAL(2, history.size());
+
+        undo(1);
+        CHECK_EQUAL(9, variableValues[valueId]->tensorInit[9]);
+        undo(-1);
+        CHECK_EQUAL(18, variableValues[valueId]->tensorInit[9]);
+      }
+
+    TEST_FIXTURE(TestFixture, autoSaver)
+      {
+        auto param=model->addItem(VariablePtr(VariableType::parameter,"p"));
+        auto& tensorInit=dynamic_cast<VariableBase&>(*param).vValue()->tensorInit;
+        tensorInit.hypercube(civita::Hypercube(vector<unsigned>{30,20}));
+        for (size_t i=0; i<tensorInit.size(); ++i) tensorInit[i]=i;
+        pushHistory();
+        {
+          AutoSaver saver("autoSaver.mky");
+          saver.save(history.snapshot());
+          // the model can change whilst the snapshot is being written
+          model->addItem(OperationBase::create(OperationType::exp));
+          pushHistory();
+          saver.save(history.snapshot());
+          saver.flush();
+          CHECK(!boost::filesystem::exists("autoSaver.mky.tmp"));
+        }
+        clearAllMaps();
+        load("autoSaver.mky");
+        CHECK_EQUAL(2, model->items.size());
+        bool found=false;
+        for (auto& i: model->items)
+          if (auto v=i->variableCast())
+            {
+              found=true;
+              CHECK_EQUAL(600, v->vValue()->tensorInit.size());
+              CHECK_EQUAL(599, v->vValue()->tensorInit[599]);
+            }
+        CHECK(found);
+
+        AutoSaver badSaver("nonexistentDir/autoSaver.mky");
+        badSaver.save(history.snapshot());
+        CHECK_THROW(badSaver.flush(), std::exception);
+      }
+
+    TEST(blockEncode)
+      {
+        auto savedSettings=encodeSettings;
+        encodeSettings.blockSize=1000;
+        for (size_t n: {0, 999, 1000, 1001, 54321})
+          {
+            pack_t buf;
+            for (size_t i=0; i<n; ++i) buf<<char(i%7);
+            auto decoded=decode(encode(buf));
+            CHECK_EQUAL(buf.size(), decoded.size());
+            CHECK(memcmp(buf.data(), decoded.data(), buf.size())==0);
+          }
+        // data written as a single stream is still readable
+        pack_t buf;
+        for (int i=0; i<10000; ++i) buf<<i;
+        encodeSettings.blockSize=buf.size();
+        auto encoded=encode(buf);
+        encodeSettings.blockSize=100;
+        auto decoded=decode(encoded);
+        CHECK_EQUAL(buf.size(), decoded.size());
+        CHECK(memcmp(buf.data(), decoded.data(), buf.size())==0);
+        encodeSettings=savedSettings;
+      }
+
+    TEST_FIXTURE(TestFixture, lazyTensorData)
+      {
+        auto savedSettings=encodeSettings;
+        encodeSettings.blockSize=1000;
+        auto param=model->addItem(VariablePtr(VariableType::parameter,"p"));
+        auto& tensorInit=dynamic_cast<VariableBase&>(*param).vValue()->tensorInit;
+        tensorInit.hypercube(civita::Hypercube(vector<unsigned>{30,20}));
+        for (size_t i=0; i<tensorInit.size(); ++i) tensorInit[i]=i%7;
+
+        schema3::TensorPayloads tensors;
+        schema3::Minsky encoded(*this), binary(*this, &tensors);
+        encodeSettings=savedSettings;
+        for (bool fromBinary: {false, true})
+          {
+            clearAllMaps();
+            model->clear();
+            if (fromBinary)
+              binary.populateGroup(*model, tensors);
+            else
+              encoded.populateGroup(*model);
+            CHECK_EQUAL(1, model->items.size());
+            auto v=model->items[0]->variableCast();
+            CHECK(v);
+            if (!v) continue;
+            auto& init=v->vValue()->tensorInit;
+            // structure is available without decoding the data
+            CHECK(init.deferredData());
+            CHECK_EQUAL(600, init.size());
+            CHECK_EQUAL(2, init.rank());
+            CHECK_EQUAL(20, init.hypercube().xvectors[1].size());
+            CHECK(init.deferredData());
+            CHECK_EQUAL(599%7, init[599]);
+            CHECK(!init.deferredData());
+          }
+
+        // recording history on opening a model, and saving it again,
+        // keep the data encoded
+        clearAllMaps();
+        model->clear();
+        encoded.populateGroup(*model);
+        {
+          auto& init=model->items[0]->variableCast()->vValue()->tensorInit;
+          CHECK(pushHistory());
+          CHECK(init.deferredData());
+          schema3::Minsky resaved(*this);
+          CHECK(init.deferredData());
+          CHECK(resaved.items[0].tensorData && encoded.items[0].tensorData &&
+                *resaved.items[0].tensorData==*encoded.items[0].tensorData);
+          undo(0);
+          auto& restored=model->items[0]->variableCast()->vValue()->tensorInit;
+          CHECK(restored.deferredData());
+          CHECK_EQUAL(599%7, restored[599]);
+          clearHistory();
+        }
+
+        // data is decoded when the variable is reset
+        clearAllMaps();
+        model->clear();
+        binary.populateGroup(*model, tensors);
+        reset();
+        auto v=model->items[0]->variableCast();
+        CHECK(!v->vValue()->tensorInit.deferredData());
+        CHECK_EQUAL(598%7, (*v->vValue())[598]);
+      }
+
+    TEST_FIXTURE(TestFixture, mappedTensorData)
+      {
+        mappedTensorThreshold=1000;
+        auto param=model->addItem(VariablePtr(VariableType::parameter,"p"));
+        auto value=dynamic_cast<VariableBase&>(*param).vValue();
+        value->tensorInit.hypercube(civita::Hypercube(vector<unsigned>{30,20}));
+        double total=0;
+        for (size_t i=0; i<value->tensorInit.size(); ++i)
+          total+=value->tensorInit[i]=i%7;
+        auto op=model->addItem(OperationBase::create(OperationType::sum));
+        auto result=model->addItem(VariablePtr(VariableType::flow,"r"));
+        model->addWire(*param, *op, 1);
+        model->addWire(*op, *result, 1);
+        reset();
+
+        // values are read in place, rather than held in the value vector
+        CHECK(value->tensorInit.readInPlace());
+        CHECK(value->inPlace());
+        CHECK(ValueVector::flowVars.size()<value->size());
+        CHECK_EQUAL(599%7, value->value(599));
+        CHECK_EQUAL(total, result->variableCast()->value());
+
+        // the undo history shares the mapped data
+        pushHistory();
+        model->addItem(VariablePtr(VariableType::flow,"x"));
+        pushHistory();
+        undo();
+        bool found=false;
+        model->recursiveDo(&GroupItems::items, [&](Items&, Items::iterator i) {
+            if (auto v=(*i)->variableCast())
+              if (v->name()=="p")
+                {
+                  found=true;
+                  auto& init=v->vValue()->tensorInit;
+                  CHECK(init.deferredData()==value->tensorInit.deferredData());
+                  CHECK_EQUAL(599%7, init[599]);
+                }
+            return false;
+          });
+        CHECK(found);
+      }
+
+    TEST_FIXTURE(TestFixture, singlePrecisionParameters)
+      {
+        singlePrecisionParameters=true;
+        auto param=model->addItem(VariablePtr(VariableType::parameter,"p"));
+        auto value=dynamic_cast<VariableBase&>(*param).vValue();
+        value->tensorInit.hypercube(civita::Hypercube(vector<unsigned>{30,20}));
+        double total=0;
+        for (size_t i=0; i<value->tensorInit.size(); ++i)
+          total+=value->tensorInit[i]=0.1*i;
+        auto op=model->addItem(OperationBase::create(OperationType::sum));
+        auto result=model->addItem(VariablePtr(VariableType::flow,"r"));
+        model->addWire(*param, *op, 1);
+        model->addWire(*op, *result, 1);
+        reset();
+
+        auto storage=dynamic_cast<const InPlaceTensorData*>(value->tensorInit.deferredData().get());
+        CHECK(storage && storage->singlePrecision());
+        if (!storage) return;
+        CHECK_EQUAL(600*sizeof(float), storage->residentBytes());
+        CHECK(value->inPlace());
+        CHECK_EQUAL(float(59.9), value->value(599));
+        CHECK(storage->precisionLoss.maxRel>0 && storage->precisionLoss.maxRel<1e-7);
+        CHECK_CLOSE(total, result->variableCast()->value(), 1e-6*total);
+        CHECK(tensorStorageReport().find("\tsingle\t")!=string::npos);
+
+        // saved in full precision, along with the setting
+        schema3::Minsky saved(*this);
+        CHECK(saved.singlePrecisionParameters);
+        bool found=false;
+        for (auto& i: saved.items)
+          if (i.tensorData)
+            {
+              found=true;
+              auto buf=decode(*i.tensorData);
+              uint64_t n;
+              double x;
+              buf>>n;
+              for (size_t j=0; j<600; ++j) buf>>x;
+              CHECK_EQUAL(0.1*599, x);
+            }
+        CHECK(found);
+
+        // and restored by undo in full precision
+        auto valueId=param->variableCast()->valueId();
+        pushHistory();
+        model->addItem(VariablePtr(VariableType::flow,"x"));
+        pushHistory();
+        undo();
+        value=variableValues[valueId];
+        const civita::TensorVal& restored=value->tensorInit;
+        CHECK_EQUAL(0.1*599, restored[599]);
+
+        // back to double precision, without loss
+        singlePrecisionParameters=false;
+        reset();
+        CHECK(!value->tensorInit.deferredData());
+        CHECK(!value->inPlace());
+        CHECK_EQUAL(0.1*599, value->value(599));
+      }
+
+    TEST_FIXTURE(TestFixture, equationCache)
+      {
+        integrateConstant();
+        equationCacheDir=".";
+        reset();
+        auto cacheFile=EquationCache::fileName(*this,equationCacheDir);
+        CHECK(boost::filesystem::exists(cacheFile));
+        CHECK_EQUAL(0, equationCacheHits);
+        step();
+        step();
+        double tc=t;
+        auto stocks=stockVars;
+        auto numEquations=equations.size();
+
+        // second reset should install equations from the cache
+        reset();
+        CHECK_EQUAL(1, equationCacheHits);
+        CHECK_EQUAL(numEquations, equations.size());
+        CHECK_EQUAL(1, integrals.size());
+        step();
+        step();
+        CHECK_EQUAL(tc, t);
+        CHECK_ARRAY_CLOSE(stocks, stockVars, stocks.size(), 1e-10);
+        boost::filesystem::remove(cacheFile);
+      }
+    
+    TEST(frameRing)
+      {
+        FrameRing ring(2,3);
+        double frame[2];
+        for (int i=0; i<4; ++i)
+          {
+            frame[0]=i; frame[1]=2*i;
+            CHECK_EQUAL(i<3, ring.push(frame));
+          }
+        CHECK_EQUAL(3, ring.size());
+        CHECK_EQUAL(1, ring.dropped());
+        for (int i=0; i<3; ++i)
+          {
+            CHECK(ring.pop(frame));
+            CHECK_EQUAL(i, frame[0]);
+            CHECK_EQUAL(2*i, frame[1]);
+          }
+        CHECK(!ring.pop(frame));
+      }
+
+    TEST_FIXTURE(TestFixture, freeRun)
+      {
+        integrateConstant();
+        reset();
+        startFreeRun();
+        CHECK(freeRunning());
+        while (t==0)
+          {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            pollFreeRun();
+          }
+        stopFreeRun();
+        CHECK(!freeRunning());
+        CHECK(t>0);
+        CHECK_CLOSE(10*t, integrals[0].stock.value(), 1e-5);
+
+        // the solver stops itself at tmax
+        reset();
+        startFreeRun(1);
+        while (freeRunning())
+          {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            pollFreeRun();
+          }
+        CHECK(t>=1);
+        CHECK_CLOSE(10*t, integrals[0].stock.value(), 1e-5);
+      }
+
+    TEST_FIXTURE(TestFixture, freeRunParameterChange)
+      {
+        auto param=model->addItem(VariablePtr(VariableType::parameter,"p"));
+        auto op=model->addItem(OperationPtr(OperationBase::integrate));
+        model->addWire(*param,*op,1);
+        param->variableCast()->init("1");
+        nSteps=1;
+        reset();
+        startFreeRun();
+        while (t==0)
+          {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            pollFreeRun();
+          }
+        // a parameter set whilst free running is picked up by the solver
+        param->variableCast()->value(0);
+        double tChanged=t;
+        while (t<tChanged+1)
+          {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            pollFreeRun();
+            CHECK_EQUAL(0, param->variableCast()->value());
+          }
+        stopFreeRun();
+        CHECK(integrals[0].stock.value()<t-0.5);
+      }
+    
+    TEST_FIXTURE(TestFixture, binaryLog)
+      {
+        integrateConstant();
+        reset();
+        logVarList.insert(":output");
+
+        openLogFile("log.txt");
+        for (int i=0; i<5; ++i) step();
+        closeLogFile();
+
+        reset();
+        binaryLog=true;
+        openLogFile("log.bin");
+        for (int i=0; i<5; ++i) step();
+        closeLogFile();
+        convertBinaryLog("log.bin","log2.txt");
+
+        ifstream text("log.txt"), converted("log2.txt");
+        string textLine, convertedLine;
+        int lines=0;
+        while (getline(text,textLine))
+          {
+            CHECK(getline(converted,convertedLine));
+            CHECK_EQUAL(textLine, convertedLine);
+            lines++;
+          }
+        CHECK_EQUAL(6, lines);
+      }
+
+    TEST(logWriteError)
+      {
+        // every write to /dev/full fails
+        if (!boost::filesystem::exists("/dev/full")) return;
+        DataLogger logger("/dev/full", {DataLogger::Column("x")}, DataLogger::text, 1);
+        vector<double> stocks, flows{1};
+        CHECK_THROW(for (int i=0; i<10; ++i) logger.log(i, stocks, flows); logger.close(),
+                    ecolab::error);
+      }
+    
+    TEST_FIXTURE(TestFixture, timeSeries)
+      {
+        auto& integral=integrateConstant();
+        recordTimeSeries=true;
+        reset();
+        for (int i=0; i<10; ++i) step();
+        CHECK_EQUAL(11, timeSeriesSize());
+        auto names=timeSeriesNames();
+        CHECK(find(names.begin(), names.end(), ":output")!=names.end());
+
+        auto r=timeSeriesQuery(":output", 0, t, 100);
+        CHECK_EQUAL(22, r.size());
+        for (size_t i=0; i<r.size(); i+=2)
+          CHECK_CLOSE(10*r[i], r[i+1], 1e-5);
+
+        // downsampled query returns interval extrema
+        r=timeSeriesQuery(":output", 0, t, 4);
+        CHECK_EQUAL(8, r.size());
+        CHECK_EQUAL(0, r[0]);
+        CHECK_CLOSE(t, r[6], 1e-10);
+
+        // plots of recorded variables are exported from the full history
+        auto plot=model->addItem(new PlotWidget);
+        model->addWire(*integral.intVar, *plot, 6);
+        reset();
+        for (int i=0; i<10; ++i) step();
+        exportAllPlotsAsCSV("timeSeries");
+        ifstream f("timeSeries-0.csv");
+        string buf;
+        getline(f, buf);
+        CHECK_EQUAL("t,:output", buf);
+        size_t lines=0;
+        while (getline(f, buf)) ++lines;
+        CHECK_EQUAL(timeSeriesSize(), lines);
+        f.close();
+        boost::filesystem::remove("timeSeries-0.csv");
+      }
+
+    TEST(timeSeriesEviction)
+      {
+        TimeSeriesStore store;
+        store.chunkSize=10;
+        store.uncompressedChunks=1;
+        store.maxRecords=25;
+        store.setColumns({TimeSeriesStore::Column("x",false,0)});
+        vector<double> stocks(1), flows;
+        for (int i=0; i<100; ++i)
+          {
+            stocks[0]=i;
+            store.append(i, stocks, flows);
+          }
+        // oldest chunks are discarded
+        CHECK(store.size()>=25 && store.size()<=25+2*store.chunkSize);
+        size_t n=0;
+        double first=-1;
+        store.visit(0, [&](const double* t, const double* y, size_t m)
+                    {
+                      if (first<0) first=t[0];
+                      for (size_t i=0; i<m; ++i)
+                        CHECK_EQUAL(t[i], y[i]);
+                      n+=m;
+                    });
+        CHECK_EQUAL(store.size(), n);
+        CHECK_EQUAL(100-n, first);
+      }
+    
 }
@@ -22,6 +22,7 @@
 #include "selection.h"
 #include "xvector.h"
 #include "minskyTensorOps.h"
+#include "ravelWrap.h"
 #include "minsky.h"
 #include "minsky_epilogue.h"
 #include <UnitTest++/UnitTest++.h>
@@ -230,6 +231,51 @@ SUITE(TensorOps)
       }
     }
 
+  TEST_FIXTURE(TestFixture, tensorArena)
+    {
+      Operation<OperationType::runningSum> theOp;
+      Wire w1(from.ports[0], theOp.ports[1]), w2(theOp.ports[0], to.ports[1]);
+      auto ev=make_shared<EvalCommon>();
+      ev->arena=new TensorArena;
+      auto& arena=*ev->arena;
+      {
+        TensorEval eval(to.vValue(), ev, TensorOpFactory().create(theOp,TensorsFromPort(ev)));
+        // the operation, its argument and its cached result are
+        // allocated from the arena
+        auto& toVal=*to.vValue();
+        CHECK(arena.inUse()>toVal.size()*sizeof(double));
+        eval.eval(ValueVector::flowVars.data(), ValueVector::flowVars.size(), ValueVector::stockVars.data());
+        for (size_t i=0; i<toVal.size(); ++i)
+          CHECK_EQUAL((i+1)*(i+2)/2,toVal[i]);
+      }
+      // everything is returned to the arena once the evaluation is released
+      CHECK_EQUAL(0,arena.inUse());
+      CHECK(arena.highWater()>0);
+      CHECK(arena.capacity()>=arena.highWater());
+    }
+
+  TEST(tensorArenaReuse)
+    {
+      TensorArenaPtr arena=new TensorArena;
+      civita::TensorVal escaped;
+      {
+        civita::TensorVal result(arena.get());
+        // blocks freed as a result grows are reused, rather than the
+        // arena growing
+        for (unsigned i=1; i<100; ++i)
+          result.hypercube(civita::Hypercube(vector<unsigned>{10*i}));
+        CHECK_EQUAL(TensorArena::defaultSlabSize, arena->capacity());
+        // blocks too large for a slab do not count towards its size
+        auto highWater=arena->highWater();
+        result.hypercube(civita::Hypercube(vector<unsigned>{unsigned(TensorArena::defaultSlabSize)}));
+        CHECK_EQUAL(highWater, arena->highWater());
+        // a result moved out of the graph is copied to the heap
+        escaped=std::move(result);
+      }
+      CHECK_EQUAL(TensorArena::defaultSlabSize, escaped.size());
+      CHECK_EQUAL(0, arena->inUse());
+    }
+
   TEST_FIXTURE(TestFixture, difference2D)
     {
       vector<unsigned> dims{5,5};
@@ -389,6 +435,39 @@ SUITE(TensorOps)
         }
     }
   
+  TEST_FIXTURE(MinskyFixture, ravelWithTwoConsumers)
+    {
+      Variable<VariableType::flow> src("src");
+      Ravel ravel;
+      Wire w(src.ports[0], ravel.ports[1]);
+      src.init("iota(6)");
+      variableValues.reset();
+      auto value=src.vValue();
+      value->hypercube(civita::Hypercube(vector<unsigned>{3,2}));
+      // each graph reads the source through its own flow variables
+      auto flows1=ValueVector::flowVars, flows2=flows1;
+      for (size_t i=0; i<value->size(); ++i)
+        {
+          flows1[value->idx()+i]=i;
+          flows2[value->idx()+i]=100+i;
+        }
+      auto ev1=make_shared<EvalCommon>(), ev2=make_shared<EvalCommon>();
+      ev1->update(flows1.data(), flows1.size(), ValueVector::stockVars.data());
+      ev2->update(flows2.data(), flows2.size(), ValueVector::stockVars.data());
+
+      TensorOpFactory factory;
+      auto graph1=factory.create(ravel, TensorsFromPort(ev1));
+      auto graph2=factory.create(ravel, TensorsFromPort(ev2));
+      CHECK_EQUAL(6, graph1->size());
+      CHECK_EQUAL(graph1->size(), graph2->size());
+      // building the second graph leaves the first reading its own argument
+      for (size_t i=0; i<graph1->size(); ++i)
+        {
+          CHECK((*graph1)[i]<100);
+          CHECK_EQUAL((*graph1)[i]+100, (*graph2)[i]);
+        }
+    }
+
   TEST_FIXTURE(MinskyFixture, tensorBinOpFactory)
     {
       TensorOpFactory factory;
@@ -600,4 +679,163 @@ SUITE(TensorOps)
       vector<size_t> dims={2,2};
       CHECK_ARRAY_EQUAL(dims, chain.back()->shape(), 2);
     }
+
+    TEST(odometer)
+    {
+      Hypercube hc;
+      hc.xvectors={XVector("a",{"1","2","3"}),XVector("b",{"1","2"}),XVector("c",{"1","2","3","4"})};
+      vector<size_t> strides{1,3,6};
+      CHECK_ARRAY_EQUAL(strides, hc.strides(), 3);
+      hc.xvectors[0].push_back("4"); // strides follow modification
+      strides={1,4,8};
+      CHECK_ARRAY_EQUAL(strides, hc.strides(), 3);
+
+      // walk hc in transposed order (c,b,a), with b relabelled in reverse
+      vector<size_t> targetStrides{8,4,1};
+      Odometer odometer(hc, targetStrides);
+      odometer.mapAxis(1,{1,0});
+      for (size_t i=0; i<hc.numElements(); ++i, ++odometer)
+        {
+          auto idx=hc.splitIndex(i);
+          CHECK_EQUAL(i, odometer.position());
+          CHECK_EQUAL(idx[0]*8+(1-idx[1])*4+idx[2], odometer.target());
+          CHECK_EQUAL(odometer.target(), odometer.targetOf(i));
+        }
+      odometer.seek(13);
+      CHECK_EQUAL(13, odometer.position());
+      CHECK_EQUAL(1*8+0*4+1*1, odometer.target());
+      CHECK_EQUAL(odometer.target(), odometer(13));
+    }
+
+    TEST_FIXTURE(TensorValFixture, sparsePartialPivot)
+    {
+      arg->index({0,4,8,12,16});
+      for (size_t i=0; i<arg->size(); ++i) (*arg)[i]=arg->index()[i];
+      Pivot pivot;
+      pivot.setArgument(arg);
+      // sex is not listed, so is placed last
+      pivot.setOrientation({"date","country"});
+      auto& phc=pivot.hypercube();
+      CHECK_EQUAL("sex",phc.xvectors[2].name);
+      auto& ahc=arg->hypercube();
+      for (size_t i=0; i<pivot.size(); ++i)
+        {
+          auto idx=phc.splitIndex(pivot.index()[i]);
+          CHECK_EQUAL(ahc.linealIndex({idx[1],idx[2],idx[0]}), pivot[i]);
+        }
+    }
+
+    TEST_FIXTURE(TensorValFixture, materialisedPivot)
+    {
+      Pivot pivot, materialised;
+      pivot.setArgument(arg);
+      pivot.setOrientation({"date","country"});
+      materialised.setArgument(arg);
+      materialised.setOrientation({"date","country"});
+      materialised.materialise(true);
+      for (size_t i=0; i<pivot.size(); ++i)
+        CHECK_EQUAL(pivot[i], materialised[i]);
+
+      // argument updates are picked up at the start of the next pass
+      (*arg)[1]=100;
+      arg->updateTimestamp();
+      for (size_t i=0; i<pivot.size(); ++i)
+        CHECK_EQUAL(pivot[i], materialised[i]);
+
+      auto permuteAxis=make_shared<PermuteAxis>();
+      permuteAxis->setArgument(arg,"country");
+      permuteAxis->setPermutation({2,0});
+      materialised.setArgument(permuteAxis);
+      materialised.setOrientation({"date","country"});
+      pivot.setArgument(permuteAxis);
+      pivot.setOrientation({"date","country"});
+      CHECK_EQUAL(12, materialised.size());
+      for (size_t i=0; i<pivot.size(); ++i)
+        CHECK_EQUAL(pivot[i], materialised[i]);
+    }
+
+    TEST_FIXTURE(TensorValFixture, incrementalRavelChain)
+    {
+      state.handleStates["sex"].sliceLabel="male";
+      state.outputHandles={"date","country"};
+      RavelChain ravelChain;
+      ravelChain.update(state, arg);
+      auto chain=ravelChain.chain();
+      CHECK_EQUAL(3, chain.size());
+      vector<double> expected={0,6,12,1,7,13,2,8,14};
+      CHECK_ARRAY_EQUAL(expected, *chain.back(), 9);
+
+      // changing the slice reuses the existing operations
+      state.handleStates["sex"].sliceLabel="female";
+      ravelChain.update(state, arg);
+      CHECK(chain==ravelChain.chain());
+      expected={3,9,15,4,10,16,5,11,17};
+      CHECK_ARRAY_EQUAL(expected, *chain.back(), 9);
+
+      state.outputHandles={"country","date"};
+      ravelChain.update(state, arg);
+      CHECK(chain==ravelChain.chain());
+      expected={3,4,5,9,10,11,15,16,17};
+      CHECK_ARRAY_EQUAL(expected, *chain.back(), 9);
+
+      // an argument of the same shape is swapped in
+      auto newArg=make_shared<TensorVal>();
+      newArg->hypercube(arg->hypercube());
+      for (size_t i=0; i<newArg->size(); ++i) (*newArg)[i]=2*i;
+      newArg->updateTimestamp();
+      ravelChain.update(state, newArg);
+      CHECK(chain[1]==ravelChain.chain()[1]);
+      expected={6,8,10,18,20,22,30,32,34};
+      CHECK_ARRAY_EQUAL(expected, *ravelChain.chain().back(), 9);
+
+      // cached reductions follow changes to the argument's data
+      state.handleStates["sex"].collapsed=true;
+      ravelChain.update(state, newArg);
+      expected={6,10,14,30,34,38,54,58,62};
+      CHECK_ARRAY_EQUAL(expected, *ravelChain.chain().back(), 9);
+      (*newArg)[0]=100;
+      newArg->updateTimestamp();
+      expected={106,10,14,30,34,38,54,58,62};
+      CHECK_ARRAY_EQUAL(expected, *ravelChain.chain().back(), 9);
+    }
+
+    TEST_FIXTURE(TensorValFixture, sparseFormats)
+    {
+      arg->index({0,4,8,12,16});
+      // compress along date
+      AxisCompressedIndex fibres(arg->hypercube(), arg->index(), 2);
+      CHECK_EQUAL(3, fibres.numFibres());
+      vector<size_t> expectedFibres={0,2,4};
+      CHECK_ARRAY_EQUAL(expectedFibres, fibres.fibres(), 3);
+      CHECK_EQUAL(2, fibres.fibreEnd(0)-fibres.fibreBegin(0));
+      CHECK_EQUAL(0, fibres.entry(fibres.fibreBegin(0)));
+      CHECK_EQUAL(3, fibres.entry(fibres.fibreBegin(0)+1));
+      CHECK_EQUAL(2, fibres.axisIndex(fibres.fibreBegin(0)+1));
+
+      HashedIndex hashed(arg->index());
+      CHECK_EQUAL(3, hashed.linealOffset(12));
+      CHECK_EQUAL(5, hashed.linealOffset(5));
+
+      Sum sum;
+      sum.setArgument(arg,"date",0);
+      CHECK_EQUAL(3, sum.size());
+      vector<double> expected={3,2,5};
+      CHECK_ARRAY_EQUAL(expected, sum, 3);
+
+      // scans keep the argument's sparsity
+      arg->updateTimestamp();
+      Scan scan([](double& x,double y,size_t){x+=y;}, arg, "date");
+      CHECK(scan.index()==arg->index());
+      expected={0,1,2,3,5};
+      CHECK_ARRAY_EQUAL(expected, scan, 5);
+
+      auto other=make_shared<TensorVal>();
+      other->index({4,5});
+      other->hypercube(arg->hypercube());
+      (*other)[0]=10; (*other)[1]=20;
+      BinOp add([](double x,double y){return x+y;}, arg, other);
+      CHECK_EQUAL(6, add.size());
+      CHECK_EQUAL(11, add[1]);
+      CHECK(std::isnan(add[0]));
+    }
 }
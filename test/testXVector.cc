@@ -178,4 +178,66 @@ SUITE(XVector)
       CHECK_THROW(push_back("foo"),std::exception);
 
     }
+
+  TEST(labelColumn)
+    {
+      XVector x("x",{"foo","bar","baz","bar"});
+      auto& c=x.labels();
+      CHECK_EQUAL(4,c.size());
+      // equal strings intern to the same id
+      CHECK_EQUAL(c.stringIds()[1],c.stringIds()[3]);
+      CHECK(c.equal(1,c,3));
+      CHECK_EQUAL(diff(x[0],x[1]),c.diff(0,1));
+      vector<size_t> forward{1,3,2,0}, reverse{0,2,1,3};
+      CHECK_ARRAY_EQUAL(forward,c.sortedOrder(),4);
+      CHECK_ARRAY_EQUAL(reverse,c.sortedOrder(true),4);
+
+      // copies share the string table until added to
+      XVector x1(x);
+      x1.push_back("qux");
+      CHECK_EQUAL(4,x.size());
+      CHECK_EQUAL(5,x1.size());
+      CHECK_EQUAL("qux",str(x1.back()));
+      x1.erase(x1.end()-1,x1.end());
+      CHECK(x==x1);
+
+      XVector t("t");
+      t.dimension.type=Dimension::time;
+      t.push_back("2019-01-01");
+      t.push_back("2018-04-01");
+      auto& tc=t.labels();
+      CHECK(Dimension::time==tc.type());
+      CHECK(tc.compare(0,1)>0);
+      CHECK_CLOSE(diff(t[0],t[1]),tc.diff(0,1),1e-3);
+      CHECK_EQUAL(ptime(date(2018,Apr,1)), any_cast<ptime>(t[1]));
+
+      // labels not of the dimension type are converted
+      XVector v("v");
+      v.dimension.type=Dimension::value;
+      v.push_back("3");
+      v.push_back(boost::any(string("1")));
+      CHECK_EQUAL(3,v.labels().values()[0]);
+      CHECK_EQUAL(1,v.labels().values()[1]);
+      CHECK(v.labels()!=x.labels());
+
+      // imposing a dimension rewrites the labels
+      XVector s("s",{"1","2"});
+      s.dimension.type=Dimension::value;
+      s.imposeDimension();
+      CHECK(Dimension::value==s.labels().type());
+      CHECK_EQUAL(2,any_cast<double>(s[1]));
+    }
+
+  TEST(makeConformant)
+    {
+      // independently built columns intern their strings to different ids
+      civita::Hypercube a, b;
+      a.xvectors.push_back(XVector("x",{"r","z","p"}));
+      b.xvectors.push_back(XVector("x",{"p","q","r"}));
+      a.makeConformant(b);
+      CHECK_EQUAL(1,a.rank());
+      CHECK_EQUAL(2,a.xvectors[0].size());
+      CHECK_EQUAL("r",str(a.xvectors[0][0]));
+      CHECK_EQUAL("p",str(a.xvectors[0][1]));
+    }
 }